@@ -0,0 +1,706 @@
+#pragma once
+
+// Host stand-in for the Arduino core, so the sketch builds and runs on
+// Linux. The build picks the board it pretends to be with ESP32 or
+// __AVR__, and defines ARDUINO_HOST.
+//
+// Nothing here touches real hardware. The pins, the clock and the serial
+// port are simulated, and the tests drive them through the hal namespace.
+// The clock is virtual: it only moves when the sketch waits, so the loop
+// runs at full host speed while seeing the times it would on the board.
+// FreeRTOS tasks are threads that take turns on the same clock: one runs
+// at a time, until it waits, and the clock only moves on once every task
+// due before then has had its turn. So the tasks run the same way every
+// time, however loaded the host is.
+//
+// The pins can also play back a recorded trace (hal::loadTrace), and a
+// serial port can be attached to file descriptors, eg. stdin and stdout
+// or a pty, for a driver to talk to while the sketch runs.
+
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT        0x01
+#define OUTPUT       0x03
+#define INPUT_PULLUP 0x05
+
+#define RISING  0x01
+#define FALLING 0x02
+#define CHANGE  0x03
+
+// Code the board keeps in RAM, meaningless here.
+#define IRAM_ATTR
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HAL_PIN_COUNT 64
+
+#if defined(__AVR__)
+  #define HAL_ANALOG_MAX 1023
+#else
+  #define HAL_ANALOG_MAX 4095
+#endif
+
+#if defined(__AVR__)
+  // Arduino Nano pin numbers.
+  #define A0 14
+  #define A1 15
+  #define A2 16
+  #define A3 17
+  #define A4 18
+  #define A5 19
+  #define A6 20
+  #define A7 21
+  #define LED_BUILTIN 13
+#endif
+
+#if defined(__AVR__)
+  // Port B is pins 8 to 13, C is 14 to 19 and D is 0 to 7, like the Nano.
+  #define HAL_PORT_B 2
+  #define HAL_PORT_C 3
+  #define HAL_PORT_D 4
+
+  namespace hal {
+    // The input registers, kept in step with the pin levels.
+    inline volatile uint8_t port_inputs[5];
+
+    inline uint8_t pinPort(int pin) {
+      return pin < 8 ? HAL_PORT_D : (pin < 14 ? HAL_PORT_B : HAL_PORT_C);
+    }
+
+    inline uint8_t pinBit(int pin) {
+      return pin < 8 ? pin : (pin < 14 ? pin - 8 : pin - 14);
+    }
+  }
+#endif
+
+// FreeRTOS, each task is a thread. The ESP32 ticks every millisecond.
+struct HostTask {
+  std::thread thread;
+  uint32_t notifications = 0;
+  // Virtual time the task runs again at.
+  unsigned long wake_at = 0;
+  // Whether a notification wakes it before then.
+  bool waiting_for_notification = false;
+  bool finished = false;
+};
+
+namespace hal {
+  // Thrown out of the blocking calls of a task being stopped, to unwind it.
+  struct TaskStopped {};
+
+  inline std::atomic<unsigned long> now_us(0);
+  inline std::atomic<int> analog_values[HAL_PIN_COUNT];
+  // Each reading is off from the set value by up to this much.
+  inline std::atomic<int> analog_noise(0);
+  inline std::atomic<int> digital_levels[HAL_PIN_COUNT];
+  // Levels driven by the sketch, kept apart from the inputs the test sets.
+  inline std::atomic<int> output_levels[HAL_PIN_COUNT];
+  inline void (*pin_interrupts[HAL_PIN_COUNT])();
+  inline uint8_t pin_interrupt_modes[HAL_PIN_COUNT];
+
+  inline std::atomic<bool> stopping_tasks(false);
+  inline thread_local bool in_task = false;
+  // Waits take real time as well, for a driver on the other end.
+  inline std::atomic<bool> real_time(false);
+
+  inline void checkStopping() {
+    if (in_task && stopping_tasks) throw TaskStopped();
+  }
+
+  // A task waiting for a notification with no timeout.
+  constexpr unsigned long NEVER = ~0ul;
+
+  inline std::mutex tasks_mutex;
+  // Signalled whenever the turn passes.
+  inline std::condition_variable task_switch;
+  inline std::vector<HostTask*> tasks;
+  // The task whose turn it is, NULL while the thread that moves the clock
+  // has it.
+  inline HostTask* running_task = NULL;
+  inline thread_local HostTask* current_task = NULL;
+
+  // Give a task the turn and wait for it to hand it back.
+  inline void runTask(std::unique_lock<std::mutex>& lock, HostTask* task) {
+    running_task = task;
+    task_switch.notify_all();
+    task_switch.wait(lock, []() { return running_task == NULL; });
+  }
+
+  // Called by a task: hand the turn back and wait until it is woken at the
+  // given time, or by a notification.
+  inline void blockTask(unsigned long wake_at) {
+    HostTask* task = current_task;
+    std::unique_lock<std::mutex> lock(tasks_mutex);
+    task->wake_at = wake_at;
+    running_task = NULL;
+    task_switch.notify_all();
+    task_switch.wait(lock, [task]() { return running_task == task; });
+    if (stopping_tasks) throw TaskStopped();
+  }
+
+  // Move the virtual clock on. The tasks due on the way run in the order
+  // they wake, each at the time it wakes.
+  inline void advance(unsigned long us) {
+    const unsigned long until = now_us + us;
+    std::unique_lock<std::mutex> lock(tasks_mutex);
+    for (;;) {
+      HostTask* next = NULL;
+      for (HostTask* task : tasks) {
+        if (task->finished || task->wake_at > until) continue;
+        if (next == NULL || task->wake_at < next->wake_at) next = task;
+      }
+      if (next == NULL) break;
+      if (next->wake_at > now_us) now_us = next->wake_at;
+      runTask(lock, next);
+    }
+    now_us = until;
+  }
+
+  inline void setAnalog(int pin, int value) {
+    analog_values[pin] = value;
+  }
+
+  // Returns the level the pin had.
+  inline int setLevel(int pin, int level) {
+    #if defined(__AVR__)
+      if (pin < 20) {
+        const uint8_t bit = 1 << pinBit(pin);
+        port_inputs[pinPort(pin)] = level ? port_inputs[pinPort(pin)] | bit : port_inputs[pinPort(pin)] & ~bit;
+      }
+    #endif
+    return digital_levels[pin].exchange(level);
+  }
+
+  // Set the level of an input pin, running its interrupt like the board
+  // would if the level changed.
+  inline void setDigital(int pin, int level) {
+    const int old = setLevel(pin, level ? HIGH : LOW);
+    if (pin_interrupts[pin] == NULL || old == (level ? HIGH : LOW)) return;
+
+    const uint8_t mode = pin_interrupt_modes[pin];
+    if (mode == CHANGE || (mode == RISING && level) || (mode == FALLING && !level)) {
+      pin_interrupts[pin]();
+    }
+  }
+
+  inline int outputLevel(int pin) {
+    return output_levels[pin];
+  }
+}
+
+inline unsigned long micros() {
+  hal::checkStopping();
+  return hal::now_us;
+}
+
+inline unsigned long millis() {
+  return micros() / 1000;
+}
+
+// A task hands the turn on until the clock gets there, anything else
+// moves the clock.
+inline void delayMicroseconds(unsigned int us) {
+  hal::checkStopping();
+  if (hal::in_task) {
+    hal::blockTask(hal::now_us + us);
+    return;
+  }
+  if (hal::real_time) std::this_thread::sleep_for(std::chrono::microseconds(us));
+  hal::advance(us);
+}
+
+inline void delay(unsigned long ms) {
+  delayMicroseconds(ms * 1000);
+}
+
+inline void yield() {}
+
+namespace hal {
+  // Pin values recorded over time. Each row holds until the virtual clock
+  // reaches the next one, the last row holds for good.
+  struct Trace {
+    std::vector<int> pins;
+    std::vector<bool> digital;
+    std::vector<unsigned long> times;
+    std::vector<std::vector<int>> rows;
+    unsigned long start = 0;
+    size_t next = 0;
+  };
+
+  inline std::mutex trace_mutex;
+  inline Trace trace;
+  inline std::atomic<bool> trace_loaded(false);
+  // Set while the trace is played or held still, the reads leave it alone.
+  inline thread_local bool playing_trace = false;
+
+  // Load a trace from a CSV file and start playing it from now. The header
+  // names the columns: time_us, then aN for analog pin N and dN for digital
+  // pin N. Each row is a time from the start in microseconds and the
+  // values. Returns false with the reason in the error.
+  inline bool loadTrace(const char* path, std::string& error) {
+    std::ifstream file(path);
+    if (!file) {
+      error = std::string("can't open ") + path;
+      return false;
+    }
+
+    Trace loaded;
+    std::string line;
+    std::getline(file, line);
+    std::stringstream header(line);
+    std::string column;
+    std::getline(header, column, ',');
+    if (column != "time_us") {
+      error = "the first column must be time_us";
+      return false;
+    }
+    while (std::getline(header, column, ',')) {
+      const int pin = column.size() > 1 ? atoi(column.c_str() + 1) : -1;
+      if ((column[0] != 'a' && column[0] != 'd') || pin < 0 || pin >= HAL_PIN_COUNT) {
+        error = "unknown column " + column;
+        return false;
+      }
+      loaded.pins.push_back(pin);
+      loaded.digital.push_back(column[0] == 'd');
+    }
+
+    for (int row = 2; std::getline(file, line); row++) {
+      if (line.empty() || line[0] == '#') continue;
+      std::stringstream values(line);
+      std::string value;
+      std::getline(values, value, ',');
+      const unsigned long time = strtoul(value.c_str(), NULL, 10);
+      if (!loaded.times.empty() && time < loaded.times.back()) {
+        error = "row " + std::to_string(row) + " goes back in time";
+        return false;
+      }
+      std::vector<int> pin_values;
+      while (std::getline(values, value, ',')) pin_values.push_back(atoi(value.c_str()));
+      if (pin_values.size() != loaded.pins.size()) {
+        error = "row " + std::to_string(row) + " doesn't have a value for every column";
+        return false;
+      }
+      loaded.times.push_back(time);
+      loaded.rows.push_back(pin_values);
+    }
+
+    std::lock_guard<std::mutex> lock(trace_mutex);
+    loaded.start = now_us;
+    trace = loaded;
+    trace_loaded = true;
+    return true;
+  }
+
+  // Whether every row of the trace has been played.
+  inline bool traceFinished() {
+    std::lock_guard<std::mutex> lock(trace_mutex);
+    return trace.next >= trace.rows.size();
+  }
+
+  // Set the pins to the rows of the trace the clock has reached. Called
+  // by the reads, the pins change as the sketch would see them.
+  inline void playTrace() {
+    if (!trace_loaded || playing_trace) return;
+
+    std::vector<std::pair<int, int>> levels;
+    {
+      std::lock_guard<std::mutex> lock(trace_mutex);
+      const unsigned long elapsed = now_us - trace.start;
+      while (trace.next < trace.rows.size() && trace.times[trace.next] <= elapsed) {
+        const std::vector<int>& row = trace.rows[trace.next++];
+        for (size_t i = 0; i < row.size(); i++) {
+          if (trace.digital[i]) levels.emplace_back(trace.pins[i], row[i]);
+          else analog_values[trace.pins[i]] = row[i];
+        }
+      }
+    }
+
+    // Outside the lock, a level change can run an interrupt that reads pins.
+    playing_trace = true;
+    for (const std::pair<int, int>& level : levels) setDigital(level.first, level.second);
+    playing_trace = false;
+  }
+}
+
+inline void noInterrupts() {}
+
+inline void interrupts() {}
+
+inline void pinMode(int pin, int mode) {
+  // Pull ups read high until something pulls them down.
+  if (mode == INPUT_PULLUP) hal::setLevel(pin, HIGH);
+}
+
+inline int digitalRead(int pin) {
+  hal::playTrace();
+  return hal::digital_levels[pin];
+}
+
+inline void digitalWrite(int pin, int level) {
+  hal::output_levels[pin] = level ? HIGH : LOW;
+}
+
+namespace hal {
+  // Conversions made by the calling thread, for the sampling benchmarks.
+  inline thread_local unsigned long analog_reads = 0;
+}
+
+inline int analogRead(int pin) {
+  hal::playTrace();
+  hal::analog_reads++;
+  const int noise = hal::analog_noise;
+  if (noise == 0) return hal::analog_values[pin];
+
+  static thread_local uint32_t random = 1;
+  random = random * 1664525u + 1013904223u;
+  const int offset = static_cast<int>(random >> 8) % (2 * noise + 1) - noise;
+  return constrain(hal::analog_values[pin] + offset, 0, HAL_ANALOG_MAX);
+}
+
+namespace hal {
+  // Read several pins in one go, like the ADC's scan modes. The trace
+  // holds still for the scan, so every pin is read at the same instant of
+  // it. Adds readings conversions of each pin to its sum.
+  inline void analogScan(const int* pins, uint8_t count, uint8_t readings, unsigned long* sums) {
+    playTrace();
+    playing_trace = true;
+    for (uint8_t n = 0; n < readings; n++) {
+      for (uint8_t i = 0; i < count; i++) sums[i] += analogRead(pins[i]);
+    }
+    playing_trace = false;
+  }
+}
+
+inline long map(long x, long in_min, long in_max, long out_min, long out_max) {
+  return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+inline int digitalPinToInterrupt(int pin) {
+  return pin;
+}
+
+inline void attachInterrupt(int interrupt, void (*handler)(), int mode) {
+  hal::pin_interrupts[interrupt] = handler;
+  hal::pin_interrupt_modes[interrupt] = mode;
+}
+
+inline void detachInterrupt(int interrupt) {
+  hal::pin_interrupts[interrupt] = NULL;
+}
+
+#if defined(__AVR__)
+  #define _BV(bit) (1 << (bit))
+  #define ISR(vector) void vector()
+
+  inline uint8_t digitalPinToPort(int pin) {
+    return hal::pinPort(pin);
+  }
+
+  inline uint8_t digitalPinToBitMask(int pin) {
+    return 1 << hal::pinBit(pin);
+  }
+
+  inline volatile uint8_t* portInputRegister(uint8_t port) {
+    return &hal::port_inputs[port];
+  }
+
+  // Pin change interrupts aren't simulated, the masks are only stored.
+  namespace hal {
+    inline volatile uint8_t pcicr;
+    inline volatile uint8_t pcmsk[3];
+  }
+  #define digitalPinToPCICR(pin)    (&hal::pcicr)
+  #define digitalPinToPCICRbit(pin) ((pin) < 8 ? 2 : ((pin) < 14 ? 0 : 1))
+  #define digitalPinToPCMSK(pin)    (&hal::pcmsk[digitalPinToPCICRbit(pin)])
+  #define digitalPinToPCMSKbit(pin) (hal::pinBit(pin))
+#endif
+
+// Base of the serial ports. Bytes fed in are read back by the sketch and
+// everything it writes is kept until the test takes it, unless the port
+// is attached to file descriptors. Safe to use from both tasks and the
+// test.
+class Stream {
+ public:
+  Stream() : write_room(128), input_fd(-1), output_fd(-1) {}
+
+  // Read from and write to file descriptors instead, eg. stdin and stdout
+  // or a pty. Reading only takes what has already arrived.
+  void attach(int input, int output) {
+    std::lock_guard<std::mutex> lock(mutex);
+    input_fd = input;
+    output_fd = output;
+  }
+
+  int available() {
+    std::lock_guard<std::mutex> lock(mutex);
+    receive();
+    return input.size();
+  }
+
+  int read() {
+    std::lock_guard<std::mutex> lock(mutex);
+    receive();
+    if (input.empty()) return -1;
+    const int next = static_cast<uint8_t>(input[0]);
+    input.erase(0, 1);
+    return next;
+  }
+
+  int peek() {
+    std::lock_guard<std::mutex> lock(mutex);
+    receive();
+    return input.empty() ? -1 : static_cast<uint8_t>(input[0]);
+  }
+
+  int availableForWrite() {
+    return write_room;
+  }
+
+  size_t write(const uint8_t* data, size_t length) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (output_fd < 0) {
+      output.append(reinterpret_cast<const char*>(data), length);
+      return length;
+    }
+
+    for (size_t written = 0; written < length;) {
+      const ssize_t count = ::write(output_fd, data + written, length - written);
+      if (count <= 0) return written;
+      written += count;
+    }
+    return length;
+  }
+
+  size_t write(const char* data, size_t length) {
+    return write(reinterpret_cast<const uint8_t*>(data), length);
+  }
+
+  size_t write(uint8_t value) {
+    return write(&value, 1);
+  }
+
+  size_t print(const char* text) {
+    return write(text, strlen(text));
+  }
+
+  size_t print(const std::string& text) {
+    return write(text.data(), text.size());
+  }
+
+  template<typename T>
+  size_t print(const T& value) {
+    return print(toText(value));
+  }
+
+  template<typename T>
+  size_t println(const T& value) {
+    return print(value) + print("\r\n");
+  }
+
+  size_t println() {
+    return print("\r\n");
+  }
+
+  size_t printf(const char* format, ...) {
+    char text[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    return print(text);
+  }
+
+  void flush() {}
+
+  void setTimeout(unsigned long) {}
+
+  // Bytes for the sketch to read.
+  void feed(const char* data, size_t length) {
+    std::lock_guard<std::mutex> lock(mutex);
+    input.append(data, length);
+  }
+
+  void feed(const std::string& data) {
+    feed(data.data(), data.size());
+  }
+
+  // Everything written since the last take.
+  std::string takeOutput() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string taken;
+    taken.swap(output);
+    return taken;
+  }
+
+  // How much availableForWrite reports, the buffer is drained instantly.
+  void setWriteRoom(int room) {
+    write_room = room;
+  }
+
+ private:
+  // Take the bytes that have arrived on the input descriptor.
+  void receive() {
+    if (input_fd < 0) return;
+    pollfd waiting = {input_fd, POLLIN, 0};
+    while (poll(&waiting, 1, 0) > 0 && (waiting.revents & (POLLIN | POLLHUP))) {
+      char bytes[256];
+      const ssize_t count = ::read(input_fd, bytes, sizeof(bytes));
+      if (count <= 0) {
+        // The other end closed, nothing more will arrive.
+        input_fd = -1;
+        return;
+      }
+      input.append(bytes, count);
+    }
+  }
+
+  template<typename T>
+  static std::string toText(const T& value) {
+    if constexpr (std::is_convertible<const T&, const char*>::value) {
+      return std::string(value);
+    } else if constexpr (std::is_arithmetic<T>::value) {
+      return std::to_string(value);
+    } else {
+      return value.toString();
+    }
+  }
+
+  std::mutex mutex;
+  std::string input;
+  std::string output;
+  std::atomic<int> write_room;
+  int input_fd;
+  int output_fd;
+};
+
+class HardwareSerial : public Stream {
+ public:
+  void begin(unsigned long baud) {}
+  void end() {}
+
+  explicit operator bool() const {
+    return true;
+  }
+};
+
+inline HardwareSerial Serial;
+
+typedef HostTask* TaskHandle_t;
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef void (*TaskFunction_t)(void*);
+
+#define pdTRUE  1
+#define pdFALSE 0
+#define pdPASS  1
+#define portMAX_DELAY 0xFFFFFFFFu
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) (static_cast<TickType_t>(ms) / portTICK_PERIOD_MS)
+
+namespace hal {
+  // Stop every task and wait for them to finish. Each is unwound from the
+  // call it is waiting in.
+  inline void stopTasks() {
+    std::unique_lock<std::mutex> lock(tasks_mutex);
+    stopping_tasks = true;
+    for (HostTask* task : tasks) {
+      if (!task->finished) runTask(lock, task);
+    }
+    lock.unlock();
+    for (HostTask* task : tasks) {
+      task->thread.join();
+      delete task;
+    }
+    tasks.clear();
+    stopping_tasks = false;
+  }
+}
+
+// The task gets its first turn when the clock next moves.
+inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stack_depth,
+                                          void* parameters, unsigned int priority, TaskHandle_t* handle,
+                                          int core) {
+  HostTask* task = new HostTask();
+  task->wake_at = hal::now_us;
+  if (handle != NULL) *handle = task;
+
+  std::lock_guard<std::mutex> lock(hal::tasks_mutex);
+  hal::tasks.push_back(task);
+  task->thread = std::thread([task, function, parameters]() {
+    hal::in_task = true;
+    hal::current_task = task;
+    {
+      std::unique_lock<std::mutex> lock(hal::tasks_mutex);
+      hal::task_switch.wait(lock, [task]() { return hal::running_task == task; });
+    }
+    try {
+      if (!hal::stopping_tasks) function(parameters);
+    } catch (const hal::TaskStopped&) {
+    }
+
+    std::lock_guard<std::mutex> lock(hal::tasks_mutex);
+    task->finished = true;
+    hal::running_task = NULL;
+    hal::task_switch.notify_all();
+  });
+  return pdPASS;
+}
+
+inline void xTaskNotifyGive(TaskHandle_t task) {
+  std::lock_guard<std::mutex> lock(hal::tasks_mutex);
+  task->notifications++;
+  if (task->waiting_for_notification && task->wake_at > hal::now_us) task->wake_at = hal::now_us;
+}
+
+inline uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks) {
+  hal::checkStopping();
+  HostTask* task = hal::current_task;
+  if (task == NULL) return 0;
+
+  if (task->notifications == 0) {
+    task->waiting_for_notification = true;
+    hal::blockTask(ticks == portMAX_DELAY ? hal::NEVER : hal::now_us + ticks * portTICK_PERIOD_MS * 1000ul);
+    task->waiting_for_notification = false;
+  }
+
+  std::lock_guard<std::mutex> lock(hal::tasks_mutex);
+  const uint32_t count = task->notifications;
+  if (clear_on_exit) task->notifications = 0;
+  else if (count > 0) task->notifications--;
+  return count;
+}
+
+inline void vTaskDelay(TickType_t ticks) {
+  delay(ticks * portTICK_PERIOD_MS);
+}
+
+// Only a task can delete itself. Called from the Arduino loop there is
+// no task to delete, so it returns and the loop is called again.
+inline void vTaskDelete(TaskHandle_t task) {
+  if (task == NULL && hal::in_task) throw hal::TaskStopped();
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "Arduino.h"
+
+// The SPP events the sketch listens for.
+typedef enum {
+  ESP_SPP_CLOSE_EVT = 27,
+  ESP_SPP_WRITE_EVT = 33,
+  ESP_SPP_CONG_EVT = 35,
+} esp_spp_cb_event_t;
+
+typedef union {
+  struct {
+    bool cong;
+  } write;
+  struct {
+    bool cong;
+  } cong;
+} esp_spp_cb_param_t;
+
+typedef void (esp_spp_cb_t)(esp_spp_cb_event_t event, esp_spp_cb_param_t* param);
+
+class BluetoothSerial;
+
+namespace hal {
+  inline esp_spp_cb_t* spp_callback = NULL;
+  // The port the sketch started, the test takes what was sent from it.
+  inline BluetoothSerial* bluetooth = NULL;
+
+  // Tell the sketch the link is congested, or isn't any more.
+  inline void setBluetoothCongested(bool congested) {
+    esp_spp_cb_param_t param;
+    param.cong.cong = congested;
+    if (spp_callback != NULL) spp_callback(ESP_SPP_CONG_EVT, &param);
+  }
+}
+
+class BluetoothSerial : public Stream {
+ public:
+  bool begin(const char* name) {
+    hal::bluetooth = this;
+    return true;
+  }
+
+  bool hasClient() {
+    return true;
+  }
+
+  int register_callback(esp_spp_cb_t* callback) {
+    hal::spp_callback = callback;
+    return 0;
+  }
+};
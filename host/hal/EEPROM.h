@@ -0,0 +1,43 @@
+#pragma once
+
+#include "Arduino.h"
+
+#define HAL_EEPROM_SIZE 1024
+
+// The EEPROM of a Nano, erased to 0xFF. It keeps its contents for the
+// whole run, like across a reset of the board.
+class EEPROMClass {
+ public:
+  EEPROMClass() : writes(0) {
+    memset(data, 0xFF, sizeof(data));
+  }
+
+  uint8_t read(int address) const {
+    return data[address];
+  }
+
+  void write(int address, uint8_t value) {
+    data[address] = value;
+    writes++;
+  }
+
+  // Skips the write if the byte already holds the value.
+  void update(int address, uint8_t value) {
+    if (data[address] != value) write(address, value);
+  }
+
+  uint16_t length() const {
+    return HAL_EEPROM_SIZE;
+  }
+
+  // Bytes written, to check the wear.
+  unsigned long writeCount() const {
+    return writes;
+  }
+
+ private:
+  uint8_t data[HAL_EEPROM_SIZE];
+  unsigned long writes;
+};
+
+inline EEPROMClass EEPROM;
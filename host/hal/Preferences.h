@@ -0,0 +1,49 @@
+#pragma once
+
+#include "Arduino.h"
+
+#include <map>
+
+namespace hal {
+  // The NVS partition, by namespace and key. It keeps its contents for
+  // the whole run, like across a reset of the board.
+  inline std::map<std::string, std::vector<uint8_t>> nvs;
+  // Counted after each write, a test can wait on it for a writing task.
+  inline std::atomic<unsigned long> nvs_writes(0);
+}
+
+class Preferences {
+ public:
+  bool begin(const char* name, bool read_only = false) {
+    space = std::string(name) + "/";
+    return true;
+  }
+
+  void end() {}
+
+  size_t getBytesLength(const char* key) {
+    auto entry = hal::nvs.find(space + key);
+    return entry == hal::nvs.end() ? 0 : entry->second.size();
+  }
+
+  size_t getBytes(const char* key, void* buffer, size_t length) {
+    auto entry = hal::nvs.find(space + key);
+    if (entry == hal::nvs.end() || entry->second.size() > length) return 0;
+    memcpy(buffer, entry->second.data(), entry->second.size());
+    return entry->second.size();
+  }
+
+  size_t putBytes(const char* key, const void* value, size_t length) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(value);
+    hal::nvs[space + key].assign(bytes, bytes + length);
+    hal::nvs_writes++;
+    return length;
+  }
+
+  bool remove(const char* key) {
+    return hal::nvs.erase(space + key) > 0;
+  }
+
+ private:
+  std::string space;
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "Arduino.h"
+
+#define MIN_PULSE_WIDTH 544
+#define MAX_PULSE_WIDTH 2400
+
+namespace hal {
+  // The last pulse width written to each servo pin.
+  inline std::atomic<int> servo_pulses[HAL_PIN_COUNT];
+  inline std::atomic<unsigned long> servo_writes(0);
+}
+
+// Keeps the pulse it would send, the tests read it from hal::servo_pulses.
+class Servo {
+ public:
+  Servo() : pin(-1) {}
+
+  uint8_t attach(int servo_pin) {
+    pin = servo_pin;
+    return 0;
+  }
+
+  void detach() {
+    pin = -1;
+  }
+
+  bool attached() const {
+    return pin >= 0;
+  }
+
+  void write(int angle) {
+    writeMicroseconds(map(constrain(angle, 0, 180), 0, 180, MIN_PULSE_WIDTH, MAX_PULSE_WIDTH));
+  }
+
+  void writeMicroseconds(int pulse) {
+    if (pin < 0) return;
+    hal::servo_pulses[pin] = pulse;
+    hal::servo_writes++;
+  }
+
+  int readMicroseconds() const {
+    return pin < 0 ? 0 : hal::servo_pulses[pin].load();
+  }
+
+ private:
+  int pin;
+};
@@ -0,0 +1,131 @@
+#pragma once
+
+#include "Arduino.h"
+
+#include <deque>
+#include <memory>
+
+#define WIFI_STA 1
+
+#define WL_CONNECTED      3
+#define WL_CONNECT_FAILED 4
+
+class IPAddress {
+ public:
+  IPAddress() : address(0) {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) :
+    address((uint32_t(a) << 24) | (uint32_t(b) << 16) | (uint32_t(c) << 8) | d) {}
+
+  bool operator==(const IPAddress& other) const {
+    return address == other.address;
+  }
+
+  bool operator!=(const IPAddress& other) const {
+    return address != other.address;
+  }
+
+  std::string toString() const {
+    return std::to_string(address >> 24) + "." + std::to_string((address >> 16) & 0xFF) + "." +
+           std::to_string((address >> 8) & 0xFF) + "." + std::to_string(address & 0xFF);
+  }
+
+ private:
+  uint32_t address;
+};
+
+namespace hal {
+  inline std::atomic<int> wifi_status(WL_CONNECTED);
+}
+
+class WiFiClass {
+ public:
+  void mode(int mode) {}
+  void begin(const char* ssid, const char* password) {}
+
+  int waitForConnectResult() {
+    return hal::wifi_status;
+  }
+
+  IPAddress localIP() {
+    return IPAddress(192, 168, 1, 2);
+  }
+};
+
+inline WiFiClass WiFi;
+
+// A TCP connection. Copies of a client share the connection, like on
+// the board, and the test holds one to play the driver.
+class WiFiClient {
+ public:
+  struct Connection {
+    Stream stream;
+    std::atomic<bool> connected{true};
+  };
+
+  WiFiClient() {}
+  explicit WiFiClient(std::shared_ptr<Connection> connection) : connection(connection) {}
+
+  explicit operator bool() const {
+    return connection != NULL;
+  }
+
+  bool connected() {
+    return connection && connection->connected;
+  }
+
+  void stop() {
+    if (connection) connection->connected = false;
+  }
+
+  void setNoDelay(bool no_delay) {}
+
+  int available() {
+    return connection ? connection->stream.available() : 0;
+  }
+
+  int read() {
+    return connection ? connection->stream.read() : -1;
+  }
+
+  size_t write(const uint8_t* data, size_t length) {
+    return connection ? connection->stream.write(data, length) : 0;
+  }
+
+  // The sketch's side of the connection.
+  Stream* stream() {
+    return connection ? &connection->stream : NULL;
+  }
+
+ private:
+  std::shared_ptr<Connection> connection;
+};
+
+namespace hal {
+  // Clients waiting for the server to accept them.
+  inline std::mutex wifi_mutex;
+  inline std::deque<WiFiClient> wifi_clients;
+
+  // Connect a client to the server. The test feeds and reads the
+  // returned client's stream.
+  inline WiFiClient connectClient() {
+    WiFiClient client(std::make_shared<WiFiClient::Connection>());
+    std::lock_guard<std::mutex> lock(wifi_mutex);
+    wifi_clients.push_back(client);
+    return client;
+  }
+}
+
+class WiFiServer {
+ public:
+  WiFiServer(uint16_t port) {}
+
+  void begin() {}
+
+  WiFiClient available() {
+    std::lock_guard<std::mutex> lock(hal::wifi_mutex);
+    if (hal::wifi_clients.empty()) return WiFiClient();
+    WiFiClient client = hal::wifi_clients.front();
+    hal::wifi_clients.pop_front();
+    return client;
+  }
+};
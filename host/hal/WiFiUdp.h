@@ -0,0 +1,93 @@
+#pragma once
+
+#include "WiFi.h"
+
+namespace hal {
+  // A datagram on the simulated network.
+  struct Datagram {
+    IPAddress ip;
+    uint16_t port;
+    std::vector<uint8_t> data;
+  };
+
+  // Datagrams waiting for the sketch, and the ones it sent.
+  inline std::mutex udp_mutex;
+  inline std::deque<Datagram> udp_received;
+  inline std::deque<Datagram> udp_sent;
+
+  inline void sendDatagram(IPAddress ip, uint16_t port, const std::string& data) {
+    std::lock_guard<std::mutex> lock(udp_mutex);
+    udp_received.push_back({ip, port, std::vector<uint8_t>(data.begin(), data.end())});
+  }
+
+  inline bool takeDatagram(Datagram& datagram) {
+    std::lock_guard<std::mutex> lock(udp_mutex);
+    if (udp_sent.empty()) return false;
+    datagram = udp_sent.front();
+    udp_sent.pop_front();
+    return true;
+  }
+}
+
+class WiFiUDP {
+ public:
+  WiFiUDP() : read_offset(0) {}
+
+  uint8_t begin(uint16_t port) {
+    return 1;
+  }
+
+  // Move on to the next datagram. Returns its size, 0 if there is none.
+  int parsePacket() {
+    std::lock_guard<std::mutex> lock(hal::udp_mutex);
+    if (hal::udp_received.empty()) {
+      packet.data.clear();
+      return 0;
+    }
+    packet = hal::udp_received.front();
+    hal::udp_received.pop_front();
+    read_offset = 0;
+    return packet.data.size();
+  }
+
+  int available() {
+    return packet.data.size() - read_offset;
+  }
+
+  int read(uint8_t* buffer, size_t length) {
+    size_t count = packet.data.size() - read_offset;
+    if (count > length) count = length;
+    memcpy(buffer, packet.data.data() + read_offset, count);
+    read_offset += count;
+    return count;
+  }
+
+  IPAddress remoteIP() {
+    return packet.ip;
+  }
+
+  uint16_t remotePort() {
+    return packet.port;
+  }
+
+  int beginPacket(IPAddress ip, uint16_t port) {
+    sending = {ip, port, {}};
+    return 1;
+  }
+
+  size_t write(const uint8_t* data, size_t length) {
+    sending.data.insert(sending.data.end(), data, data + length);
+    return length;
+  }
+
+  int endPacket() {
+    std::lock_guard<std::mutex> lock(hal::udp_mutex);
+    hal::udp_sent.push_back(sending);
+    return 1;
+  }
+
+ private:
+  hal::Datagram packet;
+  size_t read_offset;
+  hal::Datagram sending;
+};
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "Arduino.h"
+
+// The GPIO input registers of the ESP32, read from the simulated pins.
+#define GPIO_IN_REG  0x3FF4403Cu
+#define GPIO_IN1_REG 0x3FF44040u
+
+namespace hal {
+  inline uint32_t readRegister(uint32_t reg) {
+    const int first = reg == GPIO_IN_REG ? 0 : 32;
+    uint32_t value = 0;
+    for (int bit = 0; bit < 32 && first + bit < HAL_PIN_COUNT; bit++) {
+      if (digital_levels[first + bit]) value |= 1ul << bit;
+    }
+    return value;
+  }
+}
+
+#define REG_READ(reg) hal::readRegister(reg)
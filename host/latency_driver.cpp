@@ -0,0 +1,189 @@
+// Stands in for the driver on the other end of the serial port, and
+// reports how late the frames and the commands are from the frame timing
+// and the latency probe.
+//
+//   opengloves_latency [--delay us] [--loss fraction] [--ping loops] [loops]
+//
+//   --delay  How long the link takes each way, 1000 us by default.
+//   --loss   The fraction of the frames the link drops, none by default.
+//   --ping   Loops between pings, 50 by default.
+//   loops    How many loops to run, 10000 by default.
+//
+// The sketch runs on the host's virtual clock and the link is a model on
+// the same clock, so the glove's times need no offset to compare with
+// the driver's. Each histogram is printed with its percentiles:
+// - Frame age, from the sample time in T to the frame's arrival.
+// - Frame gaps, from the frame numbers in U. A gap of 1 is no loss.
+// - Ping round trip, and its parts: up to the glove, waiting for the
+//   outputs to update and back down with the reply.
+
+#include "Arduino.h"
+
+#include "open-gloves.ino"
+
+#include "Signals.h"
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <random>
+
+static_assert(ENABLE_FRAME_TIMING && ENABLE_LATENCY_PROBE, "The driver needs the frame timing and the pings");
+static_assert(ENCODING == ENCODING_ALPHA, "The driver reads the alpha encoding");
+
+// Values in power of two buckets, with the exact values kept for the
+// percentiles.
+class Histogram {
+ public:
+  explicit Histogram(const char* name, const char* unit) : name(name), unit(unit) {}
+
+  void add(unsigned long value) {
+    values.push_back(value);
+  }
+
+  void print() const {
+    printf("%s, %lu samples", name, static_cast<unsigned long>(values.size()));
+    if (values.empty()) {
+      printf("\n");
+      return;
+    }
+    std::vector<unsigned long> sorted = values;
+    std::sort(sorted.begin(), sorted.end());
+    const auto percentile = [&](double fraction) {
+      return sorted[std::min<size_t>(sorted.size() - 1, sorted.size() * fraction)];
+    };
+    printf(": p50 %lu, p99 %lu, max %lu %s\n", percentile(0.5), percentile(0.99), sorted.back(), unit);
+
+    std::map<unsigned long, unsigned long> buckets;
+    for (unsigned long value : sorted) {
+      unsigned long bucket = 1;
+      while (bucket <= value / 2) bucket *= 2;
+      buckets[value == 0 ? 0 : bucket]++;
+    }
+    for (const auto& bucket : buckets) {
+      const int width = std::max<int>(1, 50 * bucket.second / sorted.size());
+      const unsigned long last = bucket.first == 0 ? 0 : 2 * bucket.first - 1;
+      printf("  %8lu-%-8lu %-3s %8lu %s\n", bucket.first, last, unit, bucket.second, std::string(width, '#').c_str());
+    }
+  }
+
+ private:
+  const char* name;
+  const char* unit;
+  std::vector<unsigned long> values;
+};
+
+// A line on its way across the link.
+struct InFlight {
+  unsigned long arrives;
+  std::string line;
+};
+
+static int usage(const char* name) {
+  fprintf(stderr, "usage: %s [--delay us] [--loss fraction] [--ping loops] [loops]\n", name);
+  return 2;
+}
+
+int main(int argc, char** argv) {
+  unsigned long delay = 1000;
+  double loss = 0;
+  unsigned long ping_loops = 50;
+  unsigned long loops = 10000;
+  for (int i = 1; i < argc; i++) {
+    const std::string option = argv[i];
+    if (option == "--delay" && i + 1 < argc) {
+      delay = strtoul(argv[++i], NULL, 10);
+    } else if (option == "--loss" && i + 1 < argc) {
+      loss = atof(argv[++i]);
+    } else if (option == "--ping" && i + 1 < argc) {
+      ping_loops = std::max(1ul, strtoul(argv[++i], NULL, 10));
+    } else if (option[0] != '-') {
+      loops = strtoul(option.c_str(), NULL, 10);
+    } else {
+      return usage(argv[0]);
+    }
+  }
+
+  Histogram ages("Frame age", "us");
+  Histogram gaps("Frame gaps", "");
+  Histogram round_trips("Ping round trip", "us");
+  Histogram ups("Ping up", "us");
+  Histogram actuations("Ping to outputs", "us");
+  Histogram downs("Ping reply down", "us");
+
+  std::mt19937 random_source(42);
+  std::deque<InFlight> to_glove;
+  std::deque<InFlight> to_driver;
+  std::map<int, unsigned long> pings_sent;
+  bool numbered = false;
+  uint16_t last_number = 0;
+  int next_ping = 0;
+
+  // What reached the driver by now.
+  const auto receive = [&]() {
+    while (!to_driver.empty() && to_driver.front().arrives <= micros()) {
+      const InFlight& arrival = to_driver.front();
+      const std::string& line = arrival.line;
+      if (line.compare(0, 2, "~J") == 0) {
+        int id = 0;
+        unsigned long received = 0;
+        unsigned long actuated = 0;
+        if (sscanf(line.c_str() + 2, "%d,%lu,%lu", &id, &received, &actuated) == 3 && pings_sent.count(id)) {
+          const unsigned long sent = pings_sent[id];
+          round_trips.add(arrival.arrives - sent);
+          ups.add(received - sent);
+          actuations.add(actuated - received);
+          downs.add(arrival.arrives - actuated);
+          pings_sent.erase(id);
+        }
+      } else {
+        const size_t time = line.rfind(EncodedInput::Type::FRAME_TIME);
+        const size_t number = line.rfind(EncodedInput::Type::FRAME_NUMBER);
+        if (time != std::string::npos && number != std::string::npos) {
+          ages.add(arrival.arrives - strtoul(line.c_str() + time + 1, NULL, 10));
+          const uint16_t frame_number = strtoul(line.c_str() + number + 1, NULL, 10);
+          if (numbered) gaps.add(static_cast<uint16_t>(frame_number - last_number));
+          last_number = frame_number;
+          numbered = true;
+        }
+      }
+      to_driver.pop_front();
+    }
+  };
+
+  setup();
+  for (unsigned long loop_count = 0; loop_count < loops; loop_count++) {
+    signals::drive(loop_count);
+
+    if (loop_count % ping_loops == 0) {
+      pings_sent[next_ping] = micros();
+      to_glove.push_back({micros() + delay, "J" + std::to_string(next_ping) + "\n"});
+      next_ping++;
+    }
+    while (!to_glove.empty() && to_glove.front().arrives <= micros()) {
+      Serial.feed(to_glove.front().line);
+      to_glove.pop_front();
+    }
+
+    // The loop sends before it waits for the next one.
+    const unsigned long sent_at = micros();
+    loop();
+    const std::string sent = Serial.takeOutput();
+    size_t start = 0;
+    for (size_t end = sent.find('\n'); end != std::string::npos; end = sent.find('\n', start)) {
+      const std::string line = sent.substr(start, end - start);
+      start = end + 1;
+      // Only the frames are dropped, the driver would resend a ping.
+      if (line[0] != '~' && std::uniform_real_distribution<double>(0, 1)(random_source) < loss) continue;
+      to_driver.push_back({sent_at + delay, line});
+    }
+    receive();
+  }
+  hal::advance(delay);
+  receive();
+
+  printf("%lu loops of %d ms, %lu us each way, %.1f%% of the frames lost\n", loops, LOOP_TIME, delay, loss * 100);
+  for (const Histogram* histogram : {&ages, &gaps, &round_trips, &ups, &actuations, &downs}) histogram->print();
+  if (!pings_sent.empty()) printf("%lu pings unanswered\n", static_cast<unsigned long>(pings_sent.size()));
+  return 0;
+}
@@ -0,0 +1,168 @@
+// Replays a session logged with ENABLE_RECORDING through the sketch on
+// the host, so a problem seen on a glove can be stepped through without it.
+//
+//   opengloves_replay session.rec
+//   opengloves_replay --record session.rec [loops]
+//
+// The session is everything the glove sent over its serial port, frames
+// and '#' records together, see Recorder.hpp. Each sample record drives
+// the pins for one loop, and the commands received in that loop are fed
+// to the serial port before it runs. Everything downstream of the pins,
+// the fingers, joystick, gestures and force feedback, runs as it did on
+// the glove. The frames and records the replay sends are compared with
+// the session's, and the replay fails on the first difference.
+//
+// The replay starts the clock and the buttons like the sketch does at
+// power up, so the session has to be recorded from then, with the buttons
+// released. Analog values with extra oversampled bits are read back at
+// the ADC resolution.
+//
+// --record runs the sketch with the scripted signals and a few force
+// feedback commands instead, and writes what it sent to the file.
+
+#include "Arduino.h"
+
+#include "open-gloves.ino"
+
+#include "Signals.h"
+
+static_assert(ENABLE_RECORDING, "The replay needs the records");
+
+// A message the glove sent, decoded.
+typedef std::string Message;
+
+static bool isRecord(const Message& message) {
+  return !message.empty() && static_cast<uint8_t>(message[0]) == Recorder::RECORD_MARKER;
+}
+
+static std::vector<Message> decodeMessages(const std::string& output) {
+  std::vector<Message> messages;
+  size_t start = 0;
+  for (size_t end = output.find('\0'); end != std::string::npos; end = output.find('\0', start)) {
+    std::vector<uint8_t> message(end - start);
+    const size_t size = cobsDecode(reinterpret_cast<const uint8_t*>(output.data() + start), end - start, message.data());
+    messages.emplace_back(reinterpret_cast<const char*>(message.data()), size);
+    start = end + 1;
+  }
+  return messages;
+}
+
+static uint16_t readWord(const Message& message, size_t offset) {
+  return (static_cast<uint8_t>(message[offset]) << 8) | static_cast<uint8_t>(message[offset + 1]);
+}
+
+// Set the pins to what the sample record read.
+static void drivePins(const Message& sample) {
+  const uint16_t buttons = readWord(sample, 7);
+  for (uint8_t i = 0; i < button_bank.buttonCount(); i++) {
+    const bool pressed = buttons & (1u << i);
+    hal::setDigital(button_bank.pin(i), pressed ? button_bank.onState(i) : !button_bank.onState(i));
+  }
+  for (uint8_t channel = 0; channel < analog_sampler.channelCount(); channel++) {
+    hal::setAnalog(analog_sampler.pin(channel), readWord(sample, 9 + 2 * channel) >> OVERSAMPLING_EXTRA_BITS);
+  }
+}
+
+// Send the force feedback limits for every finger, in a binary command.
+static void sendForceFeedback(int limit) {
+  uint8_t command[2 + 2 * 5] = {0, 0x1F};
+  for (int finger = 0; finger < 5; finger++) {
+    command[2 + 2 * finger] = limit >> 8;
+    command[3 + 2 * finger] = limit & 0xFF;
+  }
+  uint8_t framed[sizeof(command) + 2];
+  const size_t size = cobsEncode(command, sizeof(command), framed);
+  Serial.feed(std::string(reinterpret_cast<const char*>(framed), size) + '\0');
+}
+
+static int record(const char* path, unsigned long loops) {
+  signals::drive(0);
+  setup();
+  for (unsigned long loop_count = 0; loop_count < loops; loop_count++) {
+    signals::drive(loop_count);
+    if (loop_count % 500 == 100) sendForceFeedback(loop_count % 1000 < 500 ? 1000 : 0);
+    loop();
+  }
+  const std::string output = Serial.takeOutput();
+  std::ofstream(path, std::ios::binary) << output;
+  fprintf(stderr, "%lu loops, %lu bytes written to %s\n", loops, static_cast<unsigned long>(output.size()), path);
+  return 0;
+}
+
+// The first message that differs, or -1 if they all match.
+static long firstDifference(const std::vector<Message>& expected, const std::vector<Message>& actual) {
+  for (size_t i = 0; i < std::max(expected.size(), actual.size()); i++) {
+    if (i >= expected.size() || i >= actual.size() || expected[i] != actual[i]) return i;
+  }
+  return -1;
+}
+
+static int replay(const char* path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    perror(path);
+    return 1;
+  }
+  const std::string session((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+  // The records drive the replay, all of the messages are compared.
+  std::vector<Message> records;
+  int lost = 0;
+  const std::vector<Message> sent = decodeMessages(session);
+  for (const Message& message : sent) {
+    if (!isRecord(message) || message.size() < 7) continue;
+    if (!records.empty() && static_cast<uint8_t>(message[2] - records.back()[2]) != 1) lost++;
+    records.push_back(message);
+  }
+  if (lost > 0) fprintf(stderr, "%d records were lost, the replay won't line up after the first\n", lost);
+
+  setup();
+  std::vector<Message> replayed;
+  unsigned long loops = 0;
+  unsigned long commands = 0;
+  for (size_t i = 0; i < records.size(); i++) {
+    if (records[i][1] != Recorder::SAMPLE) continue;
+    // The commands the glove received in this loop.
+    for (size_t next = i + 1; next < records.size() && records[next][1] != Recorder::SAMPLE; next++) {
+      if (records[next][1] != Recorder::COMMAND) continue;
+      Serial.feed(records[next].substr(7) + '\0');
+      commands++;
+    }
+    drivePins(records[i]);
+    loop();
+    loops++;
+
+    const std::vector<Message> messages = decodeMessages(Serial.takeOutput());
+    replayed.insert(replayed.end(), messages.begin(), messages.end());
+  }
+
+  const long difference = firstDifference(sent, replayed);
+  printf("%lu loops and %lu commands replayed, %lu messages sent, %lu in the session\n", loops, commands,
+         static_cast<unsigned long>(replayed.size()), static_cast<unsigned long>(sent.size()));
+  #if ENABLE_FORCE_FEEDBACK
+    const int servo_pins[] = {PIN_THUMB_FFB, PIN_INDEX_FFB, PIN_MIDDLE_FFB, PIN_RING_FFB, PIN_PINKY_FFB};
+    printf("servo pulses at the end:");
+    for (int pin : servo_pins) printf(" %d", hal::servo_pulses[pin].load());
+    printf(" us\n");
+  #endif
+  if (difference >= 0) {
+    printf("the replay differs from message %ld on, a %s\n", difference,
+           difference < static_cast<long>(sent.size()) && isRecord(sent[difference]) ? "record" : "frame");
+    return 1;
+  }
+  printf("the replay matches the session\n");
+  return 0;
+}
+
+static int usage(const char* name) {
+  fprintf(stderr, "usage: %s session.rec\n       %s --record session.rec [loops]\n", name, name);
+  return 2;
+}
+
+int main(int argc, char** argv) {
+  if (argc >= 3 && std::string(argv[1]) == "--record") {
+    return record(argv[2], argc > 3 ? strtoul(argv[3], NULL, 10) : 2000);
+  }
+  if (argc == 2 && argv[1][0] != '-') return replay(argv[1]);
+  return usage(argv[0]);
+}
@@ -0,0 +1,106 @@
+// Runs the sketch on the host, with scripted signals or a recorded trace,
+// and reports what each loop costs on the host.
+//
+//   opengloves_host [--stdio | --pty] [--real-time] [--trace file.csv] [loops]
+//
+// By default it runs 1000 loops at full host speed, then writes the frames
+// to stdout. The timing goes to stderr.
+//
+//   --stdio      The serial port is stdin and stdout. Frames are written as
+//                they are sent and commands are read as they arrive.
+//   --pty        The serial port is a new pseudo terminal for a driver to
+//                open, its name goes to stderr.
+//   --real-time  Each loop takes LOOP_TIME of real time, like on the board.
+//   --trace      The pins play back a CSV trace, see hal::loadTrace.
+//   loops        0 runs until stopped, or until the end of the trace.
+
+#include "Arduino.h"
+
+#include "open-gloves.ino"
+
+#include "Signals.h"
+
+#include <termios.h>
+
+// Open a pseudo terminal in raw mode. Returns the descriptor of our end,
+// or -1.
+static int openPty() {
+  const int pty = posix_openpt(O_RDWR | O_NOCTTY);
+  if (pty < 0 || grantpt(pty) != 0 || unlockpt(pty) != 0) return -1;
+
+  // Keep the other end open too, so reads don't fail while no driver is
+  // connected, and make it raw so the frames pass through as they are.
+  const char* name = ptsname(pty);
+  const int terminal = open(name, O_RDWR | O_NOCTTY);
+  if (terminal < 0) return -1;
+  termios settings;
+  tcgetattr(terminal, &settings);
+  cfmakeraw(&settings);
+  tcsetattr(terminal, TCSANOW, &settings);
+
+  // Drop frames rather than wait when nobody reads them.
+  fcntl(pty, F_SETFL, fcntl(pty, F_GETFL) | O_NONBLOCK);
+  fprintf(stderr, "serial port: %s\n", name);
+  return pty;
+}
+
+static int usage(const char* name) {
+  fprintf(stderr, "usage: %s [--stdio | --pty] [--real-time] [--trace file.csv] [loops]\n", name);
+  return 2;
+}
+
+int main(int argc, char** argv) {
+  unsigned long loops = 1000;
+  bool attached = false;
+  bool traced = false;
+  for (int i = 1; i < argc; i++) {
+    const std::string option = argv[i];
+    if (option == "--stdio") {
+      Serial.attach(STDIN_FILENO, STDOUT_FILENO);
+      attached = true;
+    } else if (option == "--pty") {
+      const int pty = openPty();
+      if (pty < 0) {
+        perror("pty");
+        return 1;
+      }
+      Serial.attach(pty, pty);
+      attached = true;
+    } else if (option == "--real-time") {
+      hal::real_time = true;
+    } else if (option == "--trace" && i + 1 < argc) {
+      std::string error;
+      if (!hal::loadTrace(argv[++i], error)) {
+        fprintf(stderr, "%s: %s\n", argv[i], error.c_str());
+        return 1;
+      }
+      traced = true;
+    } else if (option[0] != '-') {
+      loops = strtoul(option.c_str(), NULL, 10);
+    } else {
+      return usage(argv[0]);
+    }
+  }
+
+  setup();
+  unsigned long loop_count = 0;
+  const auto start = std::chrono::steady_clock::now();
+  while (loops == 0 ? !traced || !hal::traceFinished() : loop_count < loops) {
+    if (!traced) signals::drive(loop_count);
+    loop();
+    loop_count++;
+  }
+  const double loop_time = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() /
+                           (loop_count > 0 ? loop_count : 1);
+
+  if (attached) {
+    fprintf(stderr, "%lu loops, %.0f ns per loop on the host\n", loop_count, loop_time);
+    return 0;
+  }
+
+  const std::string output = Serial.takeOutput();
+  fwrite(output.data(), 1, output.size(), stdout);
+  fprintf(stderr, "%lu loops, %.0f ns per loop on the host, %lu bytes sent\n", loop_count, loop_time,
+          static_cast<unsigned long>(output.size()));
+  return 0;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+// Checks for the host tests. A failed check is reported and the test
+// carries on, main returns testResult().
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <type_traits>
+
+namespace host_test {
+  inline int failures = 0;
+
+  inline bool check(bool passed, const char* condition, const char* file, int line) {
+    if (!passed) {
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", file, line, condition);
+      failures++;
+    }
+    return passed;
+  }
+
+  template<typename A, typename B>
+  bool checkEqual(const A& actual, const B& expected, const char* text, const char* file, int line) {
+    if (actual == expected) return true;
+
+    if constexpr (std::is_arithmetic<A>::value && std::is_arithmetic<B>::value) {
+      fprintf(stderr, "%s:%d: CHECK_EQUAL(%s) failed: %s != %s\n", file, line, text,
+              std::to_string(actual).c_str(), std::to_string(expected).c_str());
+    } else if constexpr (std::is_same<A, std::string>::value && std::is_same<B, std::string>::value) {
+      fprintf(stderr, "%s:%d: CHECK_EQUAL(%s) failed: \"%s\" != \"%s\"\n", file, line, text,
+              actual.c_str(), expected.c_str());
+    } else {
+      fprintf(stderr, "%s:%d: CHECK_EQUAL(%s) failed\n", file, line, text);
+    }
+    failures++;
+    return false;
+  }
+
+  // Bytes as text, with anything unprintable escaped, one message per
+  // line after each delimiter.
+  inline std::string escape(const std::string& bytes, char delimiter) {
+    std::string text;
+    for (unsigned char c : bytes) {
+      if (c == static_cast<unsigned char>(delimiter)) {
+        text += c == '\n' ? "\n" : "\\0\n";
+      } else if (c < 0x20 || c >= 0x7F || c == '\\') {
+        char escaped[5];
+        snprintf(escaped, sizeof(escaped), "\\x%02X", c);
+        text += escaped;
+      } else {
+        text += static_cast<char>(c);
+      }
+    }
+    return text;
+  }
+
+  // Compare the output with golden/<name>.txt. Set UPDATE_GOLDEN=1 to
+  // write the file instead, and review the change before committing it.
+  inline bool checkGolden(const char* name, const std::string& output, const char* file, int line) {
+    const std::string path = std::string("golden/") + name + ".txt";
+    if (getenv("UPDATE_GOLDEN") != NULL) {
+      std::ofstream(path, std::ios::binary) << output;
+      return true;
+    }
+
+    std::ifstream golden(path, std::ios::binary);
+    std::stringstream expected;
+    expected << golden.rdbuf();
+    if (golden && expected.str() == output) return true;
+
+    fprintf(stderr, "%s:%d: output doesn't match %s, got:\n%s\n", file, line, path.c_str(), output.c_str());
+    failures++;
+    return false;
+  }
+
+  // Host time taken by a call, for the benchmarks (ns).
+  template<typename F>
+  double timeCall(F&& call, unsigned long repeats) {
+    const auto start = std::chrono::steady_clock::now();
+    for (unsigned long i = 0; i < repeats; i++) call();
+    const auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / repeats;
+  }
+
+  inline int result() {
+    if (failures > 0) fprintf(stderr, "%d check(s) failed\n", failures);
+    return failures > 0 ? 1 : 0;
+  }
+}
+
+#define CHECK(condition) host_test::check((condition), #condition, __FILE__, __LINE__)
+#define CHECK_EQUAL(actual, expected) \
+  host_test::checkEqual((actual), (expected), #actual " == " #expected, __FILE__, __LINE__)
+#define CHECK_GOLDEN(name, output) host_test::checkGolden((name), (output), __FILE__, __LINE__)
@@ -0,0 +1,32 @@
+#pragma once
+
+// Scripted sensor signals for running the whole sketch. Include after the
+// sketch, the pins come from its Config.h.
+
+#include "Arduino.h"
+
+namespace signals {
+  // Rises from 0 to ANALOG_MAX and back over the period, in loops.
+  inline int triangle(unsigned long loop, unsigned long period) {
+    const unsigned long phase = loop % period;
+    const unsigned long half = period / 2;
+    const unsigned long rise = phase < half ? phase : period - phase;
+    return rise * ANALOG_MAX / half;
+  }
+
+  // Every finger flexes in turn, the joystick drifts and the A button is
+  // pressed for a while. Buttons have pull ups and read low when pressed.
+  inline void drive(unsigned long loop) {
+    const int fingers[] = {PIN_THUMB, PIN_INDEX, PIN_MIDDLE, PIN_RING, PIN_PINKY};
+    for (int i = 0; i < 5; i++) {
+      hal::setAnalog(fingers[i], triangle(loop + i * 10, 80));
+    }
+    hal::setAnalog(PIN_JOY_X, ANALOG_MAX / 2 + triangle(loop, 40) / 16);
+    hal::setAnalog(PIN_JOY_Y, ANALOG_MAX / 2);
+
+    hal::setDigital(PIN_JOY_BTN, HIGH);
+    hal::setDigital(PIN_B_BTN, HIGH);
+    hal::setDigital(PIN_CALIB, HIGH);
+    hal::setDigital(PIN_A_BTN, loop >= 20 && loop < 40 ? LOW : HIGH);
+  }
+}
@@ -0,0 +1,178 @@
+// Round trips the binary encoding: COBS framing, the input frames against
+// the alpha encoding of the same inputs, and the commands. Also reports
+// the size of each encoding and the frame rate it allows on the serial
+// link.
+
+#include "Arduino.h"
+
+#include "open-gloves.ino"
+
+#include "HostTest.h"
+#include "Signals.h"
+
+#include <map>
+#include <vector>
+
+// Deterministic bytes, with runs of zeros and of non-zeros to cross the
+// COBS block boundaries.
+static std::vector<uint8_t> makeBuffer(size_t length, uint32_t seed) {
+  std::vector<uint8_t> buffer(length);
+  uint32_t state = seed * 2654435761u + 1;
+  for (size_t i = 0; i < length; i++) {
+    state = state * 1664525u + 1013904223u;
+    switch (seed % 3) {
+      case 0: buffer[i] = state >> 24; break;
+      case 1: buffer[i] = (state >> 28) == 0 ? 0 : (state >> 24) | 1; break;
+      default: buffer[i] = i % 300 < 260 ? 0xFF : 0; break;
+    }
+  }
+  return buffer;
+}
+
+static void testCobsRoundTrip() {
+  for (size_t length = 0; length <= 600; length++) {
+    for (uint32_t seed = 0; seed < 3; seed++) {
+      const std::vector<uint8_t> input = makeBuffer(length, seed + length * 3);
+      std::vector<uint8_t> encoded(length + length / 254 + 1);
+      const size_t encoded_size = cobsEncode(input.data(), length, encoded.data());
+      CHECK(encoded_size <= encoded.size());
+
+      bool zero_free = true;
+      for (size_t i = 0; i < encoded_size; i++) zero_free &= encoded[i] != 0;
+      CHECK(zero_free);
+
+      std::vector<uint8_t> decoded(length + 1);
+      const size_t decoded_size = cobsDecode(encoded.data(), encoded_size, decoded.data());
+      decoded.resize(decoded_size);
+      if (!CHECK(decoded == input)) return;
+    }
+  }
+
+  // A block that runs past the end is malformed.
+  const uint8_t truncated[] = {0x05, 0x01, 0x02};
+  uint8_t output[8];
+  CHECK_EQUAL(cobsDecode(truncated, sizeof(truncated), output), 0u);
+}
+
+// The keys and values of an alpha frame.
+static std::map<char, int> parseAlpha(const char* frame) {
+  std::map<char, int> values;
+  const char* cursor = frame;
+  while (*cursor >= 'A' && *cursor <= 'Z') {
+    const char key = *cursor++;
+    values[key] = *cursor >= '0' && *cursor <= '9' ? strtol(cursor, const_cast<char**>(&cursor), 10) : 1;
+  }
+  return values;
+}
+
+// The keys and values of a binary frame, with the digital inputs as 1.
+static std::map<char, int> parseBinary(const char* framed, size_t length) {
+  std::map<char, int> values;
+  uint8_t frame[BINARY_FRAME_MAX_SIZE + 1];
+  const size_t size = cobsDecode(reinterpret_cast<const uint8_t*>(framed), length, frame);
+  if (!CHECK(size >= 4)) return values;
+
+  const uint16_t mask = (frame[0] << 8) | frame[1];
+  const uint16_t digital = (frame[2] << 8) | frame[3];
+  CHECK(mask & BinaryFrame::KEYFRAME_FLAG);
+  for (int key = 0; key < 16; key++) {
+    if (digital & (1u << key)) values['A' + key] = 1;
+  }
+
+  size_t bit = 4 * 8;
+  for (uint8_t channel = 0; channel < BinaryFrame::ANALOG_CHANNELS; channel++) {
+    if (!(mask & (1u << channel))) continue;
+
+    int value = 0;
+    for (uint8_t i = 0; i < ANALOG_BITS; i++, bit++) {
+      value = (value << 1) | ((frame[bit / 8] >> (7 - bit % 8)) & 1);
+    }
+    CHECK(channel < BinaryFrame::SPLAY_CHANNEL_OFFSET);
+    values['A' + channel] = value;
+  }
+  CHECK_EQUAL((bit + 7) / 8, size);
+  return values;
+}
+
+static void testFramesMatchAlpha() {
+  setup();
+
+  unsigned long alpha_bytes = 0;
+  unsigned long binary_bytes = 0;
+  const int frames = 200;
+  for (int i = 0; i < frames; i++) {
+    signals::drive(i);
+    readInputs();
+
+    char alpha[ENCODED_OUTPUT_SIZE];
+    char binary[BINARY_ENCODED_MAX_SIZE];
+    const int alpha_size = encodeAll<InputRegistry>(alpha);
+    const int binary_size = encodeAllBinary<InputRegistry>(binary);
+    alpha_bytes += alpha_size;
+    binary_bytes += binary_size;
+
+    CHECK_EQUAL(binary[binary_size - 1], '\0');
+    CHECK_EQUAL(strlen(binary), static_cast<size_t>(binary_size - 1));
+    if (!CHECK(parseBinary(binary, binary_size - 1) == parseAlpha(alpha))) {
+      fprintf(stderr, "frame %d: %s", i, alpha);
+      return;
+    }
+  }
+
+  // The UART sends 10 bits for every byte.
+  const double alpha_mean = static_cast<double>(alpha_bytes) / frames;
+  const double binary_mean = static_cast<double>(binary_bytes) / frames;
+  printf("alpha:  %.1f bytes per frame, %.0f frames/s at %d baud\n",
+         alpha_mean, SERIAL_BAUD_RATE / 10 / alpha_mean, SERIAL_BAUD_RATE);
+  printf("binary: %.1f bytes per frame, %.0f frames/s at %d baud\n",
+         binary_mean, SERIAL_BAUD_RATE / 10 / binary_mean, SERIAL_BAUD_RATE);
+  CHECK(binary_mean < alpha_mean);
+}
+
+// Keeps every value it is sent.
+struct RecordingOutput : public DecodedOuput {
+  std::map<char, int> values;
+
+  bool ownsKey(DecodedOuput::Type key) const override {
+    return true;
+  }
+
+  void decodeValue(DecodedOuput::Type key, int value) override {
+    values[key] = value;
+  }
+
+  void updateOutput() override {}
+};
+
+static int decodeCommand(const std::vector<uint8_t>& command, const OutputDispatchTable& table) {
+  uint8_t framed[BINARY_COMMAND_MAX_SIZE + BINARY_COMMAND_MAX_SIZE / 254 + 2];
+  const size_t size = cobsEncode(command.data(), command.size(), framed);
+  framed[size] = '\0';
+  return decodeAllBinary(reinterpret_cast<const char*>(framed), size, table);
+}
+
+static void testCommands() {
+  RecordingOutput output;
+  OutputDispatchTable table;
+  table.registerOutput(&output);
+
+  // The keys 'A', 'C' and 'J', the values include zero bytes.
+  const uint16_t mask = (1u << 0) | (1u << 2) | (1u << 9);
+  CHECK_EQUAL(decodeCommand({mask >> 8, mask & 0xFF, 0x03, 0xE8, 0x00, 0x00, 0x12, 0x34}, table), 3);
+  CHECK_EQUAL(output.values.size(), 3u);
+  CHECK_EQUAL(output.values['A'], 1000);
+  CHECK_EQUAL(output.values['C'], 0);
+  CHECK_EQUAL(output.values['J'], 0x1234);
+
+  // An empty command asks for a keyframe, a short one is malformed.
+  CHECK_EQUAL(decodeCommand({0x00, 0x00}, table), 0);
+  CHECK_EQUAL(decodeCommand({0x00, 0x01, 0x01}, table), -1);
+  CHECK_EQUAL(decodeCommand({0x00}, table), -1);
+}
+
+int main() {
+  testCobsRoundTrip();
+  testFramesMatchAlpha();
+  testCommands();
+  return host_test::result();
+}
@@ -0,0 +1,133 @@
+// Plays bounce patterns into the button pins and checks the debounced
+// edges, their times, and the edge records the recorder writes for them.
+
+#include "Arduino.h"
+
+#include "Recorder.hpp"
+
+#include "HostTest.h"
+
+static uint8_t button_a;
+static uint8_t button_b;
+
+// Buttons have pull ups and read low when pressed.
+static void setPressed(int pin, bool pressed) {
+  hal::setDigital(pin, pressed ? LOW : HIGH);
+}
+
+// Move the clock on and sample, like a loop.
+static uint16_t sampleAfter(unsigned long us) {
+  hal::advance(us);
+  button_bank.sample(micros());
+  return button_bank.lastEdges();
+}
+
+static uint32_t readLong(const uint8_t* data) {
+  return (static_cast<uint32_t>(data[0]) << 24) | (static_cast<uint32_t>(data[1]) << 16) | (data[2] << 8) | data[3];
+}
+
+// The edges record after a sample with the edge of one button.
+static void checkEdgeRecord(uint8_t button, uint16_t states, unsigned long edge_time) {
+  static Recorder recorder;
+  uint8_t record[RECORD_MAX_SIZE];
+  const int size = recorder.encodeEdges(record, micros(), button_bank);
+  if (!CHECK_EQUAL(size, 7 + 4 + 4)) return;
+  CHECK_EQUAL(record[0], '#');
+  CHECK_EQUAL(record[1], 'E');
+  CHECK_EQUAL(readLong(record + 3), static_cast<uint32_t>(micros()));
+  CHECK_EQUAL((record[7] << 8) | record[8], 1 << button);
+  CHECK_EQUAL((record[9] << 8) | record[10], static_cast<int>(states));
+  CHECK_EQUAL(readLong(record + 11), static_cast<uint32_t>(edge_time));
+}
+
+#if ENABLE_BUTTON_INTERRUPTS
+// Each edge interrupts, the first one counts and the rest are bounce.
+static void testInterruptBounce() {
+  const unsigned long press = micros() + 1000;
+  hal::now_us = press;
+  setPressed(PIN_A_BTN, true);
+  hal::advance(120);
+  setPressed(PIN_A_BTN, false);
+  hal::advance(80);
+  setPressed(PIN_A_BTN, true);
+
+  CHECK_EQUAL(sampleAfter(LOOP_TIME * 1000UL), static_cast<uint16_t>(1 << button_a));
+  CHECK(button_bank.isPressed(button_a));
+  CHECK_EQUAL(button_bank.edgeTime(button_a), press);
+  checkEdgeRecord(button_a, 1 << button_a, press);
+
+  // Past the lockout the pin still reads pressed, nothing changes.
+  CHECK_EQUAL(sampleAfter(BUTTON_LOCKOUT_TIME * 1000UL), static_cast<uint16_t>(0));
+  CHECK(button_bank.isPressed(button_a));
+
+  // A release that bounces back to pressed during the lockout, then
+  // settles released. The last edge is found when the lockout ends.
+  const unsigned long release = micros() + 500;
+  hal::now_us = release;
+  setPressed(PIN_A_BTN, false);
+  hal::advance(300);
+  setPressed(PIN_A_BTN, true);
+  hal::advance(300);
+  setPressed(PIN_A_BTN, false);
+  CHECK_EQUAL(sampleAfter(LOOP_TIME * 1000UL), static_cast<uint16_t>(1 << button_a));
+  button_bank.reported();
+  CHECK(!button_bank.isPressed(button_a));
+  CHECK_EQUAL(button_bank.edgeTime(button_a), release);
+  CHECK_EQUAL(sampleAfter(BUTTON_LOCKOUT_TIME * 1000UL), static_cast<uint16_t>(0));
+  CHECK(!button_bank.isPressed(button_a));
+}
+#else
+// Polled once a loop, a button changes once it reads differently for
+// BUTTON_DEBOUNCE_SAMPLES loops, from the first of those reads.
+static void testPolledBounce() {
+  const unsigned long loop_time = LOOP_TIME * 1000UL;
+
+  // A bounce starts the count again.
+  setPressed(PIN_A_BTN, true);
+  CHECK_EQUAL(sampleAfter(loop_time), static_cast<uint16_t>(BUTTON_DEBOUNCE_SAMPLES == 1 ? 1 << button_a : 0));
+  setPressed(PIN_A_BTN, false);
+  sampleAfter(loop_time);
+  CHECK(!button_bank.isPressed(button_a));
+
+  setPressed(PIN_A_BTN, true);
+  setPressed(PIN_B_BTN, true);
+  uint16_t edges = sampleAfter(loop_time);
+  const unsigned long press = micros();
+  for (int n = 1; n < BUTTON_DEBOUNCE_SAMPLES; n++) {
+    CHECK_EQUAL(edges, static_cast<uint16_t>(0));
+    edges = sampleAfter(loop_time);
+  }
+  CHECK_EQUAL(edges, static_cast<uint16_t>((1 << button_a) | (1 << button_b)));
+  CHECK(button_bank.isPressed(button_a));
+  CHECK_EQUAL(button_bank.edgeTime(button_a), press);
+  CHECK_EQUAL(button_bank.edgeTime(button_b), press);
+
+  // A release of A shorter than the debounce is ignored, the one of B isn't.
+  setPressed(PIN_A_BTN, false);
+  setPressed(PIN_B_BTN, false);
+  sampleAfter(loop_time);
+  const unsigned long release = micros();
+  setPressed(PIN_A_BTN, true);
+  for (int n = 1; n < BUTTON_DEBOUNCE_SAMPLES; n++) edges = sampleAfter(loop_time);
+  CHECK_EQUAL(edges, static_cast<uint16_t>(BUTTON_DEBOUNCE_SAMPLES == 1 ? 0 : 1 << button_b));
+  CHECK_EQUAL(button_bank.edgeTime(button_b), release);
+  if (BUTTON_DEBOUNCE_SAMPLES > 1) checkEdgeRecord(button_b, 1 << button_a, release);
+  CHECK(button_bank.isPressed(button_a));
+}
+#endif
+
+int main() {
+  setPressed(PIN_A_BTN, false);
+  setPressed(PIN_B_BTN, false);
+  button_a = button_bank.addButton(PIN_A_BTN, LOW);
+  button_b = button_bank.addButton(PIN_B_BTN, LOW);
+  button_bank.begin();
+  CHECK_EQUAL(sampleAfter(0), static_cast<uint16_t>(0));
+
+  #if ENABLE_BUTTON_INTERRUPTS
+    testInterruptBounce();
+  #else
+    testPolledBounce();
+  #endif
+  return host_test::result();
+}
@@ -0,0 +1,82 @@
+// Checks the calibrator's fixed point mapping against map() over the whole
+// ADC range: every calibrated range and input at 10 bits, and every range
+// at 12 bits with a spread of inputs. It has to stay within 1 LSB, and the
+// calibrated min and max have to map to exactly 0 and ANALOG_MAX.
+
+#include "Arduino.h"
+
+#include "Calibration.hpp"
+
+#include "HostTest.h"
+
+struct Mismatches {
+  unsigned long ranges = 0;
+  unsigned long inputs = 0;
+  // Ranges whose min or max doesn't map to the end of the output range.
+  unsigned long ends = 0;
+  // Inputs more than 1 LSB from map().
+  unsigned long far = 0;
+};
+
+static bool checkInput(const MinMaxCalibrator<int>& calibrator, int input, int min, int max, int analog_max,
+                       Mismatches& mismatches) {
+  const int output = calibrator.calibrate(input, 0, analog_max);
+  const long expected = map(input, min, max, 0, analog_max);
+  mismatches.inputs++;
+  if (output - expected > 1 || expected - output > 1) {
+    if (mismatches.far++ == 0) {
+      fprintf(stderr, "range %d..%d input %d: %d, map() gives %ld\n", min, max, input, output, expected);
+    }
+    return false;
+  }
+  return true;
+}
+
+// Every pair with min < max. step is the spacing of the inputs checked
+// inside each range, 1 checks all of them.
+static Mismatches checkRanges(int analog_max, int step) {
+  Mismatches mismatches;
+  MinMaxCalibrator<int> calibrator(0, analog_max, true);
+  for (int min = 0; min < analog_max; min++) {
+    for (int max = min + 1; max <= analog_max; max++) {
+      calibrator.restore(min, max);
+      mismatches.ranges++;
+      if (calibrator.calibrate(min, 0, analog_max) != 0 || calibrator.calibrate(max, 0, analog_max) != analog_max) {
+        if (mismatches.ends++ == 0) {
+          fprintf(stderr, "range %d..%d maps to %d..%d\n", min, max, calibrator.calibrate(min, 0, analog_max),
+                  calibrator.calibrate(max, 0, analog_max));
+        }
+      }
+      for (int input = min + 1; input < max; input += step) {
+        checkInput(calibrator, input, min, max, analog_max, mismatches);
+      }
+    }
+  }
+  printf("ANALOG_MAX %d: %lu ranges, %lu inputs, %lu wrong ends, %lu more than 1 LSB from map()\n", analog_max,
+         mismatches.ranges, mismatches.inputs, mismatches.ends, mismatches.far);
+  return mismatches;
+}
+
+// Clamping holds inputs outside the range at the ends.
+static void testClamp() {
+  MinMaxCalibrator<int> calibrator(0, 4095, true);
+  CHECK_EQUAL(calibrator.calibrate(1000, 0, 4095), 2047);
+  calibrator.update(1000);
+  calibrator.update(3000);
+  CHECK_EQUAL(calibrator.calibrate(0, 0, 4095), 0);
+  CHECK_EQUAL(calibrator.calibrate(3000, 0, 4095), 4095);
+  CHECK_EQUAL(calibrator.calibrate(4000, 0, 4095), 4095);
+  // Halfway is 2047.5, which rounds up.
+  CHECK_EQUAL(calibrator.calibrate(2000, 0, 4095), 2048);
+}
+
+int main() {
+  testClamp();
+  const Mismatches bits10 = checkRanges(1023, 1);
+  CHECK_EQUAL(bits10.ends, 0ul);
+  CHECK_EQUAL(bits10.far, 0ul);
+  const Mismatches bits12 = checkRanges(4095, 97);
+  CHECK_EQUAL(bits12.ends, 0ul);
+  CHECK_EQUAL(bits12.far, 0ul);
+  return host_test::result();
+}
@@ -0,0 +1,188 @@
+// Saves and restores calibration snapshots through the file backend and
+// the board's own storage, and checks snapshots that don't fit the
+// current settings are not restored.
+
+#include "Arduino.h"
+
+#include "CalibrationStorage.hpp"
+
+#include "HostTest.h"
+
+static const char* const PATH = "/tmp/" TEST_NAME ".bin";
+
+// An input with a single range.
+class FakeInput : public Calibrated {
+ public:
+  FakeInput() {
+    resetCalibration();
+  }
+
+  void resetCalibration() override {
+    range.min = 0;
+    range.max = 0;
+  }
+
+  uint8_t saveCalibration(CalibrationRange* ranges) const override {
+    ranges[0] = range;
+    return 1;
+  }
+
+  uint8_t loadCalibration(const CalibrationRange* ranges) override {
+    range = ranges[0];
+    return 1;
+  }
+
+  CalibrationRange range;
+};
+
+struct Inputs {
+  FakeInput inputs[MAX_CALIBRATED_COUNT];
+  Calibrated* calibrators[MAX_CALIBRATED_COUNT];
+
+  Inputs() {
+    for (int i = 0; i < MAX_CALIBRATED_COUNT; i++) calibrators[i] = &inputs[i];
+  }
+
+  void set(int16_t offset) {
+    for (int i = 0; i < MAX_CALIBRATED_COUNT; i++) {
+      inputs[i].range.min = offset + i;
+      inputs[i].range.max = offset + 1000 + i;
+    }
+  }
+
+  bool matches(int16_t offset) const {
+    for (int i = 0; i < MAX_CALIBRATED_COUNT; i++) {
+      if (inputs[i].range.min != offset + i || inputs[i].range.max != offset + 1000 + i) return false;
+    }
+    return true;
+  }
+};
+
+// Loop for long enough for the ranges to settle and be written.
+static void settle(CalibrationStore& store, Inputs& inputs) {
+  for (int ms = 0; ms < CALIBRATION_SAVE_DELAY + 3 * CALIBRATION_CHECK_INTERVAL + CALIBRATION_SNAPSHOT_SIZE; ms++) {
+    store.service(inputs.calibrators, MAX_CALIBRATED_COUNT);
+    hal::advance(1000);
+  }
+}
+
+static std::string readFile() {
+  std::ifstream file(PATH, std::ios::binary);
+  std::stringstream contents;
+  contents << file.rdbuf();
+  return contents.str();
+}
+
+static void writeFile(const std::string& contents) {
+  std::ofstream(PATH, std::ios::binary) << contents;
+}
+
+// Fletcher-16, like the store.
+static void fixChecksum(std::string& snapshot) {
+  uint16_t a = 0;
+  uint16_t b = 0;
+  for (size_t i = 0; i < snapshot.size() - 2; i++) {
+    a = (a + static_cast<uint8_t>(snapshot[i])) % 255;
+    b = (b + a) % 255;
+  }
+  snapshot[snapshot.size() - 2] = static_cast<char>(b);
+  snapshot[snapshot.size() - 1] = static_cast<char>(a);
+}
+
+static void testFileRoundTrip() {
+  remove(PATH);
+  FileCalibrationStorage storage(PATH);
+  Inputs inputs;
+  CalibrationStore store(&storage);
+  CHECK(!store.restore(inputs.calibrators, MAX_CALIBRATED_COUNT));
+
+  inputs.set(100);
+  settle(store, inputs);
+  CHECK_EQUAL(readFile().size(), static_cast<size_t>(6 + MAX_CALIBRATED_COUNT * 4 + 2));
+
+  Inputs restored;
+  CalibrationStore restored_store(&storage);
+  CHECK(restored_store.restore(restored.calibrators, MAX_CALIBRATED_COUNT));
+  CHECK(restored.matches(100));
+}
+
+// A snapshot from a build with other settings, or damaged, is skipped.
+static void testMismatch() {
+  FileCalibrationStorage storage(PATH);
+  const std::string saved = readFile();
+
+  std::string other_settings = saved;
+  other_settings[3] ^= 0x5A;
+  fixChecksum(other_settings);
+  writeFile(other_settings);
+  Inputs inputs;
+  CalibrationStore store(&storage);
+  CHECK(!store.restore(inputs.calibrators, MAX_CALIBRATED_COUNT));
+  CHECK_EQUAL(inputs.inputs[0].range.max, static_cast<int16_t>(0));
+
+  std::string damaged = saved;
+  damaged[8] ^= 0x01;
+  writeFile(damaged);
+  CalibrationStore damaged_store(&storage);
+  CHECK(!damaged_store.restore(inputs.calibrators, MAX_CALIBRATED_COUNT));
+
+  // An older version had no settings hash.
+  std::string old_version = saved;
+  old_version[2] = 1;
+  fixChecksum(old_version);
+  writeFile(old_version);
+  CalibrationStore old_store(&storage);
+  CHECK(!old_store.restore(inputs.calibrators, MAX_CALIBRATED_COUNT));
+
+  remove(PATH);
+}
+
+static unsigned long storageWrites() {
+  #if defined(ESP32)
+    return hal::nvs_writes;
+  #else
+    return EEPROM.writeCount();
+  #endif
+}
+
+static void testDefaultStorage() {
+  DefaultCalibrationStorage storage;
+  Inputs inputs;
+  CalibrationStore store(&storage);
+  CHECK(!store.restore(inputs.calibrators, MAX_CALIBRATED_COUNT));
+
+  inputs.set(200);
+  settle(store, inputs);
+  const unsigned long writes = storageWrites();
+  CHECK(writes > 0);
+
+  // An unchanged calibration isn't written again.
+  settle(store, inputs);
+  CHECK_EQUAL(storageWrites(), writes);
+
+  // Only the bytes that changed are written to the EEPROM.
+  inputs.inputs[0].range.max++;
+  settle(store, inputs);
+  #if defined(ESP32)
+    CHECK_EQUAL(storageWrites(), writes + 1);
+  #else
+    CHECK_EQUAL(storageWrites(), writes + 3);
+  #endif
+
+  Inputs restored;
+  DefaultCalibrationStorage restored_storage;
+  CalibrationStore restored_store(&restored_storage);
+  CHECK(restored_store.restore(restored.calibrators, MAX_CALIBRATED_COUNT));
+  CHECK_EQUAL(restored.inputs[0].range.max, static_cast<int16_t>(1201));
+  CHECK_EQUAL(restored.inputs[1].range.max, static_cast<int16_t>(1201));
+
+  // The writing tasks use the storage.
+  hal::stopTasks();
+}
+
+int main() {
+  testFileRoundTrip();
+  testMismatch();
+  testDefaultStorage();
+  return host_test::result();
+}
@@ -0,0 +1,153 @@
+// Checks the single pass decoder against the strchr and atoi scan each
+// output used to do on FFB and haptic commands, and compares what a
+// command costs each way.
+
+#include "Arduino.h"
+
+#include "DriverProtocol.hpp"
+
+#include "HostTest.h"
+
+#include <map>
+#include <vector>
+
+// Keeps the last value of each key it owns, and how many it was given.
+class RecordingOutput : public DecodedOuput {
+ public:
+  RecordingOutput(const char* keys) : keys(keys), calls(0) {}
+
+  bool ownsKey(DecodedOuput::Type key) const override {
+    return strchr(keys, key) != NULL;
+  }
+
+  void decodeValue(DecodedOuput::Type key, int value) override {
+    values[key] = value;
+    calls++;
+  }
+
+  void updateOutput() override {}
+
+  const char* keys;
+  std::map<char, int> values;
+  int calls;
+};
+
+// How the outputs used to decode a command, each looking for its own keys.
+static std::map<char, int> decodeWithStrchr(const char* input, const char* keys) {
+  std::map<char, int> values;
+  for (const char* key = keys; *key != '\0'; key++) {
+    const char* start = strchr(input, *key);
+    if (start != NULL) values[*key] = atoi(start + 1);
+  }
+  return values;
+}
+
+struct Outputs {
+  RecordingOutput force_feedback;
+  RecordingOutput haptics;
+  OutputDispatchTable table;
+
+  Outputs() : force_feedback("ABCDE"), haptics("FGH") {
+    table.registerOutput(&force_feedback);
+    table.registerOutput(&haptics);
+  }
+
+  // Decode the command, checks it matches the old decoding.
+  void decode(const char* command) {
+    decodeAll(command, table);
+    CHECK(force_feedback.values == decodeWithStrchr(command, force_feedback.keys));
+    CHECK(haptics.values == decodeWithStrchr(command, haptics.keys));
+  }
+};
+
+static void testCommands() {
+  Outputs ffb;
+  ffb.decode("A100B200C300D400E500\n");
+  CHECK_EQUAL(ffb.force_feedback.calls, 5);
+  CHECK_EQUAL(ffb.force_feedback.values['E'], 500);
+  CHECK_EQUAL(ffb.haptics.calls, 0);
+
+  // The driver sends the haptics as floats, they are cut to integers like atoi.
+  Outputs haptic;
+  haptic.decode("F123.45G0.5H1.0\n");
+  CHECK_EQUAL(haptic.haptics.calls, 3);
+  CHECK_EQUAL(haptic.haptics.values['F'], 123);
+  CHECK_EQUAL(haptic.haptics.values['G'], 0);
+  CHECK_EQUAL(haptic.haptics.values['H'], 1);
+
+  // Only the first value of a repeated key counts.
+  Outputs repeated;
+  repeated.decode("A100B200A300F1.5F2.5\n");
+  CHECK_EQUAL(repeated.force_feedback.calls, 2);
+  CHECK_EQUAL(repeated.force_feedback.values['A'], 100);
+  CHECK_EQUAL(repeated.haptics.values['F'], 1);
+
+  // Keys nobody owns, or the table doesn't know, and other bytes are skipped.
+  Outputs unknown;
+  unknown.decode("Z12I1J7Q-5a9 A-20,B30\r\n");
+  CHECK_EQUAL(unknown.force_feedback.calls, 2);
+  CHECK_EQUAL(unknown.force_feedback.values['A'], -20);
+  CHECK_EQUAL(unknown.force_feedback.values['B'], 30);
+  CHECK_EQUAL(unknown.haptics.calls, 0);
+
+  Outputs empty;
+  empty.decode("\n");
+  CHECK_EQUAL(empty.force_feedback.calls + empty.haptics.calls, 0);
+}
+
+// Random commands with every key, repeats, floats and signs.
+static void testRandomCommands() {
+  uint32_t random = 1;
+  auto next = [&random](uint32_t range) {
+    random = random * 1664525u + 1013904223u;
+    return (random >> 8) % range;
+  };
+
+  for (int i = 0; i < 20000; i++) {
+    std::string command;
+    const int values = next(12);
+    for (int v = 0; v < values; v++) {
+      command += static_cast<char>('A' + next(26));
+      if (next(8) == 0) command += '-';
+      command += std::to_string(next(100000));
+      if (next(4) == 0) command += "." + std::to_string(next(1000));
+    }
+    command += '\n';
+    Outputs outputs;
+    outputs.decode(command.c_str());
+  }
+}
+
+// A command for all the FFB outputs and one for the haptics.
+static void benchmark() {
+  const char* const commands[] = {"A1000B1000C1000D1000E1000\n", "F174.6G0.02H0.5\n"};
+  RecordingOutput ffb[] = {"A", "B", "C", "D", "E"};
+  RecordingOutput haptic("FGH");
+  OutputDispatchTable table;
+  for (RecordingOutput& output : ffb) table.registerOutput(&output);
+  table.registerOutput(&haptic);
+
+  volatile int sink = 0;
+  for (const char* command : commands) {
+    const double single_pass = host_test::timeCall([&]() { decodeAll(command, table); }, 1000000);
+    const double scanning = host_test::timeCall([&]() {
+      for (RecordingOutput& output : ffb) {
+        const char* start = strchr(command, output.keys[0]);
+        if (start != NULL) sink = sink + atoi(start + 1);
+      }
+      for (const char* key = haptic.keys; *key != '\0'; key++) {
+        const char* start = strchr(command, *key);
+        if (start != NULL) sink = sink + atoi(start + 1);
+      }
+    }, 1000000);
+    printf("%.*s: %.0f ns with a scan per output, %.0f ns in one pass\n",
+           static_cast<int>(strlen(command) - 1), command, scanning, single_pass);
+  }
+}
+
+int main() {
+  testCommands();
+  testRandomCommands();
+  benchmark();
+  return host_test::result();
+}
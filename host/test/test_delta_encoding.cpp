@@ -0,0 +1,166 @@
+// Checks the delta encoding and its keyframes, then replays a trace of a
+// hand moving and holding still and reports the bytes per frame against
+// sending every channel.
+
+#include "Arduino.h"
+
+#include "DriverProtocol.hpp"
+
+#include "HostTest.h"
+
+#define TRACE_CHANNELS 7
+
+// The channels of a packed frame, and whether it is a keyframe.
+struct PackedFrame {
+  uint16_t mask;
+  int values[BinaryFrame::ANALOG_CHANNELS];
+
+  bool keyframe() const {
+    return mask & BinaryFrame::KEYFRAME_FLAG;
+  }
+
+  bool has(uint8_t channel) const {
+    return mask & (1u << channel);
+  }
+};
+
+static PackedFrame unpack(const uint8_t* packed, size_t size) {
+  PackedFrame frame;
+  frame.mask = (packed[0] << 8) | packed[1];
+  size_t bit = 4 * 8;
+  for (uint8_t channel = 0; channel < BinaryFrame::ANALOG_CHANNELS; channel++) {
+    frame.values[channel] = -1;
+    if (!frame.has(channel)) continue;
+
+    int value = 0;
+    for (uint8_t i = 0; i < ANALOG_BITS; i++, bit++) {
+      value = (value << 1) | ((packed[bit / 8] >> (7 - bit % 8)) & 1);
+    }
+    frame.values[channel] = value;
+  }
+  CHECK_EQUAL((bit + 7) / 8, size);
+  return frame;
+}
+
+// Pack a frame of the fingers and joystick through the filter.
+static PackedFrame encode(DeltaFilter* delta, const int (&values)[TRACE_CHANNELS], size_t* framed_size = NULL) {
+  BinaryFrame frame;
+  for (uint8_t channel = 0; channel < TRACE_CHANNELS; channel++) {
+    frame.setAnalog(static_cast<EncodedInput::Type>('A' + channel), values[channel]);
+  }
+  if (delta != NULL) delta->apply(frame);
+
+  uint8_t packed[BINARY_FRAME_MAX_SIZE];
+  const size_t size = frame.pack(packed);
+  if (framed_size != NULL) {
+    uint8_t framed[BINARY_ENCODED_MAX_SIZE];
+    // With the delimiter.
+    *framed_size = cobsEncode(packed, size, framed) + 1;
+  }
+  return unpack(packed, size);
+}
+
+static void testThresholds() {
+  DeltaFilter delta(50);
+  int values[TRACE_CHANNELS] = {1000, 1000, 1000, 1000, 1000, 2000, 2000};
+
+  // The first frame is a keyframe with everything.
+  PackedFrame frame = encode(&delta, values);
+  CHECK(frame.keyframe());
+  CHECK_EQUAL(frame.mask & 0x7F, 0x7F);
+
+  // Nothing moved.
+  frame = encode(&delta, values);
+  CHECK(!frame.keyframe());
+  CHECK_EQUAL(frame.mask, 0);
+
+  // Within the thresholds, then past them.
+  values[0] += DELTA_FLEXION_THRESHOLD;
+  values[5] += DELTA_JOYSTICK_THRESHOLD;
+  CHECK_EQUAL(encode(&delta, values).mask, 0);
+  values[0] += 1;
+  values[5] += 1;
+  frame = encode(&delta, values);
+  CHECK_EQUAL(frame.mask, (1 << 0) | (1 << 5));
+  CHECK_EQUAL(frame.values[0], 1000 + DELTA_FLEXION_THRESHOLD + 1);
+
+  // A slow drift is measured from the value the driver has, so it is
+  // sent once it adds up.
+  int sent = 0;
+  for (int i = 0; i < 10; i++) {
+    values[1] += 1;
+    sent += encode(&delta, values).has(1);
+  }
+  CHECK_EQUAL(sent, 10 / (DELTA_FLEXION_THRESHOLD + 1));
+}
+
+static void testKeyframes() {
+  const int interval = 10;
+  DeltaFilter delta(interval);
+  const int values[TRACE_CHANNELS] = {10, 20, 30, 40, 50, 60, 70};
+
+  // Every interval frames, even when nothing changes.
+  for (int i = 0; i < interval * 3; i++) {
+    const PackedFrame frame = encode(&delta, values);
+    CHECK_EQUAL(frame.keyframe(), i % interval == 0);
+    CHECK_EQUAL(frame.mask & 0x7F, frame.keyframe() ? 0x7F : 0);
+  }
+
+  // And when the driver or the link asks for one, which restarts the count.
+  delta.requestKeyframe();
+  CHECK(encode(&delta, values).keyframe());
+  for (int i = 1; i < interval; i++) CHECK(!encode(&delta, values).keyframe());
+  CHECK(encode(&delta, values).keyframe());
+}
+
+// A hand opening and closing, then holding still with a little ADC noise.
+static void traceValues(int frame, int (&values)[TRACE_CHANNELS]) {
+  uint32_t noise = frame * 2654435761u;
+  for (uint8_t channel = 0; channel < TRACE_CHANNELS; channel++) {
+    noise = noise * 1664525u + 1013904223u;
+    const int jitter = static_cast<int>(noise >> 30) - 1;
+    const bool moving = frame % 500 < 100 && channel < 5;
+    const int phase = (frame + channel * 7) % 100;
+    const int flex = moving ? (phase < 50 ? phase : 100 - phase) * ANALOG_MAX / 50 : ANALOG_MAX / 3;
+    values[channel] = constrain((channel < 5 ? flex : ANALOG_MAX / 2) + jitter, 0, ANALOG_MAX);
+  }
+}
+
+static void testReplay() {
+  DeltaFilter delta(DELTA_KEYFRAME_INTERVAL);
+  int driver[TRACE_CHANNELS] = {};
+  unsigned long full_bytes = 0;
+  unsigned long delta_bytes = 0;
+  const int frames = 2000;
+  for (int i = 0; i < frames; i++) {
+    int values[TRACE_CHANNELS];
+    traceValues(i, values);
+
+    size_t full_size;
+    size_t delta_size;
+    encode(NULL, values, &full_size);
+    const PackedFrame frame = encode(&delta, values, &delta_size);
+    full_bytes += full_size;
+    delta_bytes += delta_size;
+
+    // The driver keeps the last value of every channel, which is never
+    // further off than the threshold.
+    for (uint8_t channel = 0; channel < TRACE_CHANNELS; channel++) {
+      if (frame.has(channel)) driver[channel] = frame.values[channel];
+      const int threshold = channel < 5 ? DELTA_FLEXION_THRESHOLD : DELTA_JOYSTICK_THRESHOLD;
+      if (!CHECK(abs(driver[channel] - values[channel]) <= threshold)) return;
+    }
+  }
+
+  printf("full:  %.1f bytes per frame\n", static_cast<double>(full_bytes) / frames);
+  printf("delta: %.1f bytes per frame, keyframe every %d frames\n",
+         static_cast<double>(delta_bytes) / frames, DELTA_KEYFRAME_INTERVAL);
+  CHECK(delta_bytes < full_bytes / 2);
+}
+
+int main() {
+  testThresholds();
+  testKeyframes();
+  testReplay();
+  return host_test::result();
+}
@@ -0,0 +1,49 @@
+// Runs the sketch with the sampling and transport tasks on their own
+// threads for 100ms of the virtual clock, and checks the frames that
+// reach the driver.
+
+#include "Arduino.h"
+
+#include "open-gloves.ino"
+
+#include "HostTest.h"
+#include "Signals.h"
+
+int main() {
+  // The driver's end of the link.
+  #if COMMUNICATION == COMM_WIFI
+    WiFiClient driver = hal::connectClient();
+    Stream& link = *driver.stream();
+  #else
+    Stream& link = Serial;
+  #endif
+
+  signals::drive(0);
+  setup();
+  // The loop task deletes itself, it doesn't do any work.
+  loop();
+
+  hal::advance(100000);
+  hal::stopTasks();
+
+  // Every frame is complete and the first one has every channel.
+  const std::string output = link.takeOutput();
+  size_t start = 0;
+  int frames = 0;
+  for (size_t end = output.find('\0'); end != std::string::npos; end = output.find('\0', start)) {
+    uint8_t frame[BINARY_FRAME_MAX_SIZE + 1];
+    const size_t size = cobsDecode(reinterpret_cast<const uint8_t*>(output.data() + start), end - start, frame);
+    if (CHECK(size >= 4) && frames == 0) {
+      CHECK(frame[0] & (BinaryFrame::KEYFRAME_FLAG >> 8));
+    }
+    frames++;
+    start = end + 1;
+  }
+  CHECK_EQUAL(start, output.size());
+  // A frame for every loop from the start. The send rate controller
+  // waits for an interval before the first one.
+  CHECK_EQUAL(frames, 100 / LOOP_TIME + (ENABLE_SEND_RATE_CONTROL ? 0 : 1));
+  CHECK_EQUAL(hal::outputLevel(PIN_LED), HIGH);
+
+  return host_test::result();
+}
@@ -0,0 +1,109 @@
+// Checks the alpha encoding against the snprintf formats it replaced, for
+// every key and value and for whole frames of the configured inputs, and
+// compares what a frame costs each way.
+
+#include "Arduino.h"
+
+#include "open-gloves.ino"
+
+#include "HostTest.h"
+#include "Signals.h"
+
+static const char KEYS[] = "ABCDEFGHIJKLMNOPTU";
+
+static void testKeyValues() {
+  char encoded[16];
+  char expected[16];
+  int mismatches = 0;
+  for (const char* key = KEYS; *key != '\0'; key++) {
+    for (long value = -100000; value <= 100000; value++) {
+      const int size = encodeKeyValue(encoded, *key, value);
+      const int expected_size = snprintf(expected, sizeof(expected), "%c%d", *key, static_cast<int>(value));
+      if (size != expected_size || memcmp(encoded, expected, size) != 0) mismatches++;
+    }
+  }
+  CHECK_EQUAL(mismatches, 0);
+
+  // The ends of an int.
+  for (int value : {INT_MIN, INT_MIN + 1, -1, 0, 1, INT_MAX - 1, INT_MAX}) {
+    const int size = encodeKeyValue(encoded, 'A', value);
+    snprintf(expected, sizeof(expected), "%c%d", 'A', value);
+    CHECK_EQUAL(std::string(encoded, size), std::string(expected));
+  }
+
+  // The frame timing, a time in microseconds and a counter, as long as a
+  // long is on the boards.
+  for (unsigned long value : {0ul, 9ul, 10ul, 999999999ul, 1000000000ul, 4294967295ul}) {
+    const int size = encodeUnsigned(encoded, value);
+    snprintf(expected, sizeof(expected), "%lu", value);
+    CHECK_EQUAL(std::string(encoded, size), std::string(expected));
+  }
+}
+
+// The frame as the inputs used to encode it, with snprintf for the fingers
+// and the joystick. The keys follow the order of HardwareConfig.hpp.
+struct SnprintfEncoder {
+  char* output;
+  int offset;
+  int finger;
+  int joystick;
+
+  void operator()(const Finger& input) {
+    offset += snprintf(output + offset, Finger::ENCODED_SIZE, "%c%d", fingerKey(), input.flexionValue());
+  }
+
+  void operator()(const SplayFinger& input) {
+    const char key = fingerKey();
+    offset += snprintf(output + offset, SplayFinger::ENCODED_SIZE, "%c%d(%cB)%d", key, input.flexionValue(), key,
+                       input.splayValue());
+  }
+
+  void operator()(const JoyStickAxis& input) {
+    const char key = joystick++ == 0 ? EncodedInput::Type::JOY_X : EncodedInput::Type::JOY_Y;
+    offset += snprintf(output + offset, JoyStickAxis::ENCODED_SIZE, "%c%d", key, input.getValue());
+  }
+
+  template<typename T>
+  void operator()(const T& input) {
+    offset += input.T::encode(output + offset);
+  }
+
+  char fingerKey() {
+    return (ENABLE_THUMB ? EncodedInput::Type::THUMB : EncodedInput::Type::INDEX) + finger++;
+  }
+};
+
+static int encodeWithSnprintf(char* output) {
+  SnprintfEncoder encoder = {output, 0, 0, 0};
+  InputRegistry::forEach(encoder);
+  output[encoder.offset++] = '\n';
+  output[encoder.offset] = '\0';
+  return encoder.offset;
+}
+
+// Whole frames through a scripted session, then the cost of one.
+static void testFrames() {
+  char encoded[ENCODED_OUTPUT_SIZE];
+  char expected[ENCODED_OUTPUT_SIZE];
+  int mismatches = 0;
+  for (int i = 0; i < 400; i++) {
+    signals::drive(i);
+    InputRegistry::forEach(ReadInput());
+    const int size = encodeAll<InputRegistry>(encoded);
+    const int expected_size = encodeWithSnprintf(expected);
+    if (size != expected_size || strcmp(encoded, expected) != 0) mismatches++;
+  }
+  CHECK_EQUAL(mismatches, 0);
+
+  const double table = host_test::timeCall([&]() { encodeAll<InputRegistry>(encoded); }, 200000);
+  const double formatted = host_test::timeCall([&]() { encodeWithSnprintf(expected); }, 200000);
+  printf("%d byte frame: %.0f ns with snprintf, %.0f ns without (%.1fx)\n",
+         static_cast<int>(strlen(encoded)), formatted, table, formatted / table);
+}
+
+int main() {
+  setup();
+  testKeyValues();
+  testFrames();
+  return host_test::result();
+}
@@ -0,0 +1,174 @@
+// Replays noisy finger signals through the adaptive filter and the median
+// filter, and reports how much noise each leaves on a still finger and
+// how far each lags a moving one. A recorded trace can be replayed too:
+//
+//   test_filter_replay [trace.csv pin]
+//
+// The trace is taken as the true signal and the same noise is added to it.
+
+#include "Arduino.h"
+
+#include "AdaptiveFilter.hpp"
+#include "MedianFilter.hpp"
+
+#include "HostTest.h"
+
+#include <math.h>
+
+#include <random>
+#include <vector>
+
+static const int NOISE = 8;
+
+// The filters compared, each fed the same readings.
+struct Filters {
+  MedianFilter<int, MEDIAN_SAMPLES> median;
+  AdaptiveFilter adaptive;
+  MedianFilter<int, MEDIAN_SAMPLES> median_first;
+  AdaptiveFilter adaptive_after;
+
+  static constexpr int COUNT = 4;
+
+  void filter(int value, int* outputs) {
+    outputs[0] = value;
+    median.add(value);
+    outputs[1] = median.getMedian();
+    outputs[2] = adaptive.filter(value);
+    median_first.add(value);
+    outputs[3] = adaptive_after.filter(median_first.getMedian());
+  }
+
+  static const char* name(int filter) {
+    static const char* const names[COUNT] = {"raw", "median", "adaptive", "median+adaptive"};
+    return names[filter];
+  }
+};
+
+struct Report {
+  // RMS error while the signal is still (LSB), -1 if it never is.
+  double noise[Filters::COUNT];
+  // Samples until a step is 90% of the way there.
+  int step_latency[Filters::COUNT];
+  // Mean error while the signal ramps, over its slope (samples).
+  double ramp_lag[Filters::COUNT];
+};
+
+// Run the true signal through the filters with noise added. still says
+// which samples the signal holds, moving which ones it ramps.
+static Report replay(const std::vector<int>& signal, const std::vector<bool>& still, int step_at) {
+  std::mt19937 random(1234);
+  std::normal_distribution<double> noise(0.0, NOISE);
+  Filters filters;
+  Report report = {};
+  double still_error[Filters::COUNT] = {};
+  double ramp_error[Filters::COUNT] = {};
+  double ramp_slope = 0;
+  int still_count = 0;
+  for (int filter = 0; filter < Filters::COUNT; filter++) report.step_latency[filter] = -1;
+
+  for (size_t i = 0; i < signal.size(); i++) {
+    int outputs[Filters::COUNT];
+    filters.filter(signal[i] + lround(noise(random)), outputs);
+    const int slope = i > 0 ? signal[i] - signal[i - 1] : 0;
+    if (still[i]) still_count++;
+    if (slope != 0) ramp_slope += abs(slope);
+
+    for (int filter = 0; filter < Filters::COUNT; filter++) {
+      const int error = outputs[filter] - signal[i];
+      if (still[i]) still_error[filter] += error * error;
+      if (slope != 0) ramp_error[filter] += abs(error);
+
+      if (step_at >= 0 && static_cast<int>(i) >= step_at && report.step_latency[filter] < 0) {
+        const int step = signal[step_at] - signal[step_at - 1];
+        if ((outputs[filter] - signal[step_at - 1]) * 10 >= step * 9) report.step_latency[filter] = i - step_at;
+      }
+    }
+  }
+
+  for (int filter = 0; filter < Filters::COUNT; filter++) {
+    report.noise[filter] = still_count > 0 ? sqrt(still_error[filter] / still_count) : -1;
+    report.ramp_lag[filter] = ramp_slope > 0 ? ramp_error[filter] / ramp_slope : 0;
+  }
+  return report;
+}
+
+static void print(const char* signal, const Report& report) {
+  printf("%s, %d LSB RMS of noise, %d ms per sample:\n", signal, NOISE, LOOP_TIME);
+  printf("  %-16s %12s %14s %14s\n", "filter", "noise (LSB)", "step 90% (ms)", "ramp lag (ms)");
+  for (int filter = 0; filter < Filters::COUNT; filter++) {
+    char noise[16] = "-";
+    char step[16] = "-";
+    if (report.noise[filter] >= 0) snprintf(noise, sizeof(noise), "%.2f", report.noise[filter]);
+    if (report.step_latency[filter] >= 0) snprintf(step, sizeof(step), "%d", report.step_latency[filter] * LOOP_TIME);
+    printf("  %-16s %12s %14s %14.1f\n", Filters::name(filter), noise, step, report.ramp_lag[filter] * LOOP_TIME);
+  }
+}
+
+// A still finger, a step, a hold, then a ramp back down and a hold.
+static void testSynthetic() {
+  std::vector<int> signal;
+  std::vector<bool> still;
+  const auto hold = [&](int value, int samples) {
+    for (int i = 0; i < samples; i++) {
+      signal.push_back(value);
+      // Leave the filters a second to settle before counting the noise.
+      still.push_back(i >= 250);
+    }
+  };
+  hold(1000, 500);
+  const int step_at = signal.size();
+  hold(3000, 500);
+  for (int i = 1; i <= 100; i++) {
+    signal.push_back(3000 - 20 * i);
+    still.push_back(false);
+  }
+  hold(1000, 500);
+
+  const Report report = replay(signal, still, step_at);
+  print("Step and ramp", report);
+
+  // The median filter is as slow as half its window on a step, the
+  // adaptive filter opens up and follows much sooner.
+  CHECK(report.step_latency[1] >= MEDIAN_SAMPLES / 2 - 1);
+  CHECK(report.step_latency[2] < report.step_latency[1]);
+  CHECK(report.ramp_lag[2] < report.ramp_lag[1]);
+  // And it still takes most of the noise off a still finger.
+  CHECK(report.noise[2] < report.noise[0] / 2);
+  CHECK(report.noise[1] < report.noise[0] / 2);
+}
+
+// A recorded trace, read back through analogRead one loop at a time.
+static void testTrace(const char* path, int pin) {
+  std::string error;
+  if (!CHECK(hal::loadTrace(path, error))) {
+    fprintf(stderr, "%s: %s\n", path, error.c_str());
+    return;
+  }
+
+  std::vector<int> signal;
+  std::vector<bool> still;
+  while (!hal::traceFinished()) {
+    signal.push_back(analogRead(pin));
+    hal::advance(LOOP_TIME * 1000ul);
+  }
+  // Still where the signal has held for longer than the median window.
+  for (size_t i = 0; i < signal.size(); i++) {
+    bool held = i >= MEDIAN_SAMPLES;
+    for (size_t back = 1; held && back <= MEDIAN_SAMPLES; back++) held = signal[i - back] == signal[i];
+    still.push_back(held);
+  }
+
+  const Report report = replay(signal, still, -1);
+  print(path, report);
+  CHECK(report.ramp_lag[2] < report.ramp_lag[1]);
+}
+
+int main(int argc, char** argv) {
+  testSynthetic();
+  if (argc > 2) {
+    testTrace(argv[1], atoi(argv[2]));
+  } else {
+    testTrace("traces/grip_esp32.csv", 35);
+  }
+  return host_test::result();
+}
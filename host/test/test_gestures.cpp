@@ -0,0 +1,125 @@
+// Replays noisy finger traces through the gesture table and counts how
+// often each gesture flips, against the single threshold at ANALOG_MAX / 2
+// the gestures used before. Also times a pass over the table.
+
+#include "Arduino.h"
+
+#include "HardwareConfig.hpp"
+
+#include "HostTest.h"
+
+// A finger with a scripted flexion.
+struct ScriptedFinger {
+  int flexion;
+
+  int flexionValue() const {
+    return flexion;
+  }
+};
+
+static ScriptedFinger scripted[FINGER_COUNT];
+static ScriptedFinger* const scripted_fingers[FINGER_COUNT] = {
+  #if ENABLE_THUMB
+    &scripted[4],
+  #endif
+  &scripted[0], &scripted[1], &scripted[2], &scripted[3]
+};
+
+// Index to pinky flex together, slowly closing and opening with ADC
+// noise, and resting half closed for a while in between. The thumb
+// stays open.
+static void setFlexion(int frame) {
+  static uint32_t noise = 1;
+  const int period = 1000;
+  const int phase = frame % period;
+  int flex;
+  if (phase < 300) flex = phase * ANALOG_MAX / 300;
+  else if (phase < 600) flex = ANALOG_MAX - (phase - 300) * ANALOG_MAX / 300;
+  else flex = ANALOG_MAX / 2;
+
+  for (int i = 0; i < FINGER_COUNT; i++) {
+    noise = noise * 1664525u + 1013904223u;
+    const int jitter = static_cast<int>(noise >> 22) % (ANALOG_MAX / 25) - ANALOG_MAX / 50;
+    scripted[i].flexion = i == 4 ? 0 : constrain(flex + jitter, 0, ANALOG_MAX);
+  }
+}
+
+static void testChatter() {
+  GestureEngine<ScriptedFinger> engine(scripted_fingers, gesture_table);
+  const int frames = 5000;
+  const int cycles = frames / 1000;
+
+  int flips[GESTURE_COUNT] = {};
+  int single_flips[GESTURE_COUNT] = {};
+  bool was_pressed[GESTURE_COUNT] = {};
+  bool single_pressed[GESTURE_COUNT] = {};
+  for (int frame = 0; frame < frames; frame++) {
+    setFlexion(frame);
+    engine.readInput();
+
+    for (uint8_t g = 0; g < GESTURE_COUNT; g++) {
+      flips[g] += engine.isPressed(g) != was_pressed[g];
+      was_pressed[g] = engine.isPressed(g);
+
+      // The old gestures: the mean of the fingers over half way.
+      long sum = 0;
+      int weights = 0;
+      for (uint8_t slot = 0; slot < GESTURE_FINGER_SLOTS; slot++) {
+        const int finger = slot == 0 ? 4 : slot - 1;
+        sum += gesture_table[g].weights[slot] * scripted[finger].flexion;
+        weights += gesture_table[g].weights[slot];
+      }
+      const bool pressed = sum / weights > ANALOG_MAX / 2;
+      single_flips[g] += pressed != single_pressed[g];
+      single_pressed[g] = pressed;
+    }
+  }
+
+  for (uint8_t g = 0; g < GESTURE_COUNT; g++) {
+    printf("gesture %c: %d flips with hysteresis, %d with a single threshold, over %d closes\n",
+           gesture_table[g].type, flips[g], single_flips[g], cycles);
+  }
+
+  // The trigger and grab press and release once for each close, the pinch
+  // includes the open thumb so it never presses.
+  CHECK_EQUAL(flips[0], 2 * cycles);
+  CHECK(single_flips[0] > 2 * cycles);
+  #if GRAB_GESTURE
+    CHECK_EQUAL(flips[1], 2 * cycles);
+  #endif
+  #if PINCH_GESTURE
+    CHECK_EQUAL(flips[GESTURE_COUNT - 1], 0);
+  #endif
+}
+
+static void testTriggerValue() {
+  GestureEngine<ScriptedFinger> engine(scripted_fingers, gesture_table);
+  for (int i = 0; i < FINGER_COUNT; i++) scripted[i].flexion = 0;
+  scripted[0].flexion = 3000;
+  engine.readInput();
+
+  char output[GestureEngine<ScriptedFinger>::ENCODED_SIZE + 1];
+  output[engine.encode(output)] = '\0';
+  #if ENABLE_TRIGGER_VALUE
+    CHECK_EQUAL(std::string(output), std::string("IP3000"));
+  #else
+    CHECK_EQUAL(std::string(output), std::string("I"));
+  #endif
+}
+
+static void benchmark() {
+  GestureEngine<ScriptedFinger> engine(scripted_fingers, gesture_table);
+  int frame = 0;
+  const double time = host_test::timeCall([&]() {
+    setFlexion(frame++);
+    engine.readInput();
+  }, 100000);
+  printf("%.1f ns per pass over %d gestures, with the scripted fingers\n", time, GESTURE_COUNT);
+}
+
+int main() {
+  testChatter();
+  testTriggerValue();
+  benchmark();
+  return host_test::result();
+}
@@ -0,0 +1,135 @@
+// Checks the host's recorded signals and attached serial port: a trace
+// played back through analogRead and digitalRead, and the sketch running
+// from a trace with the driver on the other end of a pipe.
+
+#include "Arduino.h"
+
+#include "open-gloves.ino"
+
+#include "HostTest.h"
+
+static const char* const TRACE_PATH = "/tmp/" TEST_NAME ".csv";
+
+static void writeFile(const char* path, const std::string& contents) {
+  std::ofstream(path) << contents;
+}
+
+static int edges = 0;
+
+static void countEdge() {
+  edges++;
+}
+
+static void testTracePlayback() {
+  writeFile(TRACE_PATH, "time_us,a32,d27\n0,100,1\n1000,200,0\n# held\n5000,300,1\n");
+  std::string error;
+  CHECK(hal::loadTrace(TRACE_PATH, error));
+  CHECK_EQUAL(analogRead(32), 100);
+  CHECK_EQUAL(digitalRead(27), HIGH);
+  attachInterrupt(27, countEdge, CHANGE);
+  hal::advance(999);
+  CHECK_EQUAL(analogRead(32), 100);
+  hal::advance(1);
+  CHECK_EQUAL(analogRead(32), 200);
+  CHECK_EQUAL(digitalRead(27), LOW);
+  CHECK(!hal::traceFinished());
+
+  // Rows are played as the clock reaches them, the last one holds.
+  hal::advance(10000);
+  CHECK_EQUAL(digitalRead(27), HIGH);
+  CHECK_EQUAL(analogRead(32), 300);
+  CHECK(hal::traceFinished());
+  CHECK_EQUAL(edges, 2);
+  detachInterrupt(27);
+
+  writeFile(TRACE_PATH, "time,a32\n0,1\n");
+  CHECK(!hal::loadTrace(TRACE_PATH, error));
+  CHECK_EQUAL(error, std::string("the first column must be time_us"));
+  writeFile(TRACE_PATH, "time_us,x3\n0,1\n");
+  CHECK(!hal::loadTrace(TRACE_PATH, error));
+  writeFile(TRACE_PATH, "time_us,a32\n10,1\n5,2\n");
+  CHECK(!hal::loadTrace(TRACE_PATH, error));
+  CHECK_EQUAL(error, std::string("row 3 goes back in time"));
+  writeFile(TRACE_PATH, "time_us,a32,a33\n0,1\n");
+  CHECK(!hal::loadTrace(TRACE_PATH, error));
+  remove(TRACE_PATH);
+}
+
+// Everything that has arrived on the descriptor.
+static std::string readAvailable(int fd) {
+  std::string data;
+  pollfd waiting = {fd, POLLIN, 0};
+  while (poll(&waiting, 1, 0) > 0) {
+    char bytes[4096];
+    const ssize_t count = read(fd, bytes, sizeof(bytes));
+    if (count <= 0) break;
+    data.append(bytes, count);
+  }
+  return data;
+}
+
+// The lines sent, and the replies to pings kept apart.
+static std::vector<std::string> splitLines(const std::string& data, std::vector<std::string>& replies) {
+  std::vector<std::string> frames;
+  size_t start = 0;
+  for (size_t end = data.find('\n'); end != std::string::npos; end = data.find('\n', start)) {
+    const std::string line = data.substr(start, end - start);
+    (line[0] == '~' ? replies : frames).push_back(line);
+    start = end + 1;
+  }
+  return frames;
+}
+
+// The grip trace through the whole sketch, with commands and frames on pipes.
+static void testSketchOnPipes() {
+  int commands[2];
+  int frames_sent[2];
+  if (!CHECK(pipe(commands) == 0 && pipe(frames_sent) == 0)) return;
+  Serial.attach(commands[0], frames_sent[1]);
+
+  std::string error;
+  CHECK(hal::loadTrace("traces/grip_esp32.csv", error));
+  setup();
+  const unsigned long start = micros();
+
+  std::string sent;
+  int loops = 0;
+  for (; !hal::traceFinished(); loops++) {
+    if (loops == 10) CHECK_EQUAL(write(commands[1], "J42\n", 4), 4);
+    loop();
+    sent += readAvailable(frames_sent[0]);
+  }
+
+  std::vector<std::string> replies;
+  const std::vector<std::string> frames = splitLines(sent, replies);
+  CHECK_EQUAL(frames.size(), static_cast<size_t>(loops));
+  if (CHECK_EQUAL(replies.size(), static_cast<size_t>(1))) {
+    CHECK(replies[0].compare(0, 5, "~J42,") == 0);
+  }
+
+  // The A button is held from 400 to 600 ms into the trace.
+  int first_pressed = -1;
+  int last_pressed = -1;
+  for (size_t i = 0; i < frames.size(); i++) {
+    if (frames[i].find('J') == std::string::npos) continue;
+    if (first_pressed < 0) first_pressed = i;
+    last_pressed = i;
+  }
+  const int loop_ms = LOOP_TIME;
+  printf("%d loops from the trace, A pressed from %d to %d ms\n", loops, first_pressed * loop_ms,
+         last_pressed * loop_ms);
+  CHECK(first_pressed * loop_ms >= 400 && first_pressed * loop_ms <= 400 + 3 * loop_ms);
+  CHECK(last_pressed * loop_ms >= 596 && last_pressed * loop_ms <= 600 + 3 * loop_ms);
+  CHECK(micros() - start >= 1000000ul);
+
+  close(commands[0]);
+  close(commands[1]);
+  close(frames_sent[0]);
+  close(frames_sent[1]);
+}
+
+int main() {
+  testTracePlayback();
+  testSketchOnPipes();
+  return host_test::result();
+}
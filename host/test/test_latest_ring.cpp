@@ -0,0 +1,107 @@
+// Hammers LatestRing from a producer and a consumer thread. Every frame is
+// filled with its own number, so a frame the consumer takes while the
+// producer is still writing it would show up as mixed words.
+
+#include "Arduino.h"
+
+#include "LatestRing.hpp"
+
+#include "HostTest.h"
+
+#include <thread>
+
+// Big enough that writing it takes a while next to the exchange.
+struct Frame {
+  uint32_t words[64];
+};
+
+static void fill(Frame& frame, uint32_t number) {
+  for (uint32_t& word : frame.words) word = number;
+}
+
+// Fill the frame in two halves, and let the consumer run in between on
+// some frames, so it also gets a go while a frame is half written when
+// there is only one core.
+static void fillSlowly(Frame& frame, uint32_t number) {
+  const size_t half = sizeof(frame.words) / sizeof(frame.words[0]) / 2;
+  for (size_t i = 0; i < half; i++) frame.words[i] = number;
+  if (number % 4 == 0) std::this_thread::yield();
+  for (size_t i = half; i < 2 * half; i++) frame.words[i] = number;
+}
+
+// The number of the frame, or 0 if it is torn.
+static uint32_t check(const Frame& frame) {
+  for (uint32_t word : frame.words) {
+    if (word != frame.words[0]) return 0;
+  }
+  return frame.words[0];
+}
+
+// Taken values are the newest, each at most once.
+static void testLatestWins() {
+  LatestRing<Frame> ring;
+  CHECK(!ring.take());
+
+  fill(ring.writeSlot(), 1);
+  CHECK(ring.publish());
+  fill(ring.writeSlot(), 2);
+  CHECK(!ring.publish());
+  CHECK_EQUAL(ring.supersededCount(), 1ul);
+
+  CHECK(ring.take());
+  CHECK_EQUAL(check(ring.readSlot()), 2u);
+  CHECK(!ring.take());
+  CHECK_EQUAL(check(ring.readSlot()), 2u);
+
+  fill(ring.writeSlot(), 3);
+  CHECK(ring.publish());
+  CHECK(ring.take());
+  CHECK_EQUAL(check(ring.readSlot()), 3u);
+}
+
+static void testStress() {
+  const uint32_t FRAMES = 200000;
+  LatestRing<Frame> ring;
+  unsigned long published = 0;
+
+  std::thread producer([&]() {
+    for (uint32_t number = 1; number <= FRAMES; number++) {
+      fillSlowly(ring.writeSlot(), number);
+      if (ring.publish()) published++;
+    }
+  });
+
+  unsigned long taken = 0;
+  unsigned long torn = 0;
+  unsigned long out_of_order = 0;
+  uint32_t last = 0;
+  while (last != FRAMES) {
+    if (!ring.take()) {
+      std::this_thread::yield();
+      continue;
+    }
+    taken++;
+    const uint32_t number = check(ring.readSlot());
+    if (number == 0) {
+      torn++;
+      continue;
+    }
+    if (number <= last) out_of_order++;
+    last = number;
+  }
+  producer.join();
+
+  printf("%u frames published, %lu taken, %lu replaced before they were taken\n", FRAMES, taken,
+         ring.supersededCount());
+  CHECK_EQUAL(torn, 0ul);
+  CHECK_EQUAL(out_of_order, 0ul);
+  // Every frame was either taken or replaced by a newer one.
+  CHECK_EQUAL(published + ring.supersededCount(), static_cast<unsigned long>(FRAMES));
+  CHECK_EQUAL(taken, published);
+}
+
+int main() {
+  testLatestWins();
+  testStress();
+  return host_test::result();
+}
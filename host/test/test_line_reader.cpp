@@ -0,0 +1,111 @@
+// Feeds the line reader byte streams split at every boundary, overlong
+// lines and CR LF endings, and checks a new WiFi client doesn't get what
+// the last one left half sent.
+
+#include "Arduino.h"
+
+#include "SerialWIFICommunication.hpp"
+
+#include "HostTest.h"
+
+#include <vector>
+
+// Read every message that has arrived.
+static std::vector<std::string> readAll(LineReader& reader, Stream& stream, size_t output_size = RECEIVE_BUFFER_SIZE) {
+  std::vector<std::string> lines;
+  char output[RECEIVE_BUFFER_SIZE];
+  while (reader.readLine(stream, output, output_size)) lines.push_back(output);
+  return lines;
+}
+
+static const std::string COMMANDS = "A100B200C300D400E500\nF123.4G0.5H1\nJ7\n";
+static const std::vector<std::string> EXPECTED = {"A100B200C300D400E500", "F123.4G0.5H1", "J7"};
+
+// Split in two at every point, then in three, each part read on its own loop.
+static void testSplits() {
+  int mismatches = 0;
+  for (size_t first = 0; first <= COMMANDS.size(); first++) {
+    for (size_t second = first; second <= COMMANDS.size(); second++) {
+      Stream stream;
+      LineReader reader;
+      std::vector<std::string> lines;
+      for (const std::string& part : {COMMANDS.substr(0, first), COMMANDS.substr(first, second - first),
+                                      COMMANDS.substr(second)}) {
+        stream.feed(part);
+        for (const std::string& line : readAll(reader, stream)) lines.push_back(line);
+      }
+      if (lines != EXPECTED) mismatches++;
+    }
+  }
+  CHECK_EQUAL(mismatches, 0);
+
+  // A byte a loop.
+  Stream stream;
+  LineReader reader;
+  std::vector<std::string> lines;
+  for (char c : COMMANDS) {
+    stream.feed(&c, 1);
+    for (const std::string& line : readAll(reader, stream)) lines.push_back(line);
+  }
+  CHECK(lines == EXPECTED);
+}
+
+// A line that doesn't fit is dropped whole, the next one is still read.
+static void testOverlong() {
+  Stream stream;
+  LineReader reader;
+  const std::string longest(RECEIVE_BUFFER_SIZE - 1, '1');
+  const std::string overlong(RECEIVE_BUFFER_SIZE, '2');
+  stream.feed(longest + "\n" + overlong + "\n" + "A1\n" + std::string(3 * RECEIVE_BUFFER_SIZE, '3') + "\nB2\n");
+  const std::vector<std::string> lines = readAll(reader, stream);
+  CHECK_EQUAL(lines.size(), static_cast<size_t>(3));
+  if (lines.size() == 3) {
+    CHECK_EQUAL(lines[0], longest);
+    CHECK_EQUAL(lines[1], std::string("A1"));
+    CHECK_EQUAL(lines[2], std::string("B2"));
+  }
+
+  // Or too long for the output it is read into.
+  stream.feed("A1000B1000\nC1\n");
+  const std::vector<std::string> short_lines = readAll(reader, stream, 6);
+  CHECK(short_lines == std::vector<std::string>({"C1"}));
+}
+
+// CR LF ends a line like LF, and blank lines are skipped.
+static void testLineEndings() {
+  Stream stream;
+  LineReader reader;
+  stream.feed("A100\r\n\r\n\nB200\r");
+  CHECK(readAll(reader, stream) == std::vector<std::string>({"A100"}));
+  stream.feed("\nC3\rD4\n");
+  CHECK(readAll(reader, stream) == std::vector<std::string>({"B200", "C3\rD4"}));
+}
+
+// A client that drops mid command, the next one's first command is whole.
+static void testNewClient() {
+  WIFISerialCommunication comm;
+  comm.start();
+  char input[RECEIVE_BUFFER_SIZE];
+
+  WiFiClient first = hal::connectClient();
+  CHECK(comm.isOpen());
+  first.stream()->feed("A100B2");
+  CHECK(comm.hasData());
+  CHECK(!comm.readData(input, sizeof(input)));
+  first.stop();
+  CHECK(!comm.isOpen());
+
+  WiFiClient second = hal::connectClient();
+  CHECK(comm.isOpen());
+  second.stream()->feed("C300\n");
+  CHECK(comm.readData(input, sizeof(input)));
+  CHECK_EQUAL(std::string(input), std::string("C300"));
+}
+
+int main() {
+  testSplits();
+  testOverlong();
+  testLineEndings();
+  testNewClient();
+  return host_test::result();
+}
@@ -0,0 +1,114 @@
+// Runs the loop scheduler on a mock clock: holding the period, catching up
+// after a late loop, skipping after a very late one, and a period of 0.
+
+#include "Arduino.h"
+
+#include "LoopScheduler.hpp"
+
+#include "HostTest.h"
+
+#include <vector>
+
+// Only moves when the scheduler sleeps or the test does some work.
+struct MockClock {
+  static inline unsigned long time = 0;
+  static inline unsigned long sleeps = 0;
+
+  static unsigned long now() {
+    return time;
+  }
+
+  static void sleep(unsigned long duration) {
+    time += duration;
+    sleeps++;
+  }
+};
+
+static const unsigned long PERIOD = 4000;
+
+// Run loops that take the given times, returns when each loop started.
+static std::vector<unsigned long> run(LoopScheduler<MockClock>& scheduler, const std::vector<unsigned long>& work) {
+  std::vector<unsigned long> starts;
+  for (unsigned long duration : work) {
+    starts.push_back(MockClock::time);
+    MockClock::time += duration;
+    scheduler.wait();
+  }
+  return starts;
+}
+
+// However long the loop takes within its period, it starts on the period.
+static void testPeriodHold() {
+  MockClock::time = 1000;
+  LoopScheduler<MockClock> scheduler(PERIOD);
+  scheduler.start();
+  const std::vector<unsigned long> starts = run(scheduler, {0, 100, 3999, 2500, 1, 3000});
+  for (size_t i = 0; i < starts.size(); i++) {
+    CHECK_EQUAL(starts[i], 1000 + i * PERIOD);
+  }
+
+  const LoopStats& stats = scheduler.getStats();
+  CHECK_EQUAL(stats.loops, 6ul);
+  CHECK_EQUAL(stats.overruns, 0ul);
+  CHECK_EQUAL(stats.min_period, PERIOD);
+  CHECK_EQUAL(stats.max_period, PERIOD);
+  CHECK_EQUAL(stats.meanPeriod(), PERIOD);
+}
+
+// A loop late by less than a period is caught up, the next one starts
+// right away and the one after that is back on the schedule.
+static void testCatchUp() {
+  MockClock::time = 0;
+  LoopScheduler<MockClock> scheduler(PERIOD);
+  scheduler.start();
+  const std::vector<unsigned long> starts = run(scheduler, {1000, 6000, 500, 1000, 1000});
+  CHECK(starts == std::vector<unsigned long>({0, 4000, 10000, 12000, 16000}));
+
+  const LoopStats& stats = scheduler.getStats();
+  CHECK_EQUAL(stats.overruns, 1ul);
+  CHECK_EQUAL(stats.max_period, 6000ul);
+  CHECK_EQUAL(stats.min_period, 2000ul);
+  CHECK_EQUAL(stats.meanPeriod(), PERIOD);
+}
+
+// A loop late by a period or more skips the missed loops, and the
+// schedule starts again from when it ended.
+static void testSkip() {
+  MockClock::time = 0;
+  LoopScheduler<MockClock> scheduler(PERIOD);
+  scheduler.start();
+  const std::vector<unsigned long> starts = run(scheduler, {1000, 9000, 1000, 1000});
+  CHECK(starts == std::vector<unsigned long>({0, 4000, 13000, 17000}));
+  CHECK_EQUAL(scheduler.getStats().overruns, 1ul);
+  CHECK_EQUAL(scheduler.getStats().max_period, 9000ul);
+
+  scheduler.resetStats();
+  CHECK_EQUAL(scheduler.getStats().loops, 0ul);
+  run(scheduler, {1000});
+  CHECK_EQUAL(scheduler.getStats().min_period, PERIOD);
+}
+
+// With LOOP_TIME 0 the loop runs as fast as it can, it never waits and
+// is never late.
+static void testNoPeriod() {
+  MockClock::time = 0;
+  MockClock::sleeps = 0;
+  LoopScheduler<MockClock> scheduler(0);
+  const std::vector<unsigned long> starts = run(scheduler, {300, 100, 5000, 0});
+  CHECK(starts == std::vector<unsigned long>({0, 300, 400, 5400}));
+  CHECK_EQUAL(MockClock::sleeps, 0ul);
+
+  const LoopStats& stats = scheduler.getStats();
+  CHECK_EQUAL(stats.loops, 4ul);
+  CHECK_EQUAL(stats.overruns, 0ul);
+  CHECK_EQUAL(stats.min_period, 0ul);
+  CHECK_EQUAL(stats.max_period, 5000ul);
+}
+
+int main() {
+  testPeriodHold();
+  testCatchUp();
+  testSkip();
+  testNoPeriod();
+  return host_test::result();
+}
@@ -0,0 +1,98 @@
+// Checks the median filter against sorting the window, like RunningMedian
+// did, and compares the time each takes for a new value and its median.
+
+#include "Arduino.h"
+
+#include "MedianFilter.hpp"
+
+#include "HostTest.h"
+
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+// Sorts a copy of the window for every median.
+template<typename T>
+class SortedMedian {
+ public:
+  SortedMedian(size_t size) : size(size) {}
+
+  void add(T value) {
+    window.push_back(value);
+    if (window.size() > size) window.pop_front();
+  }
+
+  T getMedian() const {
+    std::vector<T> sorted(window.begin(), window.end());
+    std::sort(sorted.begin(), sorted.end());
+    const size_t middle = sorted.size() / 2;
+    return sorted.size() % 2 == 0 ? (sorted[middle - 1] + sorted[middle]) / 2 : sorted[middle];
+  }
+
+ private:
+  size_t size;
+  std::deque<T> window;
+};
+
+// Values with long rises and falls, repeats and jumps.
+static int nextValue(uint32_t& state, int i) {
+  state = state * 1664525u + 1013904223u;
+  switch ((i / 200) % 4) {
+    case 0: return state >> 22;
+    case 1: return i % 200;
+    case 2: return 200 - i % 200;
+    default: return (state >> 30) * 300;
+  }
+}
+
+template<uint8_t N>
+static void checkAgainstSort() {
+  MedianFilter<int, N> filter;
+  SortedMedian<int> reference(N);
+  uint32_t state = N;
+  for (int i = 0; i < 2000; i++) {
+    const int value = nextValue(state, i);
+    filter.add(value);
+    reference.add(value);
+    if (!CHECK_EQUAL(filter.getMedian(), reference.getMedian())) {
+      fprintf(stderr, "window %d, value %d\n", N, i);
+      return;
+    }
+  }
+}
+
+template<uint8_t N>
+static void benchmark() {
+  const unsigned long repeats = 200000;
+  uint32_t state = 1;
+  int i = 0;
+  int sink = 0;
+
+  MedianFilter<int, N> filter;
+  const double filter_time = host_test::timeCall([&]() {
+    filter.add(nextValue(state, i++));
+    sink += filter.getMedian();
+  }, repeats);
+
+  SortedMedian<int> reference(N);
+  const double sort_time = host_test::timeCall([&]() {
+    reference.add(nextValue(state, i++));
+    sink += reference.getMedian();
+  }, repeats / 10);
+
+  printf("window %3d: %6.1f ns heaps, %7.1f ns sorting (%d)\n", N, filter_time, sort_time, sink & 1);
+}
+
+int main() {
+  checkAgainstSort<1>();
+  checkAgainstSort<2>();
+  checkAgainstSort<5>();
+  checkAgainstSort<20>();
+  checkAgainstSort<64>();
+  checkAgainstSort<127>();
+
+  benchmark<5>();
+  benchmark<20>();
+  benchmark<64>();
+  return host_test::result();
+}
@@ -0,0 +1,105 @@
+// Drives the servo force feedback with its motion profile and checks the
+// pulses stay in the servo's range when the limit turns around near an
+// end of travel, or asks for more than the servo has.
+
+#include "Arduino.h"
+
+#include "ForceFeedback.hpp"
+
+#include "HostTest.h"
+
+#include <algorithm>
+
+static_assert(ENABLE_FORCE_FEEDBACK_MOTION, "The test needs the motion profile");
+
+static const int SERVO_PIN = 17;
+static const unsigned long STEP_TIME = 1000000UL / FORCE_FEEDBACK_MOTION_RATE;
+static const int LOWEST = (SERVO_MAX) > (SERVO_MIN) ? (SERVO_MIN) : (SERVO_MAX);
+static const int HIGHEST = (SERVO_MAX) > (SERVO_MIN) ? (SERVO_MAX) : (SERVO_MIN);
+
+struct Travel {
+  int lowest;
+  int highest;
+};
+
+// Loop with the limit until the time, keeping the furthest pulses.
+static void runUntil(ServoForceFeedback& servo, unsigned long end, Travel& travel) {
+  while (micros() < end) {
+    hal::advance(LOOP_TIME * 1000UL);
+    servo.updateOutput();
+    const int pulse = hal::servo_pulses[SERVO_PIN];
+    if (pulse < travel.lowest) travel.lowest = pulse;
+    if (pulse > travel.highest) travel.highest = pulse;
+  }
+}
+
+// Full travel toward one end, turning around after the time.
+static Travel turnAround(int from, int to, unsigned long turn_time) {
+  ServoForceFeedback servo(DecodedOuput::Type::FFB_INDEX, nullptr, SERVO_PIN, false);
+  servo.decodeValue(DecodedOuput::Type::FFB_INDEX, from);
+  servo.setupOutput();
+  Travel travel = {HIGHEST, LOWEST};
+  runUntil(servo, micros() + 1000000, travel);
+
+  servo.decodeValue(DecodedOuput::Type::FFB_INDEX, to);
+  runUntil(servo, micros() + turn_time, travel);
+  servo.decodeValue(DecodedOuput::Type::FFB_INDEX, from);
+  runUntil(servo, micros() + 1000000, travel);
+  return travel;
+}
+
+// Turning around at any point of a move to the end, and to past it.
+static void testTurnAround() {
+  for (int to : {FORCE_FEEDBACK_MAX, FORCE_FEEDBACK_MAX * 2}) {
+    Travel furthest = {HIGHEST, LOWEST};
+    for (unsigned long turn_time = 0; turn_time < 1000000; turn_time += STEP_TIME) {
+      const Travel travel = turnAround(FORCE_FEEDBACK_MIN, to, turn_time);
+      furthest.highest = std::max(furthest.highest, travel.highest);
+      const Travel back = turnAround(to, FORCE_FEEDBACK_MIN - FORCE_FEEDBACK_MAX, turn_time);
+      furthest.lowest = std::min(furthest.lowest, back.lowest);
+    }
+    printf("limits up to %d: pulses %d to %d (servo %d to %d)\n", to, furthest.lowest, furthest.highest, LOWEST, HIGHEST);
+    CHECK_EQUAL(furthest.lowest, LOWEST);
+    CHECK_EQUAL(furthest.highest, HIGHEST);
+  }
+}
+
+// The profile on its own, with room past the end of travel, runs on past
+// the end before it turns around. The clamp is what holds it in.
+static void testUnbounded() {
+  MotionProfile bounded(FORCE_FEEDBACK_MAX_SPEED * (HIGHEST - LOWEST) / 100,
+                        FORCE_FEEDBACK_MAX_ACCELERATION * (HIGHEST - LOWEST) / 100, STEP_TIME, LOWEST, HIGHEST);
+  MotionProfile unbounded(FORCE_FEEDBACK_MAX_SPEED * (HIGHEST - LOWEST) / 100,
+                          FORCE_FEEDBACK_MAX_ACCELERATION * (HIGHEST - LOWEST) / 100, STEP_TIME, 0, HIGHEST * 2);
+  unsigned long now = 0;
+  bounded.reset(LOWEST, now);
+  unbounded.reset(LOWEST, now);
+  bounded.setTarget(HIGHEST * 2);
+  unbounded.setTarget(HIGHEST * 2);
+  while (unbounded.output() < HIGHEST - 50) {
+    now += STEP_TIME;
+    bounded.update(now);
+    unbounded.update(now);
+  }
+
+  bounded.setTarget(LOWEST);
+  unbounded.setTarget(LOWEST);
+  int bounded_highest = bounded.output();
+  int unbounded_highest = unbounded.output();
+  for (int step = 0; step < 1000; step++) {
+    now += STEP_TIME;
+    bounded_highest = std::max(bounded_highest, bounded.update(now));
+    unbounded_highest = std::max(unbounded_highest, unbounded.update(now));
+  }
+  printf("turning around at full speed near %d: %d without the clamp, %d with it\n",
+         HIGHEST, unbounded_highest, bounded_highest);
+  CHECK(unbounded_highest > HIGHEST);
+  CHECK_EQUAL(bounded_highest, HIGHEST);
+  CHECK_EQUAL(bounded.output(), LOWEST);
+}
+
+int main() {
+  testTurnAround();
+  testUnbounded();
+  return host_test::result();
+}
@@ -0,0 +1,95 @@
+// Checks the background oversampling on the ESP32 against noisy readings,
+// and reports the noise it removes against what the loop pays for it.
+
+#include "Arduino.h"
+
+#include "AnalogSampler.hpp"
+
+#include "HostTest.h"
+
+static_assert(OVERSAMPLING_COUNT > 1, "The test needs the oversampling task");
+
+static const int PINS[] = {32, 33, 34};
+static const int CHANNELS = sizeof(PINS) / sizeof(PINS[0]);
+
+// Sample every millisecond until the first channel reads the value, or
+// 10ms have passed. The task scans every tick.
+static bool waitFor(AnalogSampler& sampler, int oversampled) {
+  for (int ms = 0; ms < 10; ms++) {
+    sampler.sample();
+    if (sampler.readOversampled(0) == oversampled) return true;
+    hal::advance(1000);
+  }
+  return false;
+}
+
+// Root mean square distance of the values from the expected one.
+template<typename Read>
+static double noise(Read read, int count, double expected) {
+  double total = 0;
+  for (int i = 0; i < count; i++) {
+    const double error = read() - expected;
+    total += error * error;
+  }
+  return sqrt(total / count);
+}
+
+static void testDecimation(AnalogSampler& sampler) {
+  hal::analog_noise = 0;
+  hal::setAnalog(PINS[0], 1000);
+  hal::setAnalog(PINS[1], ANALOG_MAX);
+  hal::setAnalog(PINS[2], 0);
+  CHECK(waitFor(sampler, 1000 << OVERSAMPLING_EXTRA_BITS));
+  CHECK_EQUAL(sampler.read(0), 1000);
+  CHECK_EQUAL(sampler.readOversampled(1), static_cast<int>(OVERSAMPLED_MAX));
+  CHECK_EQUAL(sampler.read(1), ANALOG_MAX);
+  CHECK_EQUAL(sampler.readOversampled(2), 0);
+}
+
+static void testNoise(AnalogSampler& sampler) {
+  const int level = 2000;
+  hal::analog_noise = 200;
+  for (int pin : PINS) hal::setAnalog(pin, level);
+
+  const double raw = noise([]() { return analogRead(PINS[0]); }, 1000, level);
+  const double oversampled = noise([&]() {
+    // Give the task time for a new set of scans.
+    hal::advance(2000);
+    sampler.sample();
+    return sampler.readOversampled(0) / static_cast<double>(1 << OVERSAMPLING_EXTRA_BITS);
+  }, 200, level);
+
+  const double gain = 20 * log10(raw / oversampled);
+  printf("%d readings per value: noise %.1f -> %.1f, SNR up %.1f dB (%.1f dB expected)\n",
+         OVERSAMPLING_COUNT, raw, oversampled, gain, 10 * log10(OVERSAMPLING_COUNT));
+  // Somewhat less than the square root of the count, some values repeat.
+  CHECK(gain > 0.75 * 10 * log10(OVERSAMPLING_COUNT));
+}
+
+// What the loop pays: taking the newest sums against reading them back
+// to back, on the host.
+static void benchmark(AnalogSampler& sampler) {
+  hal::analog_noise = 0;
+  const double background = host_test::timeCall([&]() { sampler.sample(); }, 100000);
+  volatile unsigned long sink = 0;
+  const double back_to_back = host_test::timeCall([&]() {
+    for (int n = 0; n < OVERSAMPLING_COUNT; n++) {
+      for (int pin : PINS) sink = sink + analogRead(pin);
+    }
+  }, 100000);
+  printf("loop cost for %d channels: %.1f ns with the task, %.1f ns for %d readings back to back\n",
+         CHANNELS, background, back_to_back, OVERSAMPLING_COUNT * CHANNELS);
+}
+
+int main() {
+  AnalogSampler sampler;
+  for (int pin : PINS) sampler.addChannel(pin);
+  sampler.begin();
+
+  testDecimation(sampler);
+  testNoise(sampler);
+  benchmark(sampler);
+
+  hal::stopTasks();
+  return host_test::result();
+}
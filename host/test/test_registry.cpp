@@ -0,0 +1,77 @@
+// Compares the compile time registry with the pointer array the loop used
+// before it: the same inputs read and encoded through the vtable, which is
+// what setup() used to collect with register. The frames have to match and
+// the buffer size the registry computes has to cover what the inputs
+// report.
+
+#include "Arduino.h"
+
+#include "open-gloves.ino"
+
+#include "HostTest.h"
+#include "Signals.h"
+
+static EncodedInput* inputs[BUTTON_COUNT + FINGER_COUNT + JOYSTICK_COUNT + 1];
+static int input_count = 0;
+
+// Collects the inputs like register did.
+struct RegisterInput {
+  void operator()(EncodedInput& input) const {
+    inputs[input_count++] = &input;
+  }
+};
+
+static int encodeVirtual(char* output) {
+  int offset = 0;
+  for (int i = 0; i < input_count; i++) offset += inputs[i]->encode(output + offset);
+  output[offset++] = '\n';
+  output[offset] = '\0';
+  return offset;
+}
+
+static void readVirtual() {
+  for (int i = 0; i < input_count; i++) inputs[i]->readInput();
+}
+
+static void testEncodedSize() {
+  int size = 0;
+  for (int i = 0; i < input_count; i++) size += inputs[i]->getEncodedSize();
+  CHECK_EQUAL(InputRegistry::ENCODED_SIZE, size);
+}
+
+static void testSameFrames() {
+  char registry[ENCODED_OUTPUT_SIZE];
+  char pointers[ENCODED_OUTPUT_SIZE];
+  int mismatches = 0;
+  for (unsigned long i = 0; i < 500; i++) {
+    signals::drive(i);
+    InputRegistry::forEach(ReadInput());
+    encodeAll<InputRegistry>(registry);
+    encodeVirtual(pointers);
+    if (strcmp(registry, pointers) != 0) mismatches++;
+    hal::advance(LOOP_TIME * 1000ul);
+  }
+  CHECK_EQUAL(mismatches, 0);
+}
+
+static void benchmark() {
+  char output[ENCODED_OUTPUT_SIZE];
+  const unsigned long repeats = 200000;
+  const double registry_read = host_test::timeCall([]() { InputRegistry::forEach(ReadInput()); }, repeats);
+  const double pointers_read = host_test::timeCall([]() { readVirtual(); }, repeats);
+  const double registry_encode = host_test::timeCall([&]() { encodeAll<InputRegistry>(output); }, repeats);
+  const double pointers_encode = host_test::timeCall([&]() { encodeVirtual(output); }, repeats);
+  printf("%d inputs, read: %.0f ns through the vtable, %.0f ns from the registry\n", input_count, pointers_read,
+         registry_read);
+  printf("%d inputs, encode: %.0f ns through the vtable, %.0f ns from the registry\n", input_count, pointers_encode,
+         registry_encode);
+}
+
+int main() {
+  setup();
+  InputRegistry::forEach(RegisterInput());
+  testEncodedSize();
+  testSameFrames();
+  benchmark();
+  return host_test::result();
+}
@@ -0,0 +1,69 @@
+// Replays the grip trace through the sketch's analog sampler, and compares
+// what sampling costs the loop with each input doing its own analogRead,
+// as they did before the sampler.
+
+#include "Arduino.h"
+
+#include "open-gloves.ino"
+
+#include "HostTest.h"
+
+// Every channel is sampled from the trace as the clock reaches each row.
+static void testReplay() {
+  std::string error;
+  if (!CHECK(hal::loadTrace("traces/grip_esp32.csv", error))) return;
+  analog_sampler.begin();
+
+  int mismatches = 0;
+  int loops = 0;
+  for (; !hal::traceFinished(); loops++) {
+    analog_sampler.sample();
+    for (uint8_t i = 0; i < analog_sampler.channelCount(); i++) {
+      const int expected = analogRead(analog_sampler.pin(i));
+      // The background scans are at most a tick behind.
+      if (OVERSAMPLING_COUNT > 1 ? abs(analog_sampler.read(i) - expected) > 200 : analog_sampler.read(i) != expected) {
+        mismatches++;
+      }
+    }
+    hal::advance(LOOP_TIME * 1000ul);
+  }
+  printf("%d loops of the trace, %d samples off\n", loops, mismatches);
+  CHECK_EQUAL(mismatches, 0);
+}
+
+static void benchmark() {
+  const uint8_t channels = analog_sampler.channelCount();
+  const unsigned long repeats = 100000;
+  volatile long sink = 0;
+
+  hal::analog_reads = 0;
+  const double before = host_test::timeCall([&]() {
+    for (uint8_t i = 0; i < channels; i++) sink = sink + analogRead(analog_sampler.pin(i));
+  }, repeats);
+  const double before_reads = hal::analog_reads / static_cast<double>(repeats);
+
+  hal::analog_reads = 0;
+  const double after = host_test::timeCall([&]() {
+    analog_sampler.sample();
+    for (uint8_t i = 0; i < channels; i++) sink = sink + analog_sampler.read(i);
+  }, repeats);
+  const double after_reads = hal::analog_reads / static_cast<double>(repeats);
+
+  printf("%d channels: analogRead in each input %.0f ns, %.0f conversions per loop; "
+         "the sampler at %d readings a value %.0f ns, %.0f conversions on the loop\n",
+         channels, before, before_reads, OVERSAMPLING_COUNT, after, after_reads);
+  #if defined(OVERSAMPLING_TASK)
+    // The background scans take the conversions off the loop.
+    CHECK_EQUAL(after_reads, 0.0);
+  #else
+    CHECK_EQUAL(after_reads, static_cast<double>(channels * OVERSAMPLING_COUNT));
+  #endif
+}
+
+int main() {
+  InputRegistry::forEach(SetupInput());
+  testReplay();
+  benchmark();
+  hal::stopTasks();
+  return host_test::result();
+}
@@ -0,0 +1,138 @@
+// Runs the send rate controller against simulated links with a set
+// bandwidth and jitter, and compares the wait of each frame with sending
+// every loop.
+
+#include "Arduino.h"
+
+#include "SendRateController.hpp"
+
+#include "HostTest.h"
+
+// A link that drains at a bandwidth that varies by up to the jitter. A
+// queueing link buffers what it can't send yet, a blocking link makes the
+// output call wait until the frame is out.
+class SimulatedLink {
+ public:
+  SimulatedLink(unsigned long bandwidth, int jitter_percent, bool blocking) :
+    bandwidth(bandwidth), jitter_percent(jitter_percent), blocking(blocking),
+    queued(0), last_advance(0), noise(1) {}
+
+  void advance(unsigned long now) {
+    queued -= (now - last_advance) * rate() / 1000000.0;
+    if (queued < 0) queued = 0;
+    last_advance = now;
+  }
+
+  // Send a frame at the time, returns when the output call returns.
+  unsigned long output(size_t length, unsigned long now) {
+    advance(now);
+    queued += length;
+    if (!blocking) return now;
+
+    const unsigned long end = now + static_cast<unsigned long>(queued * 1000000.0 / rate());
+    queued = 0;
+    last_advance = end;
+    return end;
+  }
+
+  // Time before a frame sent now would start going out (us).
+  unsigned long wait() const {
+    return static_cast<unsigned long>(queued * 1000000.0 / bandwidth);
+  }
+
+  size_t pendingBytes() const {
+    return static_cast<size_t>(queued);
+  }
+
+ private:
+  double rate() {
+    noise = noise * 1664525u + 1013904223u;
+    const int percent = static_cast<int>(noise >> 16) % (2 * jitter_percent + 1) - jitter_percent;
+    return bandwidth * (100 + percent) / 100.0;
+  }
+
+  unsigned long bandwidth;
+  int jitter_percent;
+  bool blocking;
+  double queued;
+  unsigned long last_advance;
+  uint32_t noise;
+};
+
+struct RunResult {
+  double frames_per_second;
+  double mean_wait_ms;
+  unsigned long max_wait_ms;
+};
+
+// Loops for a few seconds with frames of the length, with the controller
+// or sending every loop. The wait is measured over the last second, once
+// the controller has settled.
+static RunResult run(const SimulatedLink& start, size_t length, bool adaptive) {
+  SimulatedLink link = start;
+  const unsigned long loop_time = LOOP_TIME * 1000UL;
+  const unsigned long duration = 5000000;
+  const unsigned long settled = duration - 1000000;
+  SendRateController controller(loop_time, SEND_RATE_MAX_INTERVAL * 1000UL, SEND_RATE_TARGET_LATENCY * 1000UL);
+
+  RunResult result = {0, 0, 0};
+  unsigned long frames = 0;
+  double total_wait = 0;
+  for (unsigned long now = loop_time; now < duration;) {
+    unsigned long next = now + loop_time;
+    if (!adaptive || controller.shouldSend(now)) {
+      link.advance(now);
+      const unsigned long queued_wait = link.wait();
+      const unsigned long end = link.output(length, now);
+      const unsigned long wait = queued_wait + (end - now);
+      controller.update(now, end, length, link.pendingBytes(), true);
+      if (end > next) next = end;
+
+      if (now >= settled) {
+        frames++;
+        total_wait += wait;
+        if (wait / 1000 > result.max_wait_ms) result.max_wait_ms = wait / 1000;
+      }
+    }
+    now = next;
+  }
+
+  result.frames_per_second = frames * 1000000.0 / (duration - settled);
+  result.mean_wait_ms = frames > 0 ? total_wait / frames / 1000 : 0;
+  return result;
+}
+
+static void compare(const char* name, const SimulatedLink& link, size_t length,
+                    RunResult& fixed, RunResult& adaptive) {
+  fixed = run(link, length, false);
+  adaptive = run(link, length, true);
+  printf("%s: every loop %.0f fps, %.1f ms mean wait (%lu ms max); adaptive %.0f fps, %.1f ms mean wait (%lu ms max)\n",
+         name, fixed.frames_per_second, fixed.mean_wait_ms, fixed.max_wait_ms,
+         adaptive.frames_per_second, adaptive.mean_wait_ms, adaptive.max_wait_ms);
+}
+
+int main() {
+  const size_t length = 37;
+  const double target = SEND_RATE_TARGET_LATENCY;
+  RunResult fixed, adaptive;
+
+  // A USB serial link keeps up with every loop, the rate stays at full.
+  compare("usb 115200 baud", SimulatedLink(11520, 0, false), length, fixed, adaptive);
+  CHECK(adaptive.frames_per_second > 0.95 * fixed.frames_per_second);
+  CHECK(adaptive.mean_wait_ms < 1);
+
+  // A congested Bluetooth link queues frames, sending every loop only
+  // grows the queue.
+  compare("bluetooth 3000 B/s, 30% jitter", SimulatedLink(3000, 30, false), length, fixed, adaptive);
+  CHECK(fixed.mean_wait_ms > 10 * target);
+  CHECK(adaptive.mean_wait_ms < 2 * target);
+  CHECK(adaptive.frames_per_second > 0.5 * 3000 / length);
+
+  // A WiFi client whose writes block, the loop stalls while a frame goes
+  // out. It doesn't queue, so the rate stays as high as it allows.
+  compare("blocking 10000 B/s, 30% jitter", SimulatedLink(10000, 30, true), length, fixed, adaptive);
+  CHECK(adaptive.mean_wait_ms < target);
+  CHECK(adaptive.frames_per_second > 0.95 * fixed.frames_per_second);
+
+  return host_test::result();
+}
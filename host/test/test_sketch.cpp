@@ -0,0 +1,35 @@
+// Runs the whole sketch through a scripted session and compares what it
+// sends with the golden file for the build.
+
+#include "Arduino.h"
+
+#include "open-gloves.ino"
+
+#include "HostTest.h"
+#include "Signals.h"
+
+int main() {
+  const unsigned long start = micros();
+  setup();
+
+  const int loops = 100;
+  for (int i = 0; i < loops; i++) {
+    signals::drive(i);
+    loop();
+  }
+
+  const std::string output = Serial.takeOutput();
+  CHECK_GOLDEN(TEST_NAME, host_test::escape(output, ENCODING_DELIMITER));
+
+  // One frame a loop. When recording, a record of the readings every loop
+  // and one for each edge of the A button. The loop kept its rate.
+  size_t messages = 0;
+  for (char c : output) messages += c == ENCODING_DELIMITER;
+  CHECK_EQUAL(messages, static_cast<size_t>(loops + (ENABLE_RECORDING ? loops + 2 : 0)));
+  CHECK_EQUAL(scheduler.getStats().loops, static_cast<unsigned long>(loops));
+  CHECK_EQUAL(scheduler.getStats().overruns, 0ul);
+  CHECK_EQUAL(micros() - start, loops * LOOP_TIME * 1000ul);
+  CHECK_EQUAL(hal::outputLevel(PIN_LED), HIGH);
+
+  return host_test::result();
+}
@@ -0,0 +1,65 @@
+// Checks that telemetry taking the place of a delta frame that was never
+// sent makes the next frame a keyframe, so the driver doesn't miss the
+// changes in it.
+
+#include "Arduino.h"
+
+#include "open-gloves.ino"
+
+#include "HostTest.h"
+#include "Signals.h"
+
+static_assert(ENABLE_PROFILING && ENCODING == ENCODING_BINARY && ENABLE_DELTA_ENCODING,
+              "The test needs telemetry and delta frames");
+
+// The messages sent, decoded.
+static std::vector<std::string> takeMessages() {
+  const std::string output = Serial.takeOutput();
+  std::vector<std::string> messages;
+  size_t start = 0;
+  for (size_t end = output.find('\0'); end != std::string::npos; end = output.find('\0', start)) {
+    uint8_t message[TELEMETRY_MAX_SIZE + BINARY_FRAME_MAX_SIZE];
+    const size_t size = cobsDecode(reinterpret_cast<const uint8_t*>(output.data() + start), end - start, message);
+    messages.emplace_back(reinterpret_cast<const char*>(message), size);
+    start = end + 1;
+  }
+  return messages;
+}
+
+// Ask for the telemetry, in a binary command.
+static void requestTelemetry() {
+  const uint16_t mask = 1u << (DecodedOuput::Type::TELEMETRY - 'A');
+  const uint8_t command[] = {mask >> 8, mask & 0xFF, 0x00, 0x01};
+  uint8_t framed[BINARY_COMMAND_MAX_SIZE + BINARY_COMMAND_MAX_SIZE / 254 + 2];
+  const size_t size = cobsEncode(command, sizeof(command), framed);
+  Serial.feed(reinterpret_cast<const char*>(framed), size);
+  Serial.feed(std::string(1, '\0'));
+}
+
+static bool isKeyframe(const std::string& frame) {
+  return frame.size() >= 2 && (static_cast<uint8_t>(frame[0]) & (BinaryFrame::KEYFRAME_FLAG >> 8));
+}
+
+int main() {
+  signals::drive(0);
+  setup();
+  for (int i = 0; i < CALIBRATION_LOOPS + 10; i++) loop();
+  takeMessages();
+
+  // The link stops taking bytes. The first frame waits to be written, the
+  // next one waits behind it and is then replaced by the telemetry.
+  Serial.setWriteRoom(0);
+  loop();
+  requestTelemetry();
+  loop();
+
+  Serial.setWriteRoom(128);
+  loop();
+  const std::vector<std::string> messages = takeMessages();
+  if (CHECK_EQUAL(messages.size(), static_cast<size_t>(3))) {
+    CHECK(!isKeyframe(messages[0]));
+    CHECK_EQUAL(messages[1][0], '~');
+    CHECK(isKeyframe(messages[2]));
+  }
+  return host_test::result();
+}
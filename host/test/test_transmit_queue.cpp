@@ -0,0 +1,157 @@
+// Checks the latest-wins transmit queue against a sink that takes bytes
+// at the rate of a serial link, and the Bluetooth transport holding its
+// output while the link is congested.
+
+#include "Arduino.h"
+
+#include "ICommunication.hpp"
+#include "SerialBTCommunication.hpp"
+
+#include "HostTest.h"
+
+// Takes bytes at a fixed rate, with a small buffer like a UART.
+class SlowSink {
+ public:
+  SlowSink(unsigned long baud, int buffer_size) :
+    us_per_byte(10 * 1000000.0 / baud), buffer_size(buffer_size), buffered(0), drained_until(0) {}
+
+  // Drain the buffer up to the time.
+  void advance(unsigned long now) {
+    while (buffered > 0 && drained_until + us_per_byte <= now) {
+      drained_until += us_per_byte;
+      buffered--;
+    }
+    if (buffered == 0) drained_until = now;
+  }
+
+  int availableForWrite() {
+    return buffer_size - buffered;
+  }
+
+  size_t write(const char* data, size_t length) {
+    if (length > static_cast<size_t>(availableForWrite())) length = availableForWrite();
+    buffered += length;
+    received.append(data, length);
+    return length;
+  }
+
+  std::string received;
+
+ private:
+  double us_per_byte;
+  int buffer_size;
+  int buffered;
+  double drained_until;
+};
+
+static std::string message(char fill, size_t length) {
+  return std::string(length - 1, fill) + '\n';
+}
+
+static bool send(TransmitQueue& queue, SlowSink& sink, const std::string& data) {
+  return queue.send(sink, data.data(), data.size());
+}
+
+static void testSupersede() {
+  TransmitQueue queue;
+  SlowSink sink(115200, 16);
+
+  // The first message starts going out, the second waits behind it and
+  // the third replaces it.
+  const std::string first = message('a', 40);
+  CHECK(send(queue, sink, first));
+  CHECK_EQUAL(sink.received.size(), 16u);
+  CHECK(send(queue, sink, message('b', 40)));
+  CHECK(!send(queue, sink, message('c', 40)));
+  CHECK_EQUAL(queue.supersededCount(), 1ul);
+  CHECK_EQUAL(queue.pendingBytes(), 24u + 40u);
+
+  // Too long to queue, the waiting message stays.
+  CHECK(!send(queue, sink, message('d', TRANSMIT_BUFFER_SIZE + 1)));
+  CHECK_EQUAL(queue.droppedCount(), 1ul);
+
+  // The first message is finished before the newest one starts.
+  for (unsigned long now = 0; queue.pendingBytes() > 0; now += 100) {
+    sink.advance(now);
+    queue.service(sink);
+  }
+  CHECK(sink.received == first + message('c', 40));
+}
+
+// A frame every loop on a link too slow for all of them. Sending never
+// waits, and every frame that arrives is whole and the newest one at the
+// time it started.
+static void testSlowLink() {
+  const unsigned long loop_time = 4000;
+  const size_t frame_size = 60;
+  TransmitQueue queue;
+  SlowSink sink(115200, 64);
+
+  int sent = 0;
+  unsigned long now = 0;
+  for (; now < 2000000; now += loop_time) {
+    sink.advance(now);
+    queue.service(sink);
+
+    char frame[frame_size];
+    snprintf(frame, sizeof(frame), "%06d", sent++);
+    memset(frame + 6, '.', frame_size - 7);
+    frame[frame_size - 1] = '\n';
+    queue.send(sink, frame, frame_size);
+    CHECK(queue.pendingBytes() <= 2 * frame_size);
+  }
+  for (; queue.pendingBytes() > 0; now += loop_time) {
+    sink.advance(now);
+    queue.service(sink);
+  }
+
+  int delivered = 0;
+  int last = -1;
+  size_t start = 0;
+  for (size_t end = sink.received.find('\n'); end != std::string::npos; end = sink.received.find('\n', start)) {
+    CHECK_EQUAL(end - start, frame_size - 1);
+    const int number = atoi(sink.received.c_str() + start);
+    CHECK(number > last);
+    last = number;
+    delivered++;
+    start = end + 1;
+  }
+
+  printf("%d frames sent, %d delivered, %lu superseded\n", sent, delivered, queue.supersededCount());
+  CHECK_EQUAL(static_cast<unsigned long>(sent - delivered), queue.supersededCount());
+  CHECK(queue.supersededCount() > 0);
+  // The newest frame always gets out.
+  CHECK_EQUAL(last, sent - 1);
+}
+
+// The Bluetooth transport doesn't write while the link is congested. The
+// next frame is held to go first, newer ones replace each other behind it.
+static void testBluetoothCongestion() {
+  BTSerialCommunication comm;
+  comm.start();
+  const std::string first = message('a', 40);
+  CHECK(comm.output(first.data(), first.size()));
+  CHECK_EQUAL(comm.pendingBytes(), 0u);
+
+  hal::setBluetoothCongested(true);
+  const std::string held = message('b', 40);
+  const std::string newest = message('d', 40);
+  CHECK(comm.output(held.data(), held.size()));
+  CHECK(comm.output("c\n", 2));
+  CHECK(!comm.output(newest.data(), newest.size()));
+  comm.serviceOutput();
+  CHECK_EQUAL(comm.pendingBytes(), held.size() + newest.size());
+  CHECK_EQUAL(hal::bluetooth->takeOutput(), first);
+
+  hal::setBluetoothCongested(false);
+  comm.serviceOutput();
+  CHECK_EQUAL(comm.pendingBytes(), 0u);
+  CHECK_EQUAL(hal::bluetooth->takeOutput(), held + newest);
+}
+
+int main() {
+  testSupersede();
+  testSlowLink();
+  testBluetoothCongestion();
+  return host_test::result();
+}
@@ -0,0 +1,124 @@
+// Drives the UDP transport from simulated peers: locking on to the
+// driver, forgetting it after a silence, and dropping late commands on a
+// lossy, reordering network.
+
+#include "Arduino.h"
+
+#include "UDPWIFICommunication.hpp"
+
+#include "HostTest.h"
+
+static const IPAddress DRIVER(192, 168, 1, 10);
+static const IPAddress OTHER(192, 168, 1, 20);
+
+static std::string datagram(uint16_t sequence, const std::string& message) {
+  std::string data;
+  data += static_cast<char>(sequence >> 8);
+  data += static_cast<char>(sequence & 0xFF);
+  return data + message;
+}
+
+// Read the waiting datagrams, returns the command or "" if there was none.
+static std::string receive(WIFIUDPCommunication& comm) {
+  char input[RECEIVE_BUFFER_SIZE];
+  if (!comm.hasData() || !comm.readData(input, sizeof(input))) return "";
+  return input;
+}
+
+// Send a frame, returns where it went, or "" if nowhere.
+static std::string sendFrame(WIFIUDPCommunication& comm) {
+  CHECK(comm.output("A0\n", 3));
+  hal::Datagram sent;
+  if (!hal::takeDatagram(sent)) return "";
+  return sent.ip.toString() + ":" + std::to_string(sent.port);
+}
+
+static void testPeerLock() {
+  WIFIUDPCommunication comm;
+  comm.start();
+  CHECK(!comm.isOpen());
+  CHECK_EQUAL(sendFrame(comm), std::string(""));
+
+  // The first sender is the driver.
+  hal::sendDatagram(DRIVER, 5000, datagram(1, "A100\n"));
+  CHECK_EQUAL(receive(comm), std::string("A100"));
+  CHECK(comm.isOpen());
+  CHECK_EQUAL(sendFrame(comm), std::string("192.168.1.10:5000"));
+
+  // Another host can't take the stream over, nor can the driver from
+  // another port.
+  hal::sendDatagram(OTHER, 5000, datagram(2, "A200\n"));
+  CHECK_EQUAL(receive(comm), std::string(""));
+  hal::sendDatagram(DRIVER, 5001, datagram(2, "A300\n"));
+  CHECK_EQUAL(receive(comm), std::string(""));
+  CHECK_EQUAL(sendFrame(comm), std::string("192.168.1.10:5000"));
+
+  // Heard from often enough, the driver keeps the stream.
+  for (int i = 0; i < 5; i++) {
+    hal::advance(WIFI_UDP_PEER_TIMEOUT * 1000UL / 2);
+    hal::sendDatagram(DRIVER, 5000, datagram(2 + i, "\n"));
+    CHECK_EQUAL(receive(comm), std::string(""));
+    CHECK(comm.isOpen());
+  }
+
+  // After a silence the link closes and the next sender is the driver.
+  hal::advance(WIFI_UDP_PEER_TIMEOUT * 1000UL);
+  CHECK(!comm.isOpen());
+  CHECK_EQUAL(sendFrame(comm), std::string(""));
+  hal::sendDatagram(OTHER, 6000, datagram(0, "B100\n"));
+  CHECK_EQUAL(receive(comm), std::string("B100"));
+  CHECK(comm.isOpen());
+  CHECK_EQUAL(sendFrame(comm), std::string("192.168.1.20:6000"));
+}
+
+// Commands on a network that loses and reorders datagrams. The glove
+// only acts on commands newer than the last one it took.
+static void testLossAndReordering() {
+  hal::advance(WIFI_UDP_PEER_TIMEOUT * 1000UL);
+  WIFIUDPCommunication comm;
+  comm.start();
+
+  uint32_t random = 1;
+  int sent = 0;
+  int lost = 0;
+  int taken = 0;
+  int last = -1;
+  std::string held;
+  for (int sequence = 0; sequence < 2000; sequence++) {
+    random = random * 1664525u + 1013904223u;
+    const int roll = (random >> 16) % 100;
+    const std::string data = datagram(sequence, "A" + std::to_string(sequence) + "\n");
+    sent++;
+    if (roll < 10) {
+      lost++;
+    } else if (roll < 20 && held.empty()) {
+      // Arrives after the next one.
+      held = data;
+    } else {
+      hal::sendDatagram(DRIVER, 5000, data);
+      if (!held.empty()) hal::sendDatagram(DRIVER, 5000, held);
+      held.clear();
+    }
+
+    // A loop, reading one command at a time.
+    hal::advance(LOOP_TIME * 1000UL);
+    char input[RECEIVE_BUFFER_SIZE];
+    while (comm.hasData()) {
+      if (!comm.readData(input, sizeof(input))) continue;
+      const int number = atoi(input + 1);
+      CHECK(number > last);
+      last = number;
+      taken++;
+    }
+  }
+
+  printf("%d commands sent, %d lost, %d taken, the rest late\n", sent, lost, taken);
+  CHECK(taken < sent - lost);
+  CHECK(taken > (sent - lost) * 8 / 10);
+}
+
+int main() {
+  testPeerLock();
+  testLossAndReordering();
+  return host_test::result();
+}
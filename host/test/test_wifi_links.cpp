@@ -0,0 +1,176 @@
+// Runs the whole sketch over a lossy WiFi link and reports how old the
+// frames are when they reach the driver, and how many never do. Built
+// once for the UDP transport and once for TCP, to compare the two.
+//
+// The link is a model on the virtual clock, between the host's stand-ins
+// for the WiFi stack and the driver:
+// - Each datagram or TCP segment takes ONE_WAY to arrive and is lost
+//   with the phase's loss rate.
+// - UDP loses the frame. TCP resends it, and the segments behind it wait
+//   for it so they arrive in order. The resend goes out when the duplicate
+//   acks for the next three segments come back (fast retransmit), or after
+//   TCP_RTO if one of those was lost too.
+// Each frame is a segment of its own, the transport sets TCP_NODELAY.
+
+#include "Arduino.h"
+
+#include "open-gloves.ino"
+
+#include "HostTest.h"
+#include "Signals.h"
+
+#include <algorithm>
+#include <deque>
+#include <random>
+
+static_assert(ENABLE_FRAME_TIMING, "The frames need their sample times");
+
+static const unsigned long ONE_WAY = 1000;
+// lwIP's retransmission timer ticks every 500ms.
+static const unsigned long TCP_RTO = 500000;
+static const int LOOPS_PER_PHASE = 5000;
+static const double LOSS_RATES[] = {0, 0.01, 0.05};
+static const int PHASES = sizeof(LOSS_RATES) / sizeof(LOSS_RATES[0]);
+
+// What reached the driver, by the phase the frame was sent in.
+struct Phase {
+  std::vector<unsigned long> ages;
+  unsigned long sent = 0;
+};
+
+static Phase phases[PHASES];
+static std::mt19937 random_source(42);
+
+static int phaseOf(unsigned long loop) {
+  return std::min<unsigned long>(loop / LOOPS_PER_PHASE, PHASES - 1);
+}
+
+static bool lost(int phase) {
+  return std::uniform_real_distribution<double>(0, 1)(random_source) < LOSS_RATES[phase];
+}
+
+// A frame on its way to the driver.
+struct InFlight {
+  unsigned long arrives;
+  std::string frame;
+};
+
+static std::deque<InFlight> in_flight;
+
+// Frames that arrived by now, with how old their sample is.
+static void deliver() {
+  while (!in_flight.empty() && in_flight.front().arrives <= micros()) {
+    const std::string& frame = in_flight.front().frame;
+    const size_t time = frame.rfind(EncodedInput::Type::FRAME_TIME);
+    const unsigned long sampled = strtoul(frame.c_str() + time + 1, NULL, 10);
+    phases[phaseOf(sampled / (LOOP_TIME * 1000ul))].ages.push_back(in_flight.front().arrives - sampled);
+    in_flight.pop_front();
+  }
+}
+
+#if COMMUNICATION == COMM_WIFI_UDP
+  static const IPAddress DRIVER(192, 168, 1, 10);
+  static uint16_t driver_sequence = 0;
+
+  // The driver has to be heard from to keep the stream.
+  static void keepAlive() {
+    std::string datagram(2, '\0');
+    datagram[0] = static_cast<char>(driver_sequence >> 8);
+    datagram[1] = static_cast<char>(driver_sequence & 0xFF);
+    driver_sequence++;
+    hal::sendDatagram(DRIVER, 5000, datagram + "\n");
+  }
+
+  static void transmit(unsigned long loop, unsigned long sent_at) {
+    const int phase = phaseOf(loop);
+    hal::Datagram datagram;
+    while (hal::takeDatagram(datagram)) {
+      phases[phase].sent++;
+      if (lost(phase)) continue;
+      // Past the sequence number.
+      in_flight.push_back({sent_at + ONE_WAY, std::string(datagram.data.begin() + 2, datagram.data.end())});
+    }
+  }
+#else
+  static WiFiClient driver;
+  // When the last frame arrives, the ones behind it can't arrive sooner.
+  static unsigned long last_arrival = 0;
+
+  static void keepAlive() {}
+
+  static void transmit(unsigned long loop, unsigned long sent_at) {
+    const int phase = phaseOf(loop);
+    const std::string data = driver.stream()->takeOutput();
+    size_t start = 0;
+    for (size_t end = data.find('\n'); end != std::string::npos; end = data.find('\n', start)) {
+      phases[phase].sent++;
+      unsigned long arrives = sent_at + ONE_WAY;
+      if (lost(phase)) {
+        // Three more segments have to get through to trigger the resend.
+        bool fast = true;
+        for (int i = 0; i < 3; i++) fast = fast && !lost(phase);
+        arrives = fast ? sent_at + 3 * LOOP_TIME * 1000ul + 3 * ONE_WAY : sent_at + TCP_RTO + ONE_WAY;
+        while (lost(phase)) arrives += TCP_RTO;
+      }
+      last_arrival = std::max(last_arrival, arrives);
+      in_flight.push_back({last_arrival, data.substr(start, end - start)});
+      start = end + 1;
+    }
+  }
+#endif
+
+static unsigned long percentile(std::vector<unsigned long> ages, double fraction) {
+  if (ages.empty()) return 0;
+  std::sort(ages.begin(), ages.end());
+  return ages[std::min<size_t>(ages.size() - 1, ages.size() * fraction)];
+}
+
+int main() {
+  #if COMMUNICATION == COMM_WIFI_UDP
+    const char* transport = "UDP";
+    keepAlive();
+  #else
+    const char* transport = "TCP";
+    driver = hal::connectClient();
+  #endif
+
+  setup();
+  for (unsigned long loop_count = 0; loop_count < LOOPS_PER_PHASE * PHASES; loop_count++) {
+    if (loop_count % 100 == 0) keepAlive();
+    signals::drive(loop_count);
+    // The loop sends its frame before it waits for the next one.
+    const unsigned long sent_at = micros();
+    loop();
+    transmit(loop_count, sent_at);
+    deliver();
+  }
+  // Let the last resends arrive.
+  hal::advance(4 * TCP_RTO);
+  deliver();
+
+  printf("%s, %lu us each way:\n", transport, ONE_WAY);
+  printf("  %-6s %10s %10s %10s %10s\n", "loss", "delivered", "mean ms", "p99 ms", "max ms");
+  for (int phase = 0; phase < PHASES; phase++) {
+    const std::vector<unsigned long>& ages = phases[phase].ages;
+    double total = 0;
+    for (unsigned long age : ages) total += age;
+    printf("  %5.0f%% %9.1f%% %10.2f %10.2f %10.2f\n", LOSS_RATES[phase] * 100,
+           100.0 * ages.size() / phases[phase].sent, total / ages.size() / 1000, percentile(ages, 0.99) / 1000.0,
+           percentile(ages, 1) / 1000.0);
+  }
+
+  // Without loss every frame takes one trip.
+  CHECK_EQUAL(phases[0].ages.size(), phases[0].sent);
+  CHECK_EQUAL(percentile(phases[0].ages, 1), ONE_WAY);
+  #if COMMUNICATION == COMM_WIFI_UDP
+    // A lost datagram never holds up the next one.
+    for (int phase = 1; phase < PHASES; phase++) CHECK_EQUAL(percentile(phases[phase].ages, 1), ONE_WAY);
+  #else
+    // Every frame gets there, but the ones behind a lost one are late.
+    for (int phase = 1; phase < PHASES; phase++) {
+      CHECK_EQUAL(phases[phase].ages.size(), phases[phase].sent);
+      CHECK(percentile(phases[phase].ages, 0.99) > 10 * ONE_WAY);
+    }
+  #endif
+  return host_test::result();
+}
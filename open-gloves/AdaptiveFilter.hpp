@@ -0,0 +1,58 @@
+#pragma once
+
+#include "Config.h"
+
+#include <stdint.h>
+
+// Low pass filter whose cutoff rises with the speed of the signal, in the
+// style of the One Euro filter. A still finger is heavily smoothed, a
+// moving one is followed closely so it doesn't lag.
+//
+// Everything is fixed point so it is cheap on boards without an FPU.
+// The smoothing factor uses the small angle form of the One Euro filter,
+// alpha = 2*pi*Te*cutoff, which needs no division per sample. With
+// cutoff = min_cutoff + beta * speed, and speed = change per sample / Te,
+// this becomes alpha = 2*pi*Te*min_cutoff + 2*pi*beta*change per sample.
+class AdaptiveFilter {
+ public:
+  AdaptiveFilter() : value(0), change(0), initialized(false) {}
+
+  int filter(int input) {
+    const long scaled_input = static_cast<long>(input) << VALUE_SHIFT;
+    if (!initialized) {
+      value = scaled_input;
+      initialized = true;
+      return input;
+    }
+
+    // Smooth the change per sample so noise doesn't open the filter.
+    change += (scaled_input - value - change) * CHANGE_ALPHA >> ALPHA_SHIFT;
+
+    // Faster movement means a higher cutoff.
+    long alpha = MIN_ALPHA + (SPEED_GAIN * (change < 0 ? -change : change) >> VALUE_SHIFT);
+    if (alpha > ALPHA_ONE) alpha = ALPHA_ONE;
+
+    value += (scaled_input - value) * alpha >> ALPHA_SHIFT;
+
+    // Round back to the input resolution.
+    return (value + (1l << (VALUE_SHIFT - 1))) >> VALUE_SHIFT;
+  }
+
+ private:
+  // Fractional bits kept on the filtered values.
+  static constexpr uint8_t VALUE_SHIFT = 4;
+  // Fractional bits of the smoothing factors.
+  static constexpr uint8_t ALPHA_SHIFT = 12;
+  static constexpr long ALPHA_ONE = 1l << ALPHA_SHIFT;
+
+  // Smoothing factors for the configured loop rate.
+  static constexpr float SAMPLE_PERIOD = (LOOP_TIME > 0 ? LOOP_TIME : 1) / 1000.0f;
+  static constexpr float TWO_PI = 6.2831853f;
+  static constexpr long MIN_ALPHA = TWO_PI * SAMPLE_PERIOD * ADAPTIVE_FILTER_MIN_CUTOFF * ALPHA_ONE + 0.5f;
+  static constexpr long CHANGE_ALPHA = TWO_PI * SAMPLE_PERIOD * ADAPTIVE_FILTER_SPEED_CUTOFF * ALPHA_ONE + 0.5f;
+  static constexpr long SPEED_GAIN = TWO_PI * ADAPTIVE_FILTER_BETA * ALPHA_ONE + 0.5f;
+
+  long value;
+  long change;
+  bool initialized;
+};
@@ -0,0 +1,222 @@
+#pragma once
+
+#include "Config.h"
+
+#include <stdint.h>
+
+// ESP32 boards take several readings per value in a background task.
+#if defined(ESP32) && OVERSAMPLING_COUNT > 1
+  #define OVERSAMPLING_TASK
+  #include "LatestRing.hpp"
+#endif
+
+// Number of times a count can be halved, for powers of two.
+constexpr uint8_t log2Count(unsigned long count) {
+  return count <= 1 ? 0 : 1 + log2Count(count >> 1);
+}
+
+// Largest value readOversampled can return.
+#define OVERSAMPLED_MAX (static_cast<long>(ANALOG_MAX) << OVERSAMPLING_EXTRA_BITS)
+
+// Acquires every analog channel the inputs use in one batch per loop.
+// The inputs register their pins in setupInput and then read their value
+// out of the sample array instead of each doing a blocking analogRead.
+//
+// Each value is the average of OVERSAMPLING_COUNT readings, a boxcar
+// decimator, which lowers uncorrelated noise by the square root of the
+// count. The average can keep OVERSAMPLING_EXTRA_BITS of extra resolution,
+// each extra bit needs four times the readings to be real.
+//
+// On the ATmega328P the conversions run in the background: each ADC
+// interrupt stores a result and starts the next channel, so sampling only
+// copies the latest complete set of scans. The ADC keeps its own pace,
+// about 104us a conversion, whatever LOOP_TIME is.
+//
+// On the ESP32 a low priority task on OVERSAMPLING_CORE scans the channels
+// over and over and publishes the sums of each set of scans, and sampling
+// takes the newest set. Other boards take the readings back to back when
+// sampling. The host build scans its pins in one go, so a recorded trace
+// plays back a whole set of channels at once (see hal::loadTrace).
+class AnalogSampler {
+  static_assert((OVERSAMPLING_COUNT & (OVERSAMPLING_COUNT - 1)) == 0 &&
+                OVERSAMPLING_COUNT >= 1 && OVERSAMPLING_COUNT <= 64,
+                "OVERSAMPLING_COUNT must be a power of two from 1 to 64");
+  static_assert(OVERSAMPLING_EXTRA_BITS <= 3 && (1 << (2 * OVERSAMPLING_EXTRA_BITS)) <= OVERSAMPLING_COUNT,
+                "Each bit of OVERSAMPLING_EXTRA_BITS needs four times the OVERSAMPLING_COUNT");
+
+ public:
+  AnalogSampler() : channel_count(0) {}
+
+  // Add a pin to the scan. Returns its channel in the sample array.
+  uint8_t addChannel(int pin) {
+    pins[channel_count] = pin;
+    samples[channel_count] = 0;
+    return channel_count++;
+  }
+
+  // Start sampling, once all the inputs have registered their pins.
+  void begin() {
+    // Fill the samples so the first loop has real values.
+    for (uint8_t i = 0; i < channel_count; i++) {
+      samples[i] = decimate(static_cast<unsigned long>(analogRead(pins[i])) * OVERSAMPLING_COUNT);
+    }
+
+    #if defined(__AVR_ATmega328P__)
+      if (channel_count == 0) return;
+      for (uint8_t i = 0; i < channel_count; i++) {
+        // Same pin to channel mapping as analogRead.
+        muxes[i] = (pins[i] >= 14 ? pins[i] - 14 : pins[i]) & 0x07;
+        latest[i] = static_cast<uint16_t>(analogRead(pins[i])) * OVERSAMPLING_COUNT;
+        sums[i] = 0;
+      }
+      scan_channel = 0;
+      scan_count = 0;
+      ADMUX = _BV(REFS0) | muxes[0];
+      ADCSRA |= _BV(ADIE) | _BV(ADSC);
+    #elif defined(OVERSAMPLING_TASK)
+      if (channel_count == 0) return;
+      // Under the loop's priority, it only gets the time the loop leaves.
+      xTaskCreatePinnedToCore(scanTask, "oversampling", 2048, this, 0, NULL, OVERSAMPLING_CORE);
+    #endif
+  }
+
+  // Acquire all of the channels. This should be called every loop
+  // before the inputs are read.
+  void sample() {
+    #if defined(__AVR_ATmega328P__)
+      uint16_t scan_sums[ANALOG_CHANNEL_COUNT];
+      noInterrupts();
+      for (uint8_t i = 0; i < channel_count; i++) {
+        scan_sums[i] = latest[i];
+      }
+      interrupts();
+
+      for (uint8_t i = 0; i < channel_count; i++) {
+        samples[i] = decimate(scan_sums[i]);
+      }
+    #elif defined(OVERSAMPLING_TASK)
+      // Keep the last values until the next set of scans is done.
+      if (scan_ring.take()) {
+        for (uint8_t i = 0; i < channel_count; i++) {
+          samples[i] = decimate(scan_ring.readSlot().sums[i]);
+        }
+      }
+    #elif defined(ARDUINO_HOST)
+      unsigned long sums[ANALOG_CHANNEL_COUNT] = {0};
+      hal::analogScan(pins, channel_count, OVERSAMPLING_COUNT, sums);
+      for (uint8_t i = 0; i < channel_count; i++) {
+        samples[i] = decimate(sums[i]);
+      }
+    #else
+      for (uint8_t i = 0; i < channel_count; i++) {
+        unsigned long sum = 0;
+        for (uint8_t n = 0; n < OVERSAMPLING_COUNT; n++) {
+          sum += analogRead(pins[i]);
+        }
+        samples[i] = decimate(sum);
+      }
+    #endif
+  }
+
+  uint8_t channelCount() const {
+    return channel_count;
+  }
+
+  int pin(uint8_t channel) const {
+    return pins[channel];
+  }
+
+  // The channel's value at the ADC resolution, 0 to ANALOG_MAX.
+  int read(uint8_t channel) const {
+    return (samples[channel] + EXTRA_ROUNDING) >> OVERSAMPLING_EXTRA_BITS;
+  }
+
+  // The channel's value with the extra bits, 0 to OVERSAMPLED_MAX.
+  int readOversampled(uint8_t channel) const {
+    return samples[channel];
+  }
+
+  #if defined(__AVR_ATmega328P__)
+    // Called from the ADC interrupt when a conversion is done.
+    void conversionComplete(uint16_t value) {
+      sums[scan_channel] += value;
+      if (++scan_channel == channel_count) {
+        scan_channel = 0;
+
+        // Publish the sums once every channel has all of its readings.
+        if (++scan_count == OVERSAMPLING_COUNT) {
+          scan_count = 0;
+          for (uint8_t i = 0; i < channel_count; i++) {
+            latest[i] = sums[i];
+            sums[i] = 0;
+          }
+        }
+      }
+      ADMUX = _BV(REFS0) | muxes[scan_channel];
+      ADCSRA |= _BV(ADSC);
+    }
+  #endif
+
+ private:
+  // Shift from a sum of readings to the average with the extra bits.
+  static constexpr uint8_t DECIMATION_SHIFT = log2Count(OVERSAMPLING_COUNT) - OVERSAMPLING_EXTRA_BITS;
+  static constexpr uint8_t DECIMATION_ROUNDING = DECIMATION_SHIFT > 0 ? 1 << (DECIMATION_SHIFT - 1) : 0;
+  static constexpr uint8_t EXTRA_ROUNDING = OVERSAMPLING_EXTRA_BITS > 0 ? 1 << (OVERSAMPLING_EXTRA_BITS - 1) : 0;
+
+  static int decimate(unsigned long sum) {
+    return (sum + DECIMATION_ROUNDING) >> DECIMATION_SHIFT;
+  }
+
+  #if defined(OVERSAMPLING_TASK)
+    // Scans the channels and publishes the sums, forever.
+    void scan() {
+      for (;;) {
+        ScanSums& scan_sums = scan_ring.writeSlot();
+        for (uint8_t i = 0; i < channel_count; i++) {
+          scan_sums.sums[i] = 0;
+        }
+        // A channel at a time would bunch its readings together.
+        for (uint8_t n = 0; n < OVERSAMPLING_COUNT; n++) {
+          for (uint8_t i = 0; i < channel_count; i++) {
+            scan_sums.sums[i] += analogRead(pins[i]);
+          }
+        }
+        scan_ring.publish();
+
+        // Let the idle task run, it feeds the watchdog.
+        vTaskDelay(1);
+      }
+    }
+
+    static void scanTask(void* sampler) {
+      static_cast<AnalogSampler*>(sampler)->scan();
+    }
+  #endif
+
+  int pins[ANALOG_CHANNEL_COUNT];
+  int samples[ANALOG_CHANNEL_COUNT];
+  uint8_t channel_count;
+
+  #if defined(__AVR_ATmega328P__)
+    uint8_t muxes[ANALOG_CHANNEL_COUNT];
+    // Sums of the scans in progress, only used by the interrupt.
+    uint16_t sums[ANALOG_CHANNEL_COUNT];
+    // Sums of the last complete set of scans.
+    volatile uint16_t latest[ANALOG_CHANNEL_COUNT];
+    volatile uint8_t scan_channel;
+    volatile uint8_t scan_count;
+  #elif defined(OVERSAMPLING_TASK)
+    struct ScanSums {
+      unsigned long sums[ANALOG_CHANNEL_COUNT];
+    };
+    LatestRing<ScanSums> scan_ring;
+  #endif
+};
+
+AnalogSampler analog_sampler;
+
+#if defined(__AVR_ATmega328P__)
+  ISR(ADC_vect) {
+    analog_sampler.conversionComplete(ADC);
+  }
+#endif
@@ -2,24 +2,28 @@
 
 #include "Config.h"
 
+#include "ButtonBank.hpp"
 #include "DriverProtocol.hpp"
 
 class Button : public EncodedInput {
  public:
   Button(EncodedInput::Type type, int pin, bool invert) :
-    type(type), pin(pin), on_state(invert ? HIGH : LOW), value(false) {}
+    type(type), pin(pin), on_state(invert ? HIGH : LOW), index(0), value(false) {}
 
   void setupInput() override {
     pinMode(pin, INPUT_PULLUP);
+    index = button_bank.addButton(pin, on_state);
   }
 
   virtual void readInput() {
-    value = (digitalRead(pin) == on_state);
+    value = button_bank.isPressed(index);
   }
 
+  // Encode string size = single char
+  static constexpr int ENCODED_SIZE = 1;
+
   inline int getEncodedSize() const override {
-    // Encode string size = single char
-    return 1;
+    return ENCODED_SIZE;
   }
 
   int encode(char* output) const override {
@@ -27,6 +31,10 @@ class Button : public EncodedInput {
     return value ? 1 : 0;
   }
 
+  void encodeBinary(BinaryFrame& frame) const override {
+    frame.setDigital(type, value);
+  }
+
   bool isPressed() const {
     return value;
   }
@@ -35,5 +43,6 @@ class Button : public EncodedInput {
   const EncodedInput::Type type;
   const int pin;
   const bool on_state;
+  uint8_t index;
   bool value;
 };
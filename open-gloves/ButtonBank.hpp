@@ -0,0 +1,402 @@
+#pragma once
+
+#include "Config.h"
+
+#include "EventQueue.hpp"
+
+#include <stdint.h>
+
+// Read the buttons straight from the GPIO input registers on the boards
+// that have a known layout, instead of a digitalRead for each one.
+#if defined(__AVR__)
+  #define BUTTON_PORT_READS true
+  typedef uint8_t PortBits;
+  typedef volatile uint8_t* PortRegister;
+#elif defined(ESP32)
+  #include "soc/gpio_reg.h"
+  #define BUTTON_PORT_READS true
+  typedef uint32_t PortBits;
+  typedef uint32_t PortRegister;
+#else
+  #define BUTTON_PORT_READS false
+#endif
+
+// Planes of the vertical debounce counters, enough to count to 8.
+#define BUTTON_COUNTER_PLANES 3
+// Edges the interrupt can queue before the loop takes them.
+#define BUTTON_EVENT_QUEUE_SIZE 16
+
+// A button read pressed or released by the pin change interrupt.
+struct ButtonEvent {
+  unsigned long time;
+  uint8_t index;
+  bool pressed;
+};
+
+#if ENABLE_BUTTON_INTERRUPTS && defined(ESP32)
+  void IRAM_ATTR buttonsChanged();
+  // The interrupt runs from IRAM and so must everything it calls, flash
+  // can't be read while it is being written.
+  #define BUTTON_ISR_CODE IRAM_ATTR
+#else
+  #define BUTTON_ISR_CODE
+#endif
+
+// Reads all of the buttons at once and debounces them together. The
+// buttons register their pins in setupInput and then read their state out
+// of the bank, like the analog channels.
+//
+// Each port holding a button is read once per loop. The debouncer keeps a
+// small counter for every button, stored as bit planes so all of them
+// count at once with a few bitwise operations. A button changes state once
+// it has read differently for BUTTON_DEBOUNCE_SAMPLES loops in a row, and
+// any read that agrees with the current state starts its count again. The
+// time of an edge is when the button first read differently, the recorder
+// logs it.
+//
+// With ENABLE_BUTTON_INTERRUPTS the pins aren't polled. A pin change
+// interrupt queues an event for every edge, and the loop takes the queue.
+// The first edge is used straight away and the ones during the
+// BUTTON_LOCKOUT_TIME after it are bounce. When the lockout ends the pin is
+// read once, in case the last of those edges was real.
+//
+// Either way a press stays latched until it has been reported, so a tap
+// shorter than a frame still reaches the driver.
+class ButtonBank {
+  static_assert(BUTTON_DEBOUNCE_SAMPLES >= 1 && BUTTON_DEBOUNCE_SAMPLES <= (1 << BUTTON_COUNTER_PLANES),
+                "BUTTON_DEBOUNCE_SAMPLES must be from 1 to 8");
+  static_assert(BUTTON_COUNT <= 16, "The button states are kept in 16 bits");
+
+ public:
+  ButtonBank() : button_count(0), active_low(0), levels(0), states(0), latched(0), edges(0) {
+    #if BUTTON_PORT_READS
+      port_count = 0;
+    #endif
+    #if ENABLE_BUTTON_INTERRUPTS
+      isr_levels = 0;
+      locked = 0;
+      overflows = 0;
+      seen_overflows = 0;
+    #else
+      for (uint8_t k = 0; k < BUTTON_COUNTER_PLANES; k++) {
+        counters[k] = 0;
+      }
+    #endif
+  }
+
+  // Add a button's pin to the bank. Returns its index in the states.
+  uint8_t addButton(int pin, bool on_state) {
+    const uint8_t index = button_count++;
+    if (on_state == LOW) active_low |= 1u << index;
+    pins[index] = pin;
+    change_times[index] = 0;
+    edge_times[index] = 0;
+
+    #if BUTTON_PORT_READS
+      // Share the read of a port between all of the buttons on it.
+      const PortRegister port = portRegister(pin);
+      uint8_t p = 0;
+      while (p < port_count && ports[p] != port) p++;
+      if (p == port_count) ports[port_count++] = port;
+      button_ports[index] = p;
+      button_masks[index] = portMask(pin);
+    #endif
+
+    return index;
+  }
+
+  // Start debouncing from the current state, once all of the buttons
+  // have registered their pins.
+  void begin() {
+    levels = readLevels();
+    states = levels;
+
+    #if ENABLE_BUTTON_INTERRUPTS
+      isr_levels = levels;
+      for (uint8_t i = 0; i < button_count; i++) {
+        #if defined(__AVR__)
+          *digitalPinToPCICR(pins[i]) |= _BV(digitalPinToPCICRbit(pins[i]));
+          *digitalPinToPCMSK(pins[i]) |= _BV(digitalPinToPCMSKbit(pins[i]));
+        #elif defined(ESP32)
+          attachInterrupt(digitalPinToInterrupt(pins[i]), buttonsChanged, CHANGE);
+        #endif
+      }
+    #endif
+  }
+
+  // Update the state of all of the buttons. This should be called every
+  // loop before the inputs are read.
+  void sample(unsigned long now) {
+    #if ENABLE_BUTTON_INTERRUPTS
+      edges = takeEvents(now);
+    #else
+      edges = debounce(now);
+    #endif
+
+    // Hold the new presses until they are reported.
+    latched |= edges & states;
+  }
+
+  // Call once the states have been sent to the driver. A press that
+  // was already released is let go.
+  void reported() {
+    latched = 0;
+  }
+
+  // The debounced state of the button, pressed until reported for a
+  // press that was already released.
+  bool isPressed(uint8_t index) const {
+    return (states | latched) & (1u << index);
+  }
+
+  // Bit n set if the button n read pressed, before debouncing. With
+  // interrupts this is the level of the latest edge.
+  uint16_t rawStates() const {
+    return levels;
+  }
+
+  // Bit n set if the button n was pressed or released by the last sample.
+  uint16_t lastEdges() const {
+    return edges;
+  }
+
+  // Bit n set if the button n is pressed, after debouncing.
+  uint16_t debouncedStates() const {
+    return states;
+  }
+
+  // When the button was last pressed or released (micros).
+  unsigned long edgeTime(uint8_t index) const {
+    return edge_times[index];
+  }
+
+  uint8_t buttonCount() const {
+    return button_count;
+  }
+
+  int pin(uint8_t index) const {
+    return pins[index];
+  }
+
+  // The level the button's pin reads when it is pressed.
+  bool onState(uint8_t index) const {
+    return active_low & (1u << index) ? LOW : HIGH;
+  }
+
+  #if ENABLE_BUTTON_INTERRUPTS
+    // Called from the pin change interrupt. Queues an event for every
+    // button that reads differently from the last time.
+    void BUTTON_ISR_CODE pinsChanged() {
+      const unsigned long now = micros();
+      const uint16_t read = readLevels();
+      uint16_t changed = read ^ isr_levels;
+      isr_levels = read;
+
+      for (uint8_t i = 0; changed != 0; i++, changed >>= 1) {
+        if (!(changed & 1)) continue;
+
+        ButtonEvent event = {now, i, static_cast<bool>((read >> i) & 1)};
+        if (!events.push(event)) {
+          // The loop checks every pin when it sees this change.
+          __atomic_store_n(&overflows, static_cast<uint8_t>(overflows + 1), __ATOMIC_RELEASE);
+        }
+      }
+    }
+  #endif
+
+ private:
+  #if ENABLE_BUTTON_INTERRUPTS
+    // Apply the queued edges. Returns the buttons that changed state.
+    uint16_t takeEvents(unsigned long now) {
+      uint16_t settled = 0;
+      ButtonEvent event;
+      while (events.pop(event)) {
+        const uint16_t bit = 1u << event.index;
+        levels = event.pressed ? levels | bit : levels & ~bit;
+        change_times[event.index] = event.time;
+
+        // Edges during the lockout are bounce.
+        if ((locked & bit) || static_cast<bool>(states & bit) == event.pressed) continue;
+
+        states ^= bit;
+        settled |= bit;
+        locked |= bit;
+        edge_times[event.index] = event.time;
+      }
+
+      // Check the pins the lockout is over for, or all of them if the
+      // queue overflowed and edges were lost.
+      uint16_t check = 0;
+      const uint8_t overflow_count = __atomic_load_n(&overflows, __ATOMIC_ACQUIRE);
+      if (overflow_count != seen_overflows) {
+        seen_overflows = overflow_count;
+        check = (1u << button_count) - 1;
+      }
+      uint16_t waiting = locked;
+      for (uint8_t i = 0; waiting != 0; i++, waiting >>= 1) {
+        if ((waiting & 1) && static_cast<long>(now - edge_times[i]) >= BUTTON_LOCKOUT_TIME * 1000L) {
+          check |= 1u << i;
+        }
+      }
+      if (check == 0) return settled;
+
+      locked &= ~check;
+      levels = readLevels();
+      uint16_t missed = (levels ^ states) & check;
+      states ^= missed;
+      settled |= missed;
+      locked |= missed;
+      // The pin has been at this level since its last edge.
+      for (uint8_t i = 0; missed != 0; i++, missed >>= 1) {
+        if (missed & 1) edge_times[i] = change_times[i];
+      }
+      return settled;
+    }
+  #else
+    // Read and debounce the pins. Returns the buttons that changed state.
+    uint16_t debounce(unsigned long now) {
+      levels = readLevels();
+
+      // Buttons that read differently from their state, the others count again.
+      const uint16_t changing = levels ^ states;
+      uint16_t counting = 0;
+      for (uint8_t k = 0; k < BUTTON_COUNTER_PLANES; k++) {
+        counters[k] &= changing;
+        counting |= counters[k];
+      }
+
+      // Buttons that have read differently for long enough.
+      uint16_t settled = changing;
+      for (uint8_t k = 0; k < BUTTON_COUNTER_PLANES; k++) {
+        settled &= ((BUTTON_DEBOUNCE_SAMPLES - 1) >> k) & 1 ? counters[k] : ~counters[k];
+      }
+
+      // Count up the others, carrying from plane to plane.
+      uint16_t carry = changing & ~settled;
+      for (uint8_t k = 0; k < BUTTON_COUNTER_PLANES; k++) {
+        const uint16_t plane = counters[k];
+        counters[k] = (plane ^ carry) & ~settled;
+        carry &= plane;
+      }
+
+      // Remember when each change started, it becomes the edge time.
+      uint16_t started = changing & ~counting;
+      for (uint8_t i = 0; started != 0; i++, started >>= 1) {
+        if (started & 1) change_times[i] = now;
+      }
+
+      states ^= settled;
+      uint16_t edges = settled;
+      for (uint8_t i = 0; edges != 0; i++, edges >>= 1) {
+        if (edges & 1) edge_times[i] = change_times[i];
+      }
+      return settled;
+    }
+  #endif
+
+  #if BUTTON_PORT_READS
+    #if defined(__AVR__)
+      static PortRegister portRegister(int pin) {
+        return portInputRegister(digitalPinToPort(pin));
+      }
+
+      static PortBits portMask(int pin) {
+        return digitalPinToBitMask(pin);
+      }
+
+      static PortBits readPort(PortRegister port) {
+        return *port;
+      }
+    #elif defined(ESP32)
+      static PortRegister portRegister(int pin) {
+        return pin < 32 ? GPIO_IN_REG : GPIO_IN1_REG;
+      }
+
+      static PortBits portMask(int pin) {
+        return 1ul << (pin & 31);
+      }
+
+      static PortBits BUTTON_ISR_CODE readPort(PortRegister port) {
+        return REG_READ(port);
+      }
+    #endif
+  #endif
+
+  // Bit n set if the button n reads pressed.
+  uint16_t BUTTON_ISR_CODE readLevels() const {
+    uint16_t high = 0;
+    #if BUTTON_PORT_READS
+      PortBits values[BUTTON_COUNT];
+      for (uint8_t p = 0; p < port_count; p++) {
+        values[p] = readPort(ports[p]);
+      }
+      for (uint8_t i = 0; i < button_count; i++) {
+        if (values[button_ports[i]] & button_masks[i]) high |= 1u << i;
+      }
+    #else
+      for (uint8_t i = 0; i < button_count; i++) {
+        if (digitalRead(pins[i]) == HIGH) high |= 1u << i;
+      }
+    #endif
+
+    // Buttons with a pull up are pressed when they read low.
+    return high ^ active_low;
+  }
+
+  uint8_t button_count;
+  uint16_t active_low;
+  uint16_t levels;
+  uint16_t states;
+  uint16_t latched;
+  uint16_t edges;
+  int pins[BUTTON_COUNT];
+  unsigned long change_times[BUTTON_COUNT];
+  unsigned long edge_times[BUTTON_COUNT];
+
+  #if BUTTON_PORT_READS
+    PortRegister ports[BUTTON_COUNT];
+    uint8_t port_count;
+    uint8_t button_ports[BUTTON_COUNT];
+    PortBits button_masks[BUTTON_COUNT];
+  #endif
+
+  #if ENABLE_BUTTON_INTERRUPTS
+    EventQueue<ButtonEvent, BUTTON_EVENT_QUEUE_SIZE> events;
+    // Only used by the interrupt.
+    uint16_t isr_levels;
+    // Buttons in their lockout after an edge.
+    uint16_t locked;
+    // Counted by the interrupt when the queue was full.
+    uint8_t overflows;
+    uint8_t seen_overflows;
+  #else
+    uint16_t counters[BUTTON_COUNTER_PLANES];
+  #endif
+};
+
+ButtonBank button_bank;
+
+#if ENABLE_BUTTON_INTERRUPTS
+  #if defined(__AVR__)
+    // The buttons can be spread over any of the pin change ports.
+    #ifdef PCINT0_vect
+      ISR(PCINT0_vect) {
+        button_bank.pinsChanged();
+      }
+    #endif
+    #ifdef PCINT1_vect
+      ISR(PCINT1_vect) {
+        button_bank.pinsChanged();
+      }
+    #endif
+    #ifdef PCINT2_vect
+      ISR(PCINT2_vect) {
+        button_bank.pinsChanged();
+      }
+    #endif
+  #elif defined(ESP32)
+    void IRAM_ATTR buttonsChanged() {
+      button_bank.pinsChanged();
+    }
+  #endif
+#endif
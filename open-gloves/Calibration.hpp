@@ -1,13 +1,32 @@
 #pragma once
 
+#include <stdint.h>
+
 constexpr float accurateMap(float x, float in_min, float in_max, float out_min, float out_max) {
   return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
 }
 
+// A calibrated range, as saved to storage.
+struct CalibrationRange {
+  int16_t min;
+  int16_t max;
+};
+
+// Most ranges a single calibrated input saves.
+#define MAX_CALIBRATION_RANGES 2
+
 class Calibrated {
  public:
   virtual void resetCalibration() = 0;
 
+  // Copy the calibrated ranges out of the input.
+  // Returns the number of ranges written.
+  virtual uint8_t saveCalibration(CalibrationRange* ranges) const = 0;
+
+  // Restore ranges written by saveCalibration.
+  // Returns the number of ranges used.
+  virtual uint8_t loadCalibration(const CalibrationRange* ranges) = 0;
+
   virtual void enableCalibration() {
     calibrate = true;
   }
@@ -20,32 +39,93 @@ class Calibrated {
   bool calibrate;
 };
 
+// Visitors for the calibrated inputs of a registry, see HardwareConfig.hpp.
+struct EnableCalibration {
+  template<typename T>
+  void operator()(T& input) const {
+    input.T::enableCalibration();
+  }
+};
+
+struct DisableCalibration {
+  template<typename T>
+  void operator()(T& input) const {
+    input.T::disableCalibration();
+  }
+};
+
+struct ResetCalibration {
+  template<typename T>
+  void operator()(T& input) const {
+    input.T::resetCalibration();
+  }
+};
+
 template<typename T>
 class MinMaxCalibrator {
  public:
   MinMaxCalibrator(T output_min_,T output_max_, bool clamp_) :
     output_min(output_min_),
     output_max(output_max_),
-    value_min(output_max_),
-    value_max(output_min_),
-    clamp(clamp_) {}
+    value_min(INT16_MAX),
+    value_max(INT16_MIN),
+    clamp(clamp_),
+    scale(0) {}
 
   void reset() {
-    value_min = output_max;
-    value_max = output_min;
+    // An empty range that the first value replaces. Inputs can be wider
+    // than the output range, and the range has to fit a CalibrationRange.
+    value_min = INT16_MAX;
+    value_max = INT16_MIN;
   }
 
   void update(T input) {
     // Either update the min or the max.
     // We shouldn't ever need to update both.
-    if (input < value_min) value_min = input;
-    if (input > value_max) value_max = input;
+    bool changed = false;
+    if (input < value_min) {
+      value_min = input;
+      changed = true;
+    }
+    if (input > value_max) {
+      value_max = input;
+      changed = true;
+    }
+
+    // Only pay for the division when the range actually changes.
+    if (changed) updateScale();
+  }
+
+  // Replace the calibrated range, eg. with one from storage.
+  void restore(T min, T max) {
+    value_min = min;
+    value_max = max;
+    updateScale();
+  }
+
+  T minimum() const {
+    return value_min;
+  }
+
+  T maximum() const {
+    return value_max;
   }
 
   T calibrate(T input, T input_min, T input_max) const {
-    // This means we haven't had any calibration data yet.
+    // This means we haven't had enough calibration data yet.
     // Return a neutral value right in the middle of the output range.
-    if (value_min > value_max) return (output_min + output_max) / 2.0f;
+    if (value_min >= value_max) return (output_min + output_max) / 2.0f;
+
+    // Mapping onto the output range is the common case, use the cached
+    // fixed point scale for it. Clamping the input first is the same as
+    // clamping the output. Rounding makes the calibrated max map to
+    // output_max, the scale itself is rounded.
+    if (input_min == output_min && input_max == output_max) {
+      if (clamp) input = constrain(input, value_min, value_max);
+      if (input >= value_min && input <= value_max) {
+        return ((static_cast<long>(input - value_min) * scale + (1l << (SCALE_SHIFT - 1))) >> SCALE_SHIFT) + output_min;
+      }
+    }
 
     // Map the input range to the output range.
     T output = accurateMap(input, value_min, value_max, input_min, input_max);
@@ -53,9 +133,22 @@ class MinMaxCalibrator {
   }
 
 private:
+ // Fractional bits of the cached scale. The output range shifted by
+ // this has to fit in a long.
+ static const uint8_t SCALE_SHIFT = 16;
+
+ void updateScale() {
+   if (value_min < value_max) {
+     long range = value_max - value_min;
+     scale = ((static_cast<long>(output_max - output_min) << SCALE_SHIFT) + range / 2) / range;
+   }
+ }
+
  T output_min;
  T output_max;
  T value_min;
  T value_max;
  bool clamp;
+ // (output_max - output_min) / (value_max - value_min) in fixed point.
+ long scale;
 };
@@ -0,0 +1,307 @@
+#pragma once
+
+#include "Config.h"
+
+#include "Calibration.hpp"
+
+#if defined(__AVR__)
+  #include <EEPROM.h>
+#elif defined(ESP32)
+  #include <Preferences.h>
+  #include "LatestRing.hpp"
+#endif
+
+#if defined(ARDUINO_HOST)
+  #include <stdio.h>
+#endif
+
+// Most calibrated ranges in a snapshot.
+#define CALIBRATION_SNAPSHOT_RANGES (MAX_CALIBRATED_COUNT * MAX_CALIBRATION_RANGES)
+// Header, the ranges and a checksum.
+#define CALIBRATION_SNAPSHOT_SIZE (6 + CALIBRATION_SNAPSHOT_RANGES * 4 + 2)
+
+// Interface for non-volatile storage of the calibration snapshot.
+struct ICalibrationStorage {
+  virtual void begin() {}
+
+  // Read the stored snapshot. Returns false if nothing has been stored.
+  virtual bool read(uint8_t* data, size_t length) = 0;
+
+  // Write part of the snapshot, starting at the offset. Slow storage can
+  // write less than asked to spread the work out over several loops.
+  // Returns the number of bytes written.
+  virtual size_t write(size_t offset, const uint8_t* data, size_t length) = 0;
+};
+
+#if defined(__AVR__)
+// Stores the snapshot in the AVR EEPROM. Writing a byte takes about 3.3ms,
+// so only one byte is written per call and unchanged bytes are skipped to
+// save wear.
+class EEPROMCalibrationStorage : public ICalibrationStorage {
+ public:
+  bool read(uint8_t* data, size_t length) override {
+    for (size_t i = 0; i < length; i++) {
+      data[i] = EEPROM.read(CALIBRATION_EEPROM_ADDRESS + i);
+    }
+    return true;
+  }
+
+  size_t write(size_t offset, const uint8_t* data, size_t length) override {
+    EEPROM.update(CALIBRATION_EEPROM_ADDRESS + offset, data[0]);
+    return 1;
+  }
+};
+
+typedef EEPROMCalibrationStorage DefaultCalibrationStorage;
+#elif defined(ESP32)
+// Stores the snapshot in NVS, which does its own wear leveling. A flash
+// write can take several milliseconds, so a low priority task on
+// TRANSPORT_CORE does it and writing only hands the snapshot over.
+class PreferencesCalibrationStorage : public ICalibrationStorage {
+ public:
+  PreferencesCalibrationStorage() : write_task(NULL) {}
+
+  void begin() override {
+    preferences.begin("opengloves", false);
+    if (write_task == NULL) {
+      xTaskCreatePinnedToCore(writeTask, "calibration", 2048, this, 0, &write_task, TRANSPORT_CORE);
+    }
+  }
+
+  bool read(uint8_t* data, size_t length) override {
+    if (preferences.getBytesLength("calibration") != length) return false;
+    return preferences.getBytes("calibration", data, length) == length;
+  }
+
+  size_t write(size_t offset, const uint8_t* data, size_t length) override {
+    // NVS entries are written whole.
+    if (offset == 0) {
+      PendingSnapshot& snapshot = snapshots.writeSlot();
+      memcpy(snapshot.data, data, length);
+      snapshot.length = length;
+      snapshots.publish();
+      xTaskNotifyGive(write_task);
+    }
+    return length;
+  }
+
+ private:
+  struct PendingSnapshot {
+    uint8_t data[CALIBRATION_SNAPSHOT_SIZE];
+    size_t length;
+  };
+
+  // Writes the newest snapshot handed over, forever.
+  void writeSnapshots() {
+    for (;;) {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      if (snapshots.take()) {
+        const PendingSnapshot& snapshot = snapshots.readSlot();
+        preferences.putBytes("calibration", snapshot.data, snapshot.length);
+      }
+    }
+  }
+
+  static void writeTask(void* storage) {
+    static_cast<PreferencesCalibrationStorage*>(storage)->writeSnapshots();
+  }
+
+  Preferences preferences;
+  // Only the newest snapshot needs writing.
+  LatestRing<PendingSnapshot> snapshots;
+  TaskHandle_t write_task;
+};
+
+typedef PreferencesCalibrationStorage DefaultCalibrationStorage;
+#endif
+
+#if defined(ARDUINO_HOST)
+// Stores the snapshot in a file, for the host build and its tests.
+class FileCalibrationStorage : public ICalibrationStorage {
+ public:
+  FileCalibrationStorage(const char* path) : path(path) {}
+
+  bool read(uint8_t* data, size_t length) override {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) return false;
+    size_t count = fread(data, 1, length, file);
+    // A longer file was stored for another configuration.
+    bool whole = count == length && fgetc(file) == EOF;
+    fclose(file);
+    return whole;
+  }
+
+  size_t write(size_t offset, const uint8_t* data, size_t length) override {
+    // Start the file over with the first part of a snapshot.
+    FILE* file = fopen(path, offset == 0 ? "wb" : "r+b");
+    if (file == NULL) return 0;
+    fseek(file, offset, SEEK_SET);
+    size_t count = fwrite(data, 1, length, file);
+    fclose(file);
+    return count;
+  }
+
+ private:
+  const char* path;
+};
+#endif
+
+// FNV-1a step over a whole setting.
+constexpr uint32_t hashSetting(uint32_t hash, long value) {
+  return (hash ^ static_cast<uint32_t>(value)) * 16777619UL;
+}
+
+// Hash of the settings that shape the raw values the ranges are measured in.
+constexpr uint32_t CALIBRATION_SETTINGS_HASH =
+  hashSetting(hashSetting(hashSetting(hashSetting(hashSetting(hashSetting(hashSetting(2166136261UL,
+    ANALOG_MAX), OVERSAMPLING_EXTRA_BITS), INVERT_FLEXION), CLAMP_FLEXION), CLAMP_MIN), CLAMP_MAX),
+    CLAMP_ANALOG_MAP);
+
+// Keeps a snapshot of all the calibrated ranges in storage so the glove
+// is calibrated as soon as it powers up. The snapshot records a hash of
+// the settings that shape the raw values, a snapshot from a build with
+// other settings isn't restored.
+//
+// Saving is deferred until the ranges stop changing for
+// CALIBRATION_SAVE_DELAY, so a calibration sweep causes one write
+// instead of hundreds, and the write itself is spread out over as many
+// loops as the storage needs.
+class CalibrationStore {
+ public:
+  CalibrationStore(ICalibrationStorage* storage) :
+    storage(storage), snapshot_size(0), write_offset(0), writing(false),
+    last_check(0), last_change(0) {}
+
+  // Restore the stored ranges into the calibrators.
+  // Returns false if nothing valid was stored for this configuration.
+  bool restore(Calibrated* calibrators[], size_t count) {
+    storage->begin();
+
+    // The stored snapshot must match the layout of the current hardware.
+    snapshot_size = takeSnapshot(pending, calibrators, count);
+    if (!storage->read(stored, snapshot_size) || !isValid(stored, snapshot_size)) {
+      memcpy(stored, pending, snapshot_size);
+      stored[0] = 0; // Invalidate, so the first settled calibration is saved.
+      return false;
+    }
+
+    CalibrationRange ranges[CALIBRATION_SNAPSHOT_RANGES];
+    readRanges(stored, ranges);
+    uint8_t used = 0;
+    for (size_t i = 0; i < count; i++) {
+      used += calibrators[i]->loadCalibration(ranges + used);
+    }
+    memcpy(pending, stored, snapshot_size);
+    return true;
+  }
+
+  // Check for changes and continue any write in progress.
+  // This should be called every loop.
+  void service(Calibrated* calibrators[], size_t count) {
+    // Nothing to compare against until restore has run.
+    if (snapshot_size == 0) return;
+
+    if (writing) {
+      write_offset += storage->write(write_offset, stored + write_offset, snapshot_size - write_offset);
+      writing = write_offset < snapshot_size;
+      return;
+    }
+
+    // The ranges change slowly, there is no need to look every loop.
+    unsigned long now = millis();
+    if (now - last_check < CALIBRATION_CHECK_INTERVAL) return;
+    last_check = now;
+
+    uint8_t current[CALIBRATION_SNAPSHOT_SIZE];
+    takeSnapshot(current, calibrators, count);
+    if (memcmp(current, pending, snapshot_size) != 0) {
+      // Still changing, wait for it to settle.
+      memcpy(pending, current, snapshot_size);
+      last_change = now;
+    } else if (memcmp(pending, stored, snapshot_size) != 0 &&
+               now - last_change >= CALIBRATION_SAVE_DELAY) {
+      // Settled on something new, start saving it.
+      memcpy(stored, pending, snapshot_size);
+      write_offset = 0;
+      writing = true;
+    }
+  }
+
+ private:
+  static const uint8_t MAGIC_0 = 'O';
+  static const uint8_t MAGIC_1 = 'G';
+  static const uint8_t VERSION = 2;
+  // Magic, version, config hash and range count.
+  static const uint8_t HEADER_SIZE = 6;
+  static constexpr uint16_t CONFIG_HASH = (CALIBRATION_SETTINGS_HASH >> 16) ^ (CALIBRATION_SETTINGS_HASH & 0xFFFF);
+
+  // Serialize the ranges of all the calibrators. Returns the snapshot size.
+  static size_t takeSnapshot(uint8_t* snapshot, Calibrated* calibrators[], size_t count) {
+    CalibrationRange ranges[CALIBRATION_SNAPSHOT_RANGES];
+    uint8_t range_count = 0;
+    for (size_t i = 0; i < count; i++) {
+      range_count += calibrators[i]->saveCalibration(ranges + range_count);
+    }
+
+    size_t offset = 0;
+    snapshot[offset++] = MAGIC_0;
+    snapshot[offset++] = MAGIC_1;
+    snapshot[offset++] = VERSION;
+    snapshot[offset++] = CONFIG_HASH >> 8;
+    snapshot[offset++] = CONFIG_HASH & 0xFF;
+    snapshot[offset++] = range_count;
+    for (uint8_t i = 0; i < range_count; i++) {
+      offset = writeInt16(snapshot, offset, ranges[i].min);
+      offset = writeInt16(snapshot, offset, ranges[i].max);
+    }
+
+    uint16_t sum = checksum(snapshot, offset);
+    snapshot[offset++] = sum >> 8;
+    snapshot[offset++] = sum & 0xFF;
+    return offset;
+  }
+
+  static bool isValid(const uint8_t* snapshot, size_t size) {
+    if (size < HEADER_SIZE + 2 || snapshot[0] != MAGIC_0 || snapshot[1] != MAGIC_1 || snapshot[2] != VERSION) return false;
+    if (snapshot[3] != (CONFIG_HASH >> 8) || snapshot[4] != (CONFIG_HASH & 0xFF)) return false;
+    if (size != HEADER_SIZE + snapshot[5] * 4u + 2) return false;
+    uint16_t sum = checksum(snapshot, size - 2);
+    return snapshot[size - 2] == (sum >> 8) && snapshot[size - 1] == (sum & 0xFF);
+  }
+
+  static void readRanges(const uint8_t* snapshot, CalibrationRange* ranges) {
+    const uint8_t* range = snapshot + HEADER_SIZE;
+    for (uint8_t i = 0; i < snapshot[5]; i++, range += 4) {
+      ranges[i].min = (range[0] << 8) | range[1];
+      ranges[i].max = (range[2] << 8) | range[3];
+    }
+  }
+
+  static size_t writeInt16(uint8_t* snapshot, size_t offset, int16_t value) {
+    snapshot[offset++] = static_cast<uint16_t>(value) >> 8;
+    snapshot[offset++] = value & 0xFF;
+    return offset;
+  }
+
+  // Fletcher-16 checksum.
+  static uint16_t checksum(const uint8_t* data, size_t length) {
+    uint16_t a = 0;
+    uint16_t b = 0;
+    for (size_t i = 0; i < length; i++) {
+      a = (a + data[i]) % 255;
+      b = (b + a) % 255;
+    }
+    return (b << 8) | a;
+  }
+
+  ICalibrationStorage* storage;
+  // The snapshot in storage, or being written to it.
+  uint8_t stored[CALIBRATION_SNAPSHOT_SIZE];
+  // The latest snapshot, waiting to settle.
+  uint8_t pending[CALIBRATION_SNAPSHOT_SIZE];
+  size_t snapshot_size;
+  size_t write_offset;
+  bool writing;
+  unsigned long last_check;
+  unsigned long last_change;
+};
@@ -14,6 +14,7 @@
 #define COMM_SERIAL     0
 #define COMM_BLUETOOTH  1
 #define COMM_WIFI       2
+#define COMM_WIFI_UDP   3 // Experimental: Frames over UDP datagrams, the driver must support it.
 #define COMMUNICATION   COMM_SERIAL
 
 // COMM settings
@@ -22,7 +23,26 @@
 #define BT_SERIAL_DEVICE_NAME   "OpenGlove-Left"
 #define WIFI_SERIAL_SSID        "WIFI SSID here"
 #define WIFI_SERIAL_PASSWORD    "password here"
-#define WIFI_SERIAL_PORT        80
+#define WIFI_SERIAL_PORT        80 // Also used by COMM_WIFI_UDP
+#define WIFI_UDP_PEER_TIMEOUT   2000 // COMM_WIFI_UDP: Forget the driver after not hearing from it for this long (ms).
+
+// Experimental: Send frames less often when the link can't keep up, instead of letting them queue
+// up and arrive late. The inputs are still read every loop.
+#define ENABLE_SEND_RATE_CONTROL false
+#define SEND_RATE_MAX_INTERVAL   50 // Longest time between frames on a slow link (ms).
+#define SEND_RATE_TARGET_LATENCY 8  // How long a frame may wait behind older ones (ms).
+
+// Which encoding to use for the driver protocol
+#define ENCODING_ALPHA  0 // Readable key/value strings, eg. A1023B512...
+#define ENCODING_BINARY 1 // Experimental: Compact COBS framed binary frames, the driver must support it.
+#define ENCODING        ENCODING_ALPHA
+
+// Delta encoding settings, only used by ENCODING_BINARY
+#define ENABLE_DELTA_ENCODING    false // Experimental: Only send analog values that changed, the driver must support it.
+#define DELTA_KEYFRAME_INTERVAL  50    // Send every value at least this often (frames).
+#define DELTA_FLEXION_THRESHOLD  2     // How far a finger must move before it is sent again.
+#define DELTA_SPLAY_THRESHOLD    2     // How far a splay value must move before it is sent again.
+#define DELTA_JOYSTICK_THRESHOLD 4     // How far a joystick axis must move before it is sent again.
 
 // Button Settings
 // If a button registers as pressed when not and vice versa (eg. using normally-closed switches),
@@ -36,6 +56,13 @@
 #define INVERT_TRIGGER  false // Does nothing if gesture is enabled
 #define INVERT_GRAB     false // Does nothing if gesture is enabled
 #define INVERT_PINCH    false // Does nothing if gesture is enabled
+// How many loops in a row a button must read pressed or released before it changes (1 to 8).
+// Filters out contact bounce, 1 turns it off.
+#define BUTTON_DEBOUNCE_SAMPLES 2
+// Experimental: Catch button edges with pin change interrupts instead of reading the pins every
+// loop, so a tap between two loops isn't missed. Takes the PCINT vectors on AVR.
+#define ENABLE_BUTTON_INTERRUPTS false
+#define BUTTON_LOCKOUT_TIME      5 // Edges this soon after a press or release are bounce (ms). Replaces BUTTON_DEBOUNCE_SAMPLES.
 
 // Joystick configuration
 #define ENABLE_JOYSTICK   true // Set to false if not using the joystick
@@ -54,6 +81,12 @@
 #define GRAB_GESTURE    true
 #define PINCH_GESTURE   (true && ENABLE_THUMB) // Cannot be enabled if there is no thumb
 
+// A gesture presses when its fingers flex past the press threshold and releases when they come
+// back under the release threshold. The gap between them stops it flickering at the threshold.
+#define GESTURE_PRESS_THRESHOLD   (ANALOG_MAX * 11 / 20) // 55% flexed
+#define GESTURE_RELEASE_THRESHOLD (ANALOG_MAX * 9 / 20)  // 45% flexed
+#define ENABLE_TRIGGER_VALUE      false // Experimental: Also send how far the trigger gesture is pulled, the driver must support it.
+
 // Force Feedback and haptic settings
 // Force feedback allows you to feel the solid objects you hold
 // Haptics provide vibration.
@@ -78,9 +111,17 @@
 #define FORCE_FEEDBACK_MAX        1000 // Value of 1000 means maximum limit.
 #define FORCE_FEEDBACK_RELEASE      50 // To prevent hardware damage, value passed the limit for when to release FFB. (Set to FORCE_FEEDBACK_MAX to disable)
 
+// Experimental: Move the FFB servos smoothly to each new limit instead of jumping there.
+// The speed and acceleration can also be set for each finger where the servos are made in HardwareConfig.hpp.
+#define ENABLE_FORCE_FEEDBACK_MOTION    false
+#define FORCE_FEEDBACK_MAX_SPEED        300  // Fastest servo move (% of its range per second).
+#define FORCE_FEEDBACK_MAX_ACCELERATION 3000 // Fastest change in speed (% of its range per second^2).
+#define FORCE_FEEDBACK_MOTION_RATE      1000 // How often the motion is stepped (Hz).
+
 // Counts of objects in the system used for looping
 // Inputs
 #define GESTURE_COUNT        (TRIGGER_GESTURE + GRAB_GESTURE + PINCH_GESTURE)
+#define GESTURE_VALUE_COUNT  (TRIGGER_GESTURE && ENABLE_TRIGGER_VALUE)
 #define FINGER_COUNT         (ENABLE_THUMB ? 5 : 4)
 #define JOYSTICK_COUNT       (ENABLE_JOYSTICK ? 2 : 0)
 #define BUTTON_COUNT         (4 + ENABLE_JOYSTICK + !TRIGGER_GESTURE + !GRAB_GESTURE + !PINCH_GESTURE)
@@ -89,8 +130,11 @@
 #define FORCE_FEEDBACK_COUNT (ENABLE_FORCE_FEEDBACK ? FINGER_COUNT : 0)
 // Used for array allocations.
 #define MAX_INPUT_COUNT      (BUTTON_COUNT+FINGER_COUNT+JOYSTICK_COUNT+GESTURE_COUNT)
+#define ANALOG_CHANNEL_COUNT (FINGER_COUNT * (ENABLE_SPLAY ? 2 : 1) + JOYSTICK_COUNT)
 #define MAX_CALIBRATED_COUNT FINGER_COUNT
 #define MAX_OUTPUT_COUNT     (HAPTIC_COUNT + FORCE_FEEDBACK_COUNT)
+// Character that ends every message in the selected encoding.
+#define ENCODING_DELIMITER   (ENCODING == ENCODING_BINARY ? '\0' : '\n')
 
 //PINS CONFIGURATION
 #if defined(__AVR__)
@@ -154,9 +198,21 @@
 #endif
 
 // Advanced Config. Don't touch this unless you know what you are doing. Only for the pros XD
-#define LOOP_TIME          4 //How much time between data sends (ms), set to 0 for a good time :)
+#define LOOP_TIME          4 //How much time between the start of each data send (ms), set to 0 for a good time :)
 #define CALIBRATION_LOOPS -1 //How many loops should be calibrated. Set to -1 to always be calibrated.
 
+// Save the calibration and restore it at power up, so the glove doesn't need calibrating every time.
+#define ENABLE_CALIBRATION_STORAGE false
+#define CALIBRATION_SAVE_DELAY     10000 //Save once the calibration stops changing for this long (ms).
+#define CALIBRATION_CHECK_INTERVAL 1000  //How often to check the calibration for changes (ms).
+#define CALIBRATION_EEPROM_ADDRESS 0     //Where the calibration is stored on boards with an EEPROM.
+
+// Experimental, ESP32 only: Read the sensors on one core and talk to the driver on the other,
+// so a slow Bluetooth or WiFi send doesn't delay the next sample. Only the newest frame is sent.
+#define ENABLE_DUAL_CORE false
+#define SAMPLING_CORE    1 //Core that reads the inputs and drives the outputs.
+#define TRANSPORT_CORE   0 //Core that talks to the driver, the radio stacks also run here.
+
 //Automatically set ANALOG_MAX depending on the microcontroller
 #if defined(__AVR__)
 #define ANALOG_MAX 1023
@@ -178,7 +234,49 @@
 #define CLAMP_MIN     0           // Minimum value from the flexion sensors
 #define CLAMP_MAX     ANALOG_MAX  // Maximum value from the flexion sensors
 
-// You must install RunningMedian library to use this feature
-// https://www.arduino.cc/reference/en/libraries/runningmedian/
+// Average several ADC readings for each value. Noise drops by the square root of the count.
+#define OVERSAMPLING_COUNT      1 //readings averaged per value, a power of two from 1 to 64
+#define OVERSAMPLING_EXTRA_BITS 0 //extra bits of finger resolution to keep from the average, each needs 4x the readings (0 to 3)
+#define OVERSAMPLING_CORE       0 //ESP32: core that takes the readings in the background, so the loop doesn't wait on them.
+
 #define ENABLE_MEDIAN_FILTER false //use the median of the previous values, helps reduce noise
-#define MEDIAN_SAMPLES 20
+#define MEDIAN_SAMPLES 20 //number of previous values to take the median of (1 to 127)
+
+// Smooths noise when fingers are still without adding lag when they move.
+// Can be combined with the median filter, which is applied first.
+#define ENABLE_ADAPTIVE_FILTER       false
+#define ADAPTIVE_FILTER_MIN_CUTOFF   1.0   // Cutoff frequency when still (Hz), lower is smoother
+#define ADAPTIVE_FILTER_BETA         0.005 // How fast the cutoff rises with speed, higher has less lag
+#define ADAPTIVE_FILTER_SPEED_CUTOFF 1.0   // Cutoff frequency for the speed estimate (Hz)
+
+// Time each stage of the loop. The driver can ask for the timings with the telemetry key.
+#define ENABLE_PROFILING false
+
+// Add the time the inputs were read and a frame number to every frame, eg. "...T81234567U42",
+// so the driver can measure latency. The driver must support it.
+#define ENABLE_FRAME_TIMING  false
+// Answer pings from the driver with when the command arrived and when it reached the outputs.
+#define ENABLE_LATENCY_PROBE false
+
+// Experimental: Also send a log of the raw sensor readings and the commands received, so a
+// session can be replayed without the glove. Needs ENCODING_BINARY and a link with room to spare.
+#define ENABLE_RECORDING false
+
+#if ENABLE_DUAL_CORE && !defined(ESP32)
+#error "ENABLE_DUAL_CORE needs a dual core board like the ESP32."
+#endif
+#if ENABLE_DUAL_CORE && ENABLE_PROFILING
+#error "Profiling times the single core loop, disable ENABLE_DUAL_CORE to use it."
+#endif
+#if ENABLE_DUAL_CORE && ENABLE_LATENCY_PROBE
+#error "The latency probe answers from the single core loop, disable ENABLE_DUAL_CORE to use it."
+#endif
+#if ENABLE_BUTTON_INTERRUPTS && !defined(__AVR__) && !defined(ESP32)
+#error "ENABLE_BUTTON_INTERRUPTS needs an AVR or ESP32 board."
+#endif
+#if ENABLE_RECORDING && ENCODING != ENCODING_BINARY
+#error "Recording sends binary records, set ENCODING to ENCODING_BINARY to use it."
+#endif
+#if ENABLE_RECORDING && ENABLE_DUAL_CORE
+#error "Recording runs in the single core loop, disable ENABLE_DUAL_CORE to use it."
+#endif
@@ -1,5 +1,12 @@
 #pragma once
 
+#include "Config.h"
+
+#include <limits.h>
+#include <stdint.h>
+
+struct BinaryFrame;
+
 struct EncodedInput {
   enum Type : char {
     THUMB = 'A',
@@ -16,7 +23,13 @@ struct EncodedInput {
     GRAB = 'L',
     PINCH = 'M',
     MENU = 'N',
-    CALIBRATE = 'O'
+    CALIBRATE = 'O',
+    TRIGGER_VALUE = 'P',
+    // Not inputs, the timing fields at the end of a frame, see FrameTiming.
+    FRAME_TIME = 'T',
+    FRAME_NUMBER = 'U',
+    // No key, eg. for a gesture without a value.
+    NONE = 0
   };
 
 
@@ -30,6 +43,9 @@ struct EncodedInput {
   // Encode the input to a strin the driver can understand.
   virtual int encode(char* output) const = 0;
 
+  // Add the input's state to a frame for the binary encoding.
+  virtual void encodeBinary(BinaryFrame& frame) const = 0;
+
   // Update internal data from any sensors or whatever the
   // input represents. This should be called every loop.
   virtual void readInput() = 0;
@@ -44,28 +60,198 @@ struct DecodedOuput {
     FFB_PINKY = 'E',
     HAPTIC_FREQ = 'F',
     HAPTIC_DURATION = 'G',
-    HAPTIC_AMPLITUDE = 'H'
+    HAPTIC_AMPLITUDE = 'H',
+    TELEMETRY = 'I',
+    PING = 'J'
   };
 
   // Setup any hardware needed for the output here.
   virtual void setupOutput() {};
 
-  // This function feeds a string from the driver
-  // to the output. The output should update any state
-  // if its key is present in the string.
-  virtual void decodeToOuput(const char* input) = 0;
+  // Whether the output wants the values sent for a key.
+  virtual bool ownsKey(DecodedOuput::Type key) const = 0;
+
+  // This function feeds a single decoded value from the
+  // driver to the output. It is only called for keys the
+  // output owns.
+  virtual void decodeValue(DecodedOuput::Type key, int value) = 0;
 
   // Use any internal state to update the output.
   // This should be called every loop.
   virtual void updateOutput() = 0;
 };
 
-int encodeAll(char* output, EncodedInput* encoders[], size_t count) {
-  int offset = 0;
-  // Loop over all of the encoders and encode them to the output string.
-  for (size_t i = 0; i < count; i++) {
+// Number of keys the driver can send values for.
+#define DECODED_KEY_COUNT (DecodedOuput::Type::PING - 'A' + 1)
+
+// Lookup table from a key sent by the driver to the output that owns it.
+class OutputDispatchTable {
+ public:
+  OutputDispatchTable() {
+    for (uint8_t key = 0; key < DECODED_KEY_COUNT; key++) {
+      owners[key] = NULL;
+    }
+  }
+
+  // Take ownership of every key the output claims.
+  void registerOutput(DecodedOuput* output) {
+    for (uint8_t key = 0; key < DECODED_KEY_COUNT; key++) {
+      if (output->ownsKey(static_cast<DecodedOuput::Type>('A' + key))) {
+        owners[key] = output;
+      }
+    }
+  }
+
+  // Pass the value to the owner of the key, if there is one.
+  void dispatch(char key, int value) const {
+    uint8_t index = key - 'A';
+    if (index < DECODED_KEY_COUNT && owners[index] != NULL) {
+      owners[index]->decodeValue(static_cast<DecodedOuput::Type>(key), value);
+    }
+  }
+
+ private:
+  DecodedOuput* owners[DECODED_KEY_COUNT];
+};
+
+// Powers of ten used by encodeInteger, largest first.
+static const unsigned int POWERS_OF_TEN[] = {
+  #if UINT_MAX > 0xFFFF
+    1000000000u, 100000000u, 10000000u, 1000000u, 100000u,
+  #endif
+  10000u, 1000u, 100u, 10u
+};
+
+// Powers of ten used by encodeUnsigned, largest first.
+static const unsigned long LONG_POWERS_OF_TEN[] = {
+  1000000000ul, 100000000ul, 10000000ul, 1000000ul, 100000ul,
+  10000ul, 1000ul, 100ul, 10ul
+};
+
+// Write the digits of a value using a table of powers of ten. Digits are
+// produced by repeated subtraction, which is much cheaper than division on
+// boards without a hardware divider.
+template<typename T, size_t N>
+int encodeDigits(char* output, T remainder, const T (&powers)[N]) {
+  char* cursor = output;
+
+  // Skip the leading zeros.
+  size_t i = 0;
+  while (i < N && remainder < powers[i]) i++;
+
+  for (; i < N; i++) {
+    char digit = '0';
+    while (remainder >= powers[i]) {
+      remainder -= powers[i];
+      digit++;
+    }
+    *cursor++ = digit;
+  }
+  *cursor++ = '0' + remainder;
+
+  return cursor - output;
+}
+
+// Write the decimal representation of a value to the output without going
+// through snprintf.
+// Returns the number of characters written, no null terminator is added.
+int encodeInteger(char* output, int value) {
+  unsigned int remainder = value;
+  if (value < 0) {
+    *output = '-';
+    return 1 + encodeDigits(output + 1, 0u - remainder, POWERS_OF_TEN);
+  }
+  return encodeDigits(output, remainder, POWERS_OF_TEN);
+}
+
+// Same as encodeInteger for values that may not fit in an int, eg. timestamps.
+int encodeUnsigned(char* output, unsigned long value) {
+  return encodeDigits(output, value, LONG_POWERS_OF_TEN);
+}
+
+// Encode a single key followed by its value, eg. "A1023".
+// This matches the "%c%d" format the driver expects.
+int encodeKeyValue(char* output, char key, int value) {
+  output[0] = key;
+  return 1 + encodeInteger(output + 1, value);
+}
+
+// Visitors for the inputs and outputs of a registry, see HardwareConfig.hpp.
+// They make qualified calls on the concrete type, which aren't virtual and
+// can be inlined.
+struct SetupInput {
+  template<typename T>
+  void operator()(T& input) const {
+    input.T::setupInput();
+  }
+};
+
+struct ReadInput {
+  template<typename T>
+  void operator()(T& input) const {
+    input.T::readInput();
+  }
+};
+
+struct SetupOutput {
+  template<typename T>
+  void operator()(T& output) const {
+    output.T::setupOutput();
+  }
+};
+
+struct UpdateOutput {
+  template<typename T>
+  void operator()(T& output) const {
+    output.T::updateOutput();
+  }
+};
+
+// When the inputs of a frame were read, so the driver can measure latency.
+// The time is micros() on the glove and wraps like it, the number counts
+// the frames sent and wraps at 16 bits. A gap in the numbers is a frame
+// the link dropped.
+//
+// In the alpha encoding they are the last fields, eg. "T81234567U42".
+struct FrameTiming {
+  // Longest encoding of the fields, "T<10 digits>U<5 digits>".
+  static constexpr int ENCODED_SIZE = 1 + 10 + 1 + 5;
+
+  unsigned long sample_time;
+  uint16_t number;
+
+  int encode(char* output) const {
+    int offset = 0;
+    output[offset++] = EncodedInput::Type::FRAME_TIME;
+    offset += encodeUnsigned(output + offset, sample_time);
+    output[offset++] = EncodedInput::Type::FRAME_NUMBER;
+    offset += encodeUnsigned(output + offset, number);
+    return offset;
+  }
+};
+
+// Appends each input to the output string.
+struct AlphaEncoder {
+  char* output;
+  int offset;
+
+  template<typename T>
+  void operator()(const T& input) {
     // The offset is the total charecters already added to the string.
-    offset += encoders[i]->encode(output+offset);
+    offset += input.T::encode(output + offset);
+  }
+};
+
+// Encode all of the inputs in the registry to a single string, followed
+// by the frame timing if there is one.
+template<typename Inputs>
+int encodeAll(char* output, const FrameTiming* timing = NULL) {
+  AlphaEncoder encoder = {output, 0};
+  Inputs::forEach(encoder);
+  int offset = encoder.offset;
+
+  if (timing != NULL) {
+    offset += timing->encode(output + offset);
   }
 
   // Add a new line to the end of the encoded string.
@@ -74,3 +260,348 @@ int encodeAll(char* output, EncodedInput* encoders[], size_t count) {
 
   return offset;
 }
+
+// Number of bits needed to represent a value.
+constexpr uint8_t bitsRequired(unsigned long value) {
+  return value == 0 ? 0 : 1 + bitsRequired(value >> 1);
+}
+
+// Analog values are sent at the native resolution of the ADC in the binary encoding.
+constexpr uint8_t ANALOG_BITS = bitsRequired(ANALOG_MAX);
+
+// The state of all the inputs for the binary encoding.
+//
+// Frame layout before framing, all fields big endian:
+//   uint16 analog mask  - bit n set if analog channel n is present, bit 15 is
+//                         set if the frame is a keyframe with every channel,
+//                         bit 14 is set if the frame timing is present.
+//   uint16 digital bits - bit n set if the input with key 'A' + n is pressed.
+//   uint32 sample time, uint16 frame number - only with bit 14, see FrameTiming.
+//   Each present analog channel in channel order, packed at ANALOG_BITS each.
+//
+// Analog channels 0-6 are the keys 'A' to 'G', channels 7-11 are the
+// splay values of the fingers 'A' to 'E' and channel 12 is the trigger value.
+struct BinaryFrame {
+  enum : uint8_t {
+    SPLAY_CHANNEL_OFFSET = 7,
+    TRIGGER_VALUE_CHANNEL = 12,
+    ANALOG_CHANNELS = 13
+  };
+
+  static const uint16_t KEYFRAME_FLAG = 1u << 15;
+  static const uint16_t TIMING_FLAG = 1u << 14;
+
+  BinaryFrame() : analog_mask(0), digital(0), keyframe(true), timing(NULL) {}
+
+  void setAnalog(EncodedInput::Type key, int value) {
+    setChannel(key == EncodedInput::Type::TRIGGER_VALUE ? TRIGGER_VALUE_CHANNEL : key - 'A', value);
+  }
+
+  void setSplay(EncodedInput::Type key, int value) {
+    setChannel(SPLAY_CHANNEL_OFFSET + key - 'A', value);
+  }
+
+  void setDigital(EncodedInput::Type key, bool pressed) {
+    if (pressed) digital |= 1u << (key - 'A');
+  }
+
+  bool hasChannel(uint8_t channel) const {
+    return analog_mask & (1u << channel);
+  }
+
+  int channelValue(uint8_t channel) const {
+    return analog[channel];
+  }
+
+  // Leave a channel out of the frame, eg. because it hasn't changed.
+  void dropChannel(uint8_t channel) {
+    analog_mask &= ~(1u << channel);
+  }
+
+  void setKeyframe(bool is_keyframe) {
+    keyframe = is_keyframe;
+  }
+
+  // Add the timing to the frame, it must outlive the frame.
+  void setTiming(const FrameTiming* frame_timing) {
+    timing = frame_timing;
+  }
+
+  // Write the frame to the output. Returns the number of bytes written.
+  size_t pack(uint8_t* output) const {
+    uint16_t mask = keyframe ? analog_mask | KEYFRAME_FLAG : analog_mask;
+    if (timing != NULL) mask |= TIMING_FLAG;
+    output[0] = mask >> 8;
+    output[1] = mask & 0xFF;
+    output[2] = digital >> 8;
+    output[3] = digital & 0xFF;
+
+    size_t offset = 4;
+    if (timing != NULL) {
+      output[offset++] = timing->sample_time >> 24;
+      output[offset++] = (timing->sample_time >> 16) & 0xFF;
+      output[offset++] = (timing->sample_time >> 8) & 0xFF;
+      output[offset++] = timing->sample_time & 0xFF;
+      output[offset++] = timing->number >> 8;
+      output[offset++] = timing->number & 0xFF;
+    }
+
+    uint8_t pending = 0;
+    uint8_t pending_bits = 0;
+    for (uint8_t channel = 0; channel < ANALOG_CHANNELS; channel++) {
+      if (!(analog_mask & (1u << channel))) continue;
+
+      // Shift the value in most significant bit first.
+      for (int8_t bit = ANALOG_BITS - 1; bit >= 0; bit--) {
+        pending = (pending << 1) | ((analog[channel] >> bit) & 1);
+        if (++pending_bits == 8) {
+          output[offset++] = pending;
+          pending_bits = 0;
+        }
+      }
+    }
+
+    // Left align any partially filled byte.
+    if (pending_bits > 0) {
+      output[offset++] = pending << (8 - pending_bits);
+    }
+
+    return offset;
+  }
+
+ private:
+  void setChannel(uint8_t channel, int value) {
+    analog_mask |= 1u << channel;
+    analog[channel] = constrain(value, 0, ANALOG_MAX);
+  }
+
+  uint16_t analog_mask;
+  uint16_t digital;
+  bool keyframe;
+  const FrameTiming* timing;
+  int analog[ANALOG_CHANNELS];
+};
+
+// Drops the analog channels of a binary frame that haven't moved more than
+// their threshold since they were last sent. The driver keeps the last value
+// for any channel missing from a frame. Every channel is sent in a keyframe
+// at least every keyframe_interval frames, or when one is requested.
+class DeltaFilter {
+ public:
+  DeltaFilter(uint16_t keyframe_interval) :
+    keyframe_interval(keyframe_interval), frames_since_keyframe(0),
+    keyframe_requested(true), sent_mask(0) {
+    for (uint8_t channel = 0; channel < BinaryFrame::ANALOG_CHANNELS; channel++) {
+      if (channel == BinaryFrame::TRIGGER_VALUE_CHANNEL) {
+        thresholds[channel] = DELTA_FLEXION_THRESHOLD;
+      } else if (channel >= BinaryFrame::SPLAY_CHANNEL_OFFSET) {
+        thresholds[channel] = DELTA_SPLAY_THRESHOLD;
+      } else if (channel >= EncodedInput::Type::JOY_X - 'A') {
+        thresholds[channel] = DELTA_JOYSTICK_THRESHOLD;
+      } else {
+        thresholds[channel] = DELTA_FLEXION_THRESHOLD;
+      }
+    }
+  }
+
+  void setThreshold(uint8_t channel, int threshold) {
+    thresholds[channel] = threshold;
+  }
+
+  // Send every channel in the next frame.
+  void requestKeyframe() {
+    keyframe_requested = true;
+  }
+
+  void apply(BinaryFrame& frame) {
+    bool keyframe = keyframe_requested || ++frames_since_keyframe >= keyframe_interval;
+    if (keyframe) {
+      keyframe_requested = false;
+      frames_since_keyframe = 0;
+    }
+    frame.setKeyframe(keyframe);
+
+    for (uint8_t channel = 0; channel < BinaryFrame::ANALOG_CHANNELS; channel++) {
+      if (!frame.hasChannel(channel)) continue;
+
+      const uint16_t bit = 1u << channel;
+      const int value = frame.channelValue(channel);
+      if (!keyframe && (sent_mask & bit) && abs(value - last_sent[channel]) <= thresholds[channel]) {
+        // The driver already has a close enough value.
+        frame.dropChannel(channel);
+        continue;
+      }
+
+      last_sent[channel] = value;
+      sent_mask |= bit;
+    }
+  }
+
+ private:
+  uint16_t keyframe_interval;
+  uint16_t frames_since_keyframe;
+  bool keyframe_requested;
+  uint16_t sent_mask;
+  int thresholds[BinaryFrame::ANALOG_CHANNELS];
+  int last_sent[BinaryFrame::ANALOG_CHANNELS];
+};
+
+// Largest unframed binary frame, with the timing and every channel present.
+#define BINARY_FRAME_MAX_SIZE (4 + 6 + (BinaryFrame::ANALOG_CHANNELS * ANALOG_BITS + 7) / 8)
+// Largest binary frame after COBS framing, including the delimiter.
+#define BINARY_ENCODED_MAX_SIZE (BINARY_FRAME_MAX_SIZE + BINARY_FRAME_MAX_SIZE / 254 + 2)
+// Largest binary command from the driver, a 16 bit key mask followed by a
+// 16 bit value for each of the keys.
+#define BINARY_COMMAND_MAX_SIZE (2 + DECODED_KEY_COUNT * 2)
+
+// Consistent Overhead Byte Stuffing. Removes all zeros from the input
+// so that a zero can be used to delimit frames. The output needs to be
+// at least length + length / 254 + 1 bytes.
+// Returns the number of bytes written.
+size_t cobsEncode(const uint8_t* input, size_t length, uint8_t* output) {
+  size_t code_index = 0;
+  size_t offset = 1;
+  uint8_t code = 1;
+  for (size_t i = 0; i < length; i++) {
+    if (input[i] != 0) {
+      output[offset++] = input[i];
+      code++;
+    }
+
+    // Close the block on a zero or when it is full.
+    if (input[i] == 0 || code == 0xFF) {
+      output[code_index] = code;
+      code = 1;
+      code_index = offset++;
+    }
+  }
+  output[code_index] = code;
+  return offset;
+}
+
+// Reverse of cobsEncode. The input should not include the delimiter.
+// Returns the number of bytes written, or 0 if the input is malformed.
+size_t cobsDecode(const uint8_t* input, size_t length, uint8_t* output) {
+  size_t in = 0;
+  size_t out = 0;
+  while (in < length) {
+    uint8_t code = input[in++];
+    if (code == 0 || in + code - 1 > length) return 0;
+
+    for (uint8_t i = 1; i < code; i++) {
+      output[out++] = input[in++];
+    }
+
+    // Every block except full and final ones was ended by a zero.
+    if (code != 0xFF && in < length) {
+      output[out++] = 0;
+    }
+  }
+  return out;
+}
+
+// Frame a message that isn't an input frame, eg. telemetry, for the
+// selected encoding. The output needs room for length + length / 254 + 2
+// bytes. Returns the number of bytes to send.
+int encodeMessage(char* output, const char* message, size_t length) {
+  #if ENCODING == ENCODING_BINARY
+    int offset = cobsEncode(reinterpret_cast<const uint8_t*>(message), length, reinterpret_cast<uint8_t*>(output));
+  #else
+    memcpy(output, message, length);
+    int offset = length;
+  #endif
+  output[offset++] = ENCODING_DELIMITER;
+  return offset;
+}
+
+// Adds each input to a binary frame.
+struct BinaryEncoder {
+  BinaryFrame& frame;
+
+  template<typename T>
+  void operator()(const T& input) {
+    input.T::encodeBinary(frame);
+  }
+};
+
+template<typename Inputs>
+int encodeAllBinary(char* output, DeltaFilter* delta = NULL, const FrameTiming* timing = NULL) {
+  // Collect the state of all of the inputs.
+  BinaryFrame frame;
+  BinaryEncoder encoder = {frame};
+  Inputs::forEach(encoder);
+  frame.setTiming(timing);
+
+  // Only keep the channels that changed.
+  if (delta != NULL) {
+    delta->apply(frame);
+  }
+
+  uint8_t packed[BINARY_FRAME_MAX_SIZE];
+  size_t size = frame.pack(packed);
+
+  // Frame the packed data and add the delimiter.
+  int offset = cobsEncode(packed, size, reinterpret_cast<uint8_t*>(output));
+  output[offset++] = '\0';
+
+  return offset;
+}
+
+// Decode a line from the driver in a single pass, passing each key
+// and the integer that follows it to the owning output. Only the first
+// value for each key is used, anything else on the line is skipped.
+void decodeAll(const char* input, const OutputDispatchTable& table) {
+  uint16_t seen = 0;
+  const char* cursor = input;
+  while (*cursor != '\0') {
+    char key = *cursor++;
+    if (key < 'A' || key > 'Z') continue;
+
+    bool negative = *cursor == '-';
+    if (negative) cursor++;
+
+    int value = 0;
+    while (*cursor >= '0' && *cursor <= '9') {
+      value = value * 10 + (*cursor++ - '0');
+    }
+
+    uint8_t index = key - 'A';
+    if (index < DECODED_KEY_COUNT && !(seen & (1u << index))) {
+      seen |= 1u << index;
+      table.dispatch(key, negative ? -value : value);
+    }
+  }
+}
+
+// Decode a COBS framed command from the driver and pass each value to the
+// outputs. The input should not include the delimiter. A command without
+// any values is a request for a keyframe.
+// Returns the number of values decoded, or -1 if the command is malformed.
+int decodeAllBinary(const char* input, size_t length, const OutputDispatchTable& table) {
+  if (length == 0 || length > BINARY_COMMAND_MAX_SIZE + 1) return -1;
+
+  uint8_t command[BINARY_COMMAND_MAX_SIZE + 1];
+  size_t size = cobsDecode(reinterpret_cast<const uint8_t*>(input), length, command);
+  if (size < 2) return -1;
+
+  // Make sure the command has a value for every key in the mask.
+  const uint16_t mask = (command[0] << 8) | command[1];
+  size_t expected_size = 2;
+  for (uint8_t key = 0; key < DECODED_KEY_COUNT; key++) {
+    if (mask & (1u << key)) expected_size += 2;
+  }
+  if (size != expected_size) return -1;
+
+  int decoded = 0;
+  size_t offset = 2;
+  for (uint8_t key = 0; key < DECODED_KEY_COUNT; key++) {
+    if (!(mask & (1u << key))) continue;
+
+    int value = (command[offset] << 8) | command[offset + 1];
+    offset += 2;
+    decoded++;
+    table.dispatch('A' + key, value);
+  }
+
+  return decoded;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+
+// Passes events from one interrupt to the loop, or from one core to the
+// other, in order and without locks.
+//
+// Only the producer moves the head and only the consumer moves the tail.
+// Each publishes its index with a release store after it is done with the
+// slot, so the other side never sees a slot half written. The GCC atomic
+// builtins are used because the AVR has no <atomic>, a single byte is
+// always atomic there. One slot is kept empty to tell full from empty.
+template<typename T, uint8_t N>
+class EventQueue {
+  static_assert(N >= 2 && N <= 128 && (N & (N - 1)) == 0, "The queue size must be a power of two from 2 to 128");
+
+ public:
+  EventQueue() : head(0), tail(0) {}
+
+  // Producer: add an event. Returns false if the queue is full. Always
+  // inlined, so an interrupt kept in the ESP32's IRAM doesn't call flash.
+  __attribute__((always_inline)) bool push(const T& event) {
+    const uint8_t position = __atomic_load_n(&head, __ATOMIC_RELAXED);
+    const uint8_t next = (position + 1) & (N - 1);
+    if (next == __atomic_load_n(&tail, __ATOMIC_ACQUIRE)) return false;
+
+    slots[position] = event;
+    __atomic_store_n(&head, next, __ATOMIC_RELEASE);
+    return true;
+  }
+
+  // Consumer: take the oldest event. Returns false if there are none.
+  bool pop(T& event) {
+    const uint8_t position = __atomic_load_n(&tail, __ATOMIC_RELAXED);
+    if (position == __atomic_load_n(&head, __ATOMIC_ACQUIRE)) return false;
+
+    event = slots[position];
+    __atomic_store_n(&tail, (position + 1) & (N - 1), __ATOMIC_RELEASE);
+    return true;
+  }
+
+ private:
+  T slots[N];
+  uint8_t head;
+  uint8_t tail;
+};
@@ -2,35 +2,63 @@
 
 #include "Config.h"
 
+#include "AdaptiveFilter.hpp"
+#include "AnalogSampler.hpp"
 #include "Calibration.hpp"
 #include "DriverProtocol.hpp"
+#include "MedianFilter.hpp"
 
-#if ENABLE_MEDIAN_FILTER
-  #include <RunningMedian.h>
-#endif
+// The filters enabled in the config, applied in order to each
+// raw finger reading.
+class FingerFilter {
+ public:
+  int filter(int value) {
+    #if ENABLE_MEDIAN_FILTER
+      median.add(value);
+      value = median.getMedian();
+    #endif
+
+    #if ENABLE_ADAPTIVE_FILTER
+      value = adaptive.filter(value);
+    #endif
+
+    return value;
+  }
+
+ private:
+  #if ENABLE_MEDIAN_FILTER
+    MedianFilter<int, MEDIAN_SAMPLES> median;
+  #endif
+
+  #if ENABLE_ADAPTIVE_FILTER
+    AdaptiveFilter adaptive;
+  #endif
+};
 
 class Finger : public EncodedInput, public Calibrated {
  public:
   Finger(EncodedInput::Type enc_type, int pin) :
     type(enc_type), pin(pin), value(0),
-    median(MEDIAN_SAMPLES), calibrator(0, ANALOG_MAX, CLAMP_ANALOG_MAP) {}
+    calibrator(0, ANALOG_MAX, CLAMP_ANALOG_MAP) {}
+
+  void setupInput() override {
+    channel = analog_sampler.addChannel(pin);
+  }
 
   void readInput() override {
     // Read the latest value.
-    int new_value = analogRead(pin);
+    int new_value = analog_sampler.readOversampled(channel);
 
     // Apply configured modifiers.
     #if INVERT_FLEXION
-      new_value = ANALOG_MAX - new_value;
+      new_value = OVERSAMPLED_MAX - new_value;
     #endif
 
-    #if ENABLE_MEDIAN_FILTER
-      median.add(new_value);
-      new_value = median.getMedian();
-    #endif
+    new_value = filter.filter(new_value);
 
     #if CLAMP_FLEXION
-      new_value = constrain(new_value, CLAMP_MIN, CLAMP_MAX);
+      new_value = constrain(new_value, static_cast<long>(CLAMP_MIN) << OVERSAMPLING_EXTRA_BITS,
+                            static_cast<long>(CLAMP_MAX) << OVERSAMPLING_EXTRA_BITS);
     #endif
 
     // Update the calibration
@@ -42,20 +70,37 @@ class Finger : public EncodedInput, public Calibrated {
     value = calibrator.calibrate(new_value, 0, ANALOG_MAX);
   }
 
+  // Encode string size = AXXXX + '\0'
+  static constexpr int ENCODED_SIZE = 6;
+
   inline int getEncodedSize() const override {
-    // Encode string size = AXXXX + '\0'
-    return 6;
+    return ENCODED_SIZE;
   }
 
   int encode(char* output) const override {
-    return snprintf(output, getEncodedSize(), "%c%d", type, value);
+    return encodeKeyValue(output, type, value);
+  }
+
+  void encodeBinary(BinaryFrame& frame) const override {
+    frame.setAnalog(type, value);
   }
 
   void resetCalibration() override {
     calibrator.reset();
   }
 
-  virtual int flexionValue() const {
+  uint8_t saveCalibration(CalibrationRange* ranges) const override {
+    ranges[0].min = calibrator.minimum();
+    ranges[0].max = calibrator.maximum();
+    return 1;
+  }
+
+  uint8_t loadCalibration(const CalibrationRange* ranges) override {
+    calibrator.restore(ranges[0].min, ranges[0].max);
+    return 1;
+  }
+
+  int flexionValue() const {
     return value;
   }
 
@@ -68,14 +113,10 @@ class Finger : public EncodedInput, public Calibrated {
  protected:
   EncodedInput::Type type;
   int pin;
+  uint8_t channel;
   int value;
 
-  #if ENABLE_MEDIAN_FILTER
-    RunningMedian median;
-  #else
-    int median;
-  #endif
-
+  FingerFilter filter;
   MinMaxCalibrator<int> calibrator;
 };
 
@@ -85,9 +126,17 @@ class SplayFinger : public Finger {
     Finger(enc_type, pin), splay_pin(splay_pin), splay_value(0),
     splay_calibrator(0, ANALOG_MAX, CLAMP_ANALOG_MAP) {}
 
+  void setupInput() override {
+    Finger::setupInput();
+    splay_channel = analog_sampler.addChannel(splay_pin);
+  }
+
   void readInput() override {
     Finger::readInput();
-    int new_splay_value = analogRead(splay_pin);
+    int new_splay_value = analog_sampler.readOversampled(splay_channel);
+
+    new_splay_value = splay_filter.filter(new_splay_value);
+
     // Update the calibration
     if (calibrate) {
       splay_calibrator.update(new_splay_value);
@@ -97,21 +146,55 @@ class SplayFinger : public Finger {
     splay_value = splay_calibrator.calibrate(new_splay_value, 0, ANALOG_MAX);
   }
 
+  // Encoded string size = AXXXX(AB)XXXX + '\0'
+  static constexpr int ENCODED_SIZE = 14;
+
   inline int getEncodedSize() const override {
-    // Encoded string size = AXXXX(AB)XXXX + '\0'
-    return 14;
+    return ENCODED_SIZE;
   }
 
   int encode(char* output) const override {
-    return snprintf(output, getEncodedSize(), "%c%d(%cB)%d", type, value, type, splay_value);
+    // Encoded as AXXXX(AB)XXXX
+    int offset = encodeKeyValue(output, type, value);
+    output[offset++] = '(';
+    output[offset++] = type;
+    output[offset++] = 'B';
+    output[offset++] = ')';
+    return offset + encodeInteger(output + offset, splay_value);
   }
 
-  virtual int splayValue() const {
+  void encodeBinary(BinaryFrame& frame) const override {
+    Finger::encodeBinary(frame);
+    frame.setSplay(type, splay_value);
+  }
+
+  void resetCalibration() override {
+    Finger::resetCalibration();
+    splay_calibrator.reset();
+  }
+
+  uint8_t saveCalibration(CalibrationRange* ranges) const override {
+    uint8_t count = Finger::saveCalibration(ranges);
+    ranges[count].min = splay_calibrator.minimum();
+    ranges[count].max = splay_calibrator.maximum();
+    return count + 1;
+  }
+
+  uint8_t loadCalibration(const CalibrationRange* ranges) override {
+    uint8_t count = Finger::loadCalibration(ranges);
+    splay_calibrator.restore(ranges[count].min, ranges[count].max);
+    return count + 1;
+  }
+
+  int splayValue() const {
     return splay_value;
   }
 
  protected:
   int splay_pin;
+  uint8_t splay_channel;
   int splay_value;
+
+  FingerFilter splay_filter;
   MinMaxCalibrator<int> splay_calibrator;
 };
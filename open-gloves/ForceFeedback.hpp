@@ -2,6 +2,7 @@
 
 #include "DriverProtocol.hpp"
 #include "Finger.hpp"
+#include "MotionProfile.hpp"
 
 #if defined(ESP32)
   #include <ESP32Servo.h>
@@ -23,11 +24,12 @@ class ForceFeedback : public DecodedOuput {
  public:
   ForceFeedback(DecodedOuput::Type type, const Finger* finger) : type(type), finger(finger), limit(0) {}
 
-  void decodeToOuput(const char* input) override {
-    char* start = strchr(input, type);
-    if (start != NULL) {
-      limit = atoi(start + 1);
-    }
+  bool ownsKey(DecodedOuput::Type key) const override {
+    return key == type;
+  }
+
+  void decodeValue(DecodedOuput::Type key, int value) override {
+    limit = value;
   }
 
  protected:
@@ -37,22 +39,45 @@ class ForceFeedback : public DecodedOuput {
 };
 
 // Servo based force feedback that moves the servo to the limiting
-// postion.
+// postion. With ENABLE_FORCE_FEEDBACK_MOTION it moves there smoothly, no
+// faster than the speed and acceleration given in % of the servo's range.
 class ServoForceFeedback : public ForceFeedback {
  public:
   ServoForceFeedback(DecodedOuput::Type type,
                      const Finger* finger,
                      int servo_pin,
-                     bool invert) : ForceFeedback(type, finger), servo_pin(servo_pin), invert(invert) {}
+                     bool invert,
+                     long max_speed = FORCE_FEEDBACK_MAX_SPEED,
+                     long max_acceleration = FORCE_FEEDBACK_MAX_ACCELERATION) :
+    ForceFeedback(type, finger), servo_pin(servo_pin), invert(invert), written(0)
+    #if ENABLE_FORCE_FEEDBACK_MOTION
+      , motion(max_speed * SERVO_RANGE / 100, max_acceleration * SERVO_RANGE / 100,
+               1000000UL / FORCE_FEEDBACK_MOTION_RATE, SERVO_LOWEST, SERVO_HIGHEST)
+    #endif
+  {}
 
   void setupOutput() override {
     // Initialize the servo and move it to the unrestricted base limit.
     servo.attach(servo_pin);
-    servo.WRITE_FUNCTION(SERVO_MIN);
+    written = SERVO_MIN;
+    servo.WRITE_FUNCTION(written);
+    #if ENABLE_FORCE_FEEDBACK_MOTION
+      motion.reset(written, micros());
+    #endif
   };
 
   void updateOutput() override {
-    servo.WRITE_FUNCTION(scale(limit));
+    #if ENABLE_FORCE_FEEDBACK_MOTION
+      motion.setTarget(scale(limit));
+      int output = motion.update(micros());
+    #else
+      int output = scale(limit);
+    #endif
+
+    // The servo is already there.
+    if (output == written) return;
+    written = output;
+    servo.WRITE_FUNCTION(output);
   }
 
  protected:
@@ -73,8 +98,18 @@ class ServoForceFeedback : public ForceFeedback {
     #endif
   }
 
+  // Size of the servo's output range.
+  static constexpr long SERVO_RANGE = (SERVO_MAX) > (SERVO_MIN) ? (SERVO_MAX) - (SERVO_MIN) : (SERVO_MIN) - (SERVO_MAX);
+  // Ends of the servo's output range.
+  static constexpr int SERVO_LOWEST = (SERVO_MAX) > (SERVO_MIN) ? (SERVO_MIN) : (SERVO_MAX);
+  static constexpr int SERVO_HIGHEST = (SERVO_MAX) > (SERVO_MIN) ? (SERVO_MAX) : (SERVO_MIN);
+
   int servo_pin;
   bool invert;
+  int written;
+  #if ENABLE_FORCE_FEEDBACK_MOTION
+    MotionProfile motion;
+  #endif
   Servo servo;
 };
 
@@ -5,77 +5,112 @@
 #include "Finger.hpp"
 #include "DriverProtocol.hpp"
 
-class Gesture : public EncodedInput {
- public:
-  Gesture(EncodedInput::Type type) : type(type), value(false) {}
-
-  inline int getEncodedSize() const override {
-   // Encode string size = single char or '\0'
-    return 1;
-  }
-
-  int encode(char* output) const override {
-    if (value) output[0] = type;
-    return value ? 1 : 0;
-  }
-
-  bool isPressed() {
-    return value;
-  }
-
- protected:
-  const EncodedInput::Type type;
-  bool value;
+// Slots for the flexion of the thumb, index, middle, ring and pinky, the
+// thumb is left at zero without one.
+#define GESTURE_FINGER_SLOTS 5
+
+// A gesture pressed by flexing a weighted set of fingers. It presses once
+// the weighted average flexion goes over the press threshold and releases
+// once it falls under the release threshold, so it doesn't chatter while a
+// hand rests near a single threshold.
+struct GestureDefinition {
+  EncodedInput::Type type;
+  // Weight of each finger in the average, by slot.
+  uint8_t weights[GESTURE_FINGER_SLOTS];
+  int press_threshold;
+  int release_threshold;
+  // Key to also send the average flexion under, or NONE.
+  EncodedInput::Type value_key;
 };
 
-class GrabGesture : public Gesture {
- public:
-  GrabGesture(const Finger* index, const Finger* middle,
-              const Finger* ring, const Finger* pinky) :
-    Gesture(EncodedInput::Type::GRAB),
-    index(index), middle(middle), ring(ring), pinky(pinky)  {}
+// Evaluates every gesture in the table in one pass. The fingers are read
+// once into an array that all of the gestures share.
+template<typename FingerT>
+class GestureEngine : public EncodedInput {
+  static_assert(GESTURE_COUNT <= 8, "The pressed gestures are kept in 8 bits");
 
-  // Grab gesture is pressed if the average all fingers is more than
-  // halfway flexed.
-  void readInput() override {
-    value = (index->flexionValue() + middle->flexionValue() +
-             ring->flexionValue() + pinky->flexionValue()) / 4 > ANALOG_MAX / 2;
+ public:
+  GestureEngine(FingerT* const* fingers, const GestureDefinition* table) :
+    fingers(fingers), table(table), pressed(0) {
+    for (uint8_t slot = 0; slot < GESTURE_FINGER_SLOTS; slot++) {
+      flexion[slot] = 0;
+    }
+
+    for (uint8_t g = 0; g < GESTURE_COUNT; g++) {
+      int total = 0;
+      for (uint8_t slot = 0; slot < GESTURE_FINGER_SLOTS; slot++) {
+        total += table[g].weights[slot];
+      }
+      total_weights[g] = total > 0 ? total : 1;
+      values[g] = 0;
+    }
   }
 
- private:
-   const Finger* index;
-   const Finger* middle;
-   const Finger* ring;
-   const Finger* pinky;
-};
+  // Encode string size = a char for each gesture, and the key with up to 5 digits for each value.
+  static constexpr int ENCODED_SIZE = GESTURE_COUNT + GESTURE_VALUE_COUNT * 6;
 
-class TriggerGesture : public Gesture {
- public:
-  TriggerGesture(const Finger* index_finger) :
-    Gesture(EncodedInput::Type::TRIGGER), index_finger(index_finger) {}
+  inline int getEncodedSize() const override {
+    return ENCODED_SIZE;
+  }
 
-  // Trigger gesture is pressed if the index finger is more than halfway flexed
   void readInput() override {
-    value = index_finger->flexionValue() > ANALOG_MAX / 2;
+    // Without a thumb the fingers start at the index slot.
+    const uint8_t first_slot = GESTURE_FINGER_SLOTS - FINGER_COUNT;
+    for (uint8_t i = 0; i < FINGER_COUNT; i++) {
+      flexion[first_slot + i] = fingers[i]->flexionValue();
+    }
+
+    for (uint8_t g = 0; g < GESTURE_COUNT; g++) {
+      const GestureDefinition& gesture = table[g];
+      long sum = 0;
+      for (uint8_t slot = 0; slot < GESTURE_FINGER_SLOTS; slot++) {
+        sum += static_cast<long>(gesture.weights[slot]) * flexion[slot];
+      }
+
+      // Scale the thresholds by the total weight instead of dividing the sum.
+      const uint8_t bit = 1u << g;
+      if (pressed & bit) {
+        if (sum < static_cast<long>(gesture.release_threshold) * total_weights[g]) pressed &= ~bit;
+      } else {
+        if (sum > static_cast<long>(gesture.press_threshold) * total_weights[g]) pressed |= bit;
+      }
+
+      if (gesture.value_key != EncodedInput::Type::NONE) {
+        values[g] = sum / total_weights[g];
+      }
+    }
   }
 
- private:
-   const Finger* index_finger;
-};
+  int encode(char* output) const override {
+    int offset = 0;
+    for (uint8_t g = 0; g < GESTURE_COUNT; g++) {
+      if (pressed & (1u << g)) output[offset++] = table[g].type;
+      if (table[g].value_key != EncodedInput::Type::NONE) {
+        offset += encodeKeyValue(output + offset, table[g].value_key, values[g]);
+      }
+    }
+    return offset;
+  }
 
-class PinchGesture : public Gesture {
- public:
-  PinchGesture(const Finger* thumb, const Finger* index_finger) :
-    Gesture(EncodedInput::Type::PINCH), thumb(thumb), index_finger(index_finger) {}
+  void encodeBinary(BinaryFrame& frame) const override {
+    for (uint8_t g = 0; g < GESTURE_COUNT; g++) {
+      frame.setDigital(table[g].type, pressed & (1u << g));
+      if (table[g].value_key != EncodedInput::Type::NONE) {
+        frame.setAnalog(table[g].value_key, values[g]);
+      }
+    }
+  }
 
-  // Pinch gesture is pressed if the average flex of the thumb and index is more than
-  // halfway flexed.
-  void readInput() override {
-    // TODO: Do we need to divide both values here?
-    value = (thumb->flexionValue() + index_finger->flexionValue()) / 2 > ANALOG_MAX / 2;
+  // Whether the gesture at the index in the table is pressed.
+  bool isPressed(uint8_t index) const {
+    return pressed & (1u << index);
   }
 
-  private:
-   const Finger* thumb;
-   const Finger* index_finger;
+ private:
+  FingerT* const* fingers;
+  const GestureDefinition* table;
+  int flexion[GESTURE_FINGER_SLOTS];
+  int total_weights[GESTURE_COUNT];
+  int values[GESTURE_COUNT];
+  uint8_t pressed;
 };
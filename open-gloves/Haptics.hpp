@@ -15,20 +15,17 @@ class HapticMotor : public DecodedOuput {
     digitalWrite(motor_pin, LOW);
   }
 
-  void decodeToOuput(const char* input) override {
-    char* start = strchr(input, frequency_key);
-    if (start != NULL) {
-      frequency = atoi(start + 1);
-    }
-
-    start = strchr(input, duration_key);
-    if (start != NULL) {
-      duration = atoi(start + 1);
-    }
+  bool ownsKey(DecodedOuput::Type key) const override {
+    return key == frequency_key || key == duration_key || key == amplitude_key;
+  }
 
-    start = strchr(input, amplitude_key);
-    if (start != NULL) {
-      amplitude = atoi(start + 1);
+  void decodeValue(DecodedOuput::Type key, int value) override {
+    if (key == frequency_key) {
+      frequency = value;
+    } else if (key == duration_key) {
+      duration = value;
+    } else {
+      amplitude = value;
     }
 
     haptic_start = millis();
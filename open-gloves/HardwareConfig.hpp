@@ -13,31 +13,51 @@
 
 StatusLED led(PIN_LED);
 
+// All of the hardware lives in static storage, the lists below only point
+// to it.
+
 // This button is referenced directly by the FW, so we need a pointer to it outside
 // the list of buttons.
 Button calibration_button(EncodedInput::Type::CALIBRATE, PIN_CALIB, INVERT_CALIB);
 
+Button button_a(EncodedInput::Type::A_BTN, PIN_A_BTN, INVERT_A);
+Button button_b(EncodedInput::Type::B_BTN, PIN_B_BTN, INVERT_B);
+Button button_menu(EncodedInput::Type::MENU, PIN_MENU_BTN, INVERT_MENU);
+#if ENABLE_JOYSTICK
+  Button button_joy(EncodedInput::Type::JOY_BTN, PIN_JOY_BTN, INVERT_JOY);
+#endif
+#if !TRIGGER_GESTURE
+  Button button_trigger(EncodedInput::Type::TRIGGER, PIN_TRIG_BTN, INVERT_TRIGGER);
+#endif
+#if !GRAB_GESTURE
+  Button button_grab(EncodedInput::Type::GRAB, PIN_GRAB_BTN, INVERT_GRAB);
+#endif
+#if !PINCH_GESTURE
+  Button button_pinch(EncodedInput::Type::PINCH, PIN_PNCH_BTN, INVERT_PINCH);
+#endif
+
 Button* buttons[BUTTON_COUNT] = {
-  new Button(EncodedInput::Type::A_BTN, PIN_A_BTN, INVERT_A),
-  new Button(EncodedInput::Type::B_BTN, PIN_B_BTN, INVERT_B),
-  new Button(EncodedInput::Type::MENU, PIN_MENU_BTN, INVERT_MENU),
+  &button_a,
+  &button_b,
+  &button_menu,
   &calibration_button,
   #if ENABLE_JOYSTICK
-    new Button(EncodedInput::Type::JOY_BTN, PIN_JOY_BTN, INVERT_JOY),
+    &button_joy,
   #endif
   #if !TRIGGER_GESTURE
-    new Button(EncodedInput::Type::TRIGGER, PIN_TRIG_BTN, INVERT_TRIGGER),
+    &button_trigger,
   #endif
   #if !GRAB_GESTURE
-    new Button(EncodedInput::Type::GRAB, PIN_GRAB_BTN, INVERT_GRAB),
+    &button_grab,
   #endif
   #if !PINCH_GESTURE
-    new Button(EncodedInput::Type::PINCH, PIN_PNCH_BTN, INVERT_PINCH),
+    &button_pinch,
   #endif
-
 };
 
 #if !ENABLE_SPLAY
+  typedef Finger FingerType;
+
   #if ENABLE_THUMB
     Finger finger_thumb(EncodedInput::Type::THUMB, PIN_THUMB);
   #endif
@@ -46,6 +66,8 @@ Button* buttons[BUTTON_COUNT] = {
   Finger finger_ring(EncodedInput::Type::RING, PIN_RING);
   Finger finger_pinky(EncodedInput::Type::PINKY, PIN_PINKY);
 #else
+  typedef SplayFinger FingerType;
+
   #if ENABLE_THUMB
     SplayFinger finger_thumb(EncodedInput::Type::THUMB, PIN_THUMB, PIN_THUMB_SPLAY);
   #endif
@@ -55,66 +77,140 @@ Button* buttons[BUTTON_COUNT] = {
   SplayFinger finger_pinky(EncodedInput::Type::PINKY, PIN_PINKY, PIN_PINKY_SPLAY);
 #endif
 
-Finger* fingers[FINGER_COUNT] = {
+FingerType* fingers[FINGER_COUNT] = {
   #if ENABLE_THUMB
     &finger_thumb,
   #endif
   &finger_index, &finger_middle, &finger_ring, &finger_pinky
 };
 
+// The fingers again, for code that doesn't need to know their type.
+Calibrated* calibrators[MAX_CALIBRATED_COUNT] = {
+  #if ENABLE_THUMB
+    &finger_thumb,
+  #endif
+  &finger_index, &finger_middle, &finger_ring, &finger_pinky
+};
+
+#if ENABLE_JOYSTICK
+  JoyStickAxis joystick_x(EncodedInput::Type::JOY_X, PIN_JOY_X, JOYSTICK_DEADZONE, INVERT_JOY_X);
+  JoyStickAxis joystick_y(EncodedInput::Type::JOY_Y, PIN_JOY_Y, JOYSTICK_DEADZONE, INVERT_JOY_Y);
+#endif
+
 JoyStickAxis* joysticks[JOYSTICK_COUNT] = {
   #if ENABLE_JOYSTICK
-    new JoyStickAxis(EncodedInput::Type::JOY_X, PIN_JOY_X, JOYSTICK_DEADZONE, INVERT_JOY_X),
-    new JoyStickAxis(EncodedInput::Type::JOY_Y, PIN_JOY_Y, JOYSTICK_DEADZONE, INVERT_JOY_Y)
+    &joystick_x,
+    &joystick_y
   #endif
 };
 
-Gesture* gestures[GESTURE_COUNT] = {
+// The gestures, in the order they are encoded. The weights are for the
+// thumb, index, middle, ring and pinky.
+const GestureDefinition gesture_table[GESTURE_COUNT] = {
   #if TRIGGER_GESTURE
-    new TriggerGesture(&finger_index),
+    {EncodedInput::Type::TRIGGER, {0, 1, 0, 0, 0}, GESTURE_PRESS_THRESHOLD, GESTURE_RELEASE_THRESHOLD,
+     ENABLE_TRIGGER_VALUE ? EncodedInput::Type::TRIGGER_VALUE : EncodedInput::Type::NONE},
   #endif
   #if GRAB_GESTURE
-    new GrabGesture(&finger_index, &finger_middle, &finger_ring, &finger_pinky),
+    {EncodedInput::Type::GRAB, {0, 1, 1, 1, 1}, GESTURE_PRESS_THRESHOLD, GESTURE_RELEASE_THRESHOLD,
+     EncodedInput::Type::NONE},
   #endif
   #if PINCH_GESTURE
-    new PinchGesture(&finger_thumb, &finger_index)
+    {EncodedInput::Type::PINCH, {1, 1, 0, 0, 0}, GESTURE_PRESS_THRESHOLD, GESTURE_RELEASE_THRESHOLD,
+     EncodedInput::Type::NONE},
   #endif
 };
 
+GestureEngine<FingerType> gestures(fingers, gesture_table);
+
+#if ENABLE_HAPTICS
+  HapticMotor haptic_motor(DecodedOuput::Type::HAPTIC_FREQ,
+                           DecodedOuput::Type::HAPTIC_DURATION,
+                           DecodedOuput::Type::HAPTIC_AMPLITUDE, PIN_HAPTIC);
+#endif
+
 HapticMotor* haptics[HAPTIC_COUNT] = {
   #if ENABLE_HAPTICS
-    new HapticMotor(DecodedOuput::Type::HAPTIC_FREQ,
-                    DecodedOuput::Type::HAPTIC_DURATION,
-                    DecodedOuput::Type::HAPTIC_AMPLITUDE, PIN_HAPTIC),
+    &haptic_motor,
   #endif
 };
 
-ForceFeedback* force_feedbacks[FORCE_FEEDBACK_COUNT] {
-  #if ENABLE_FORCE_FEEDBACK
-    #if FORCE_FEEDBACK_STYLE == FORCE_FEEDBACK_STYLE_SERVO
-      #if ENABLE_THUMB
-        new ServoForceFeedback(DecodedOuput::Type::FFB_THUMB, &finger_thumb, PIN_THUMB_FFB, FORCE_FEEDBACK_INVERT),
-      #endif
-      new ServoForceFeedback(DecodedOuput::Type::FFB_INDEX, &finger_index, PIN_INDEX_FFB, FORCE_FEEDBACK_INVERT),
-      new ServoForceFeedback(DecodedOuput::Type::FFB_MIDDLE, &finger_middle, PIN_MIDDLE_FFB, FORCE_FEEDBACK_INVERT),
-      new ServoForceFeedback(DecodedOuput::Type::FFB_RING, &finger_ring, PIN_RING_FFB, FORCE_FEEDBACK_INVERT),
-      new ServoForceFeedback(DecodedOuput::Type::FFB_PINKY, &finger_pinky, PIN_PINKY_FFB, FORCE_FEEDBACK_INVERT)
-    #elif FORCE_FEEDBACK_STYLE == FORCE_FEEDBACK_STYLE_CLAMP
-      #if ENABLE_THUMB
-        new DigitalClampForceFeedback(DecodedOuput::Type::FFB_THUMB, &finger_thumb, PIN_THUMB_FFB),
-      #endif
-      new DigitalClampForceFeedback(DecodedOuput::Type::FFB_INDEX, &finger_index, PIN_INDEX_FFB),
-      new DigitalClampForceFeedback(DecodedOuput::Type::FFB_MIDDLE, &finger_middle, PIN_MIDDLE_FFB),
-      new DigitalClampForceFeedback(DecodedOuput::Type::FFB_RING, &finger_ring, PIN_RING_FFB),
-      new DigitalClampForceFeedback(DecodedOuput::Type::FFB_PINKY, &finger_pinky, PIN_PINKY_FFB)
-    #elif FORCE_FEEDBACK_STYLE == FORCE_FEEDBACK_STYLE_SERVO_CLAMP
-      #if ENABLE_THUMB
-        new ServoClampForceFeedback(DecodedOuput::Type::FFB_THUMB, &finger_thumb, PIN_THUMB_FFB),
-      #endif
-      new ServoClampForceFeedback(DecodedOuput::Type::FFB_INDEX, &finger_index, PIN_INDEX_FFB),
-      new ServoClampForceFeedback(DecodedOuput::Type::FFB_MIDDLE, &finger_middle, PIN_MIDDLE_FFB),
-      new ServoClampForceFeedback(DecodedOuput::Type::FFB_RING, &finger_ring, PIN_RING_FFB),
-      new ServoClampForceFeedback(DecodedOuput::Type::FFB_PINKY, &finger_pinky, PIN_PINKY_FFB)
+#if ENABLE_FORCE_FEEDBACK
+  #if FORCE_FEEDBACK_STYLE == FORCE_FEEDBACK_STYLE_SERVO
+    typedef ServoForceFeedback ForceFeedbackType;
+
+    #if ENABLE_THUMB
+      ServoForceFeedback force_feedback_thumb(DecodedOuput::Type::FFB_THUMB, &finger_thumb, PIN_THUMB_FFB, FORCE_FEEDBACK_INVERT);
+    #endif
+    ServoForceFeedback force_feedback_index(DecodedOuput::Type::FFB_INDEX, &finger_index, PIN_INDEX_FFB, FORCE_FEEDBACK_INVERT);
+    ServoForceFeedback force_feedback_middle(DecodedOuput::Type::FFB_MIDDLE, &finger_middle, PIN_MIDDLE_FFB, FORCE_FEEDBACK_INVERT);
+    ServoForceFeedback force_feedback_ring(DecodedOuput::Type::FFB_RING, &finger_ring, PIN_RING_FFB, FORCE_FEEDBACK_INVERT);
+    ServoForceFeedback force_feedback_pinky(DecodedOuput::Type::FFB_PINKY, &finger_pinky, PIN_PINKY_FFB, FORCE_FEEDBACK_INVERT);
+  #elif FORCE_FEEDBACK_STYLE == FORCE_FEEDBACK_STYLE_CLAMP
+    typedef DigitalClampForceFeedback ForceFeedbackType;
+
+    #if ENABLE_THUMB
+      DigitalClampForceFeedback force_feedback_thumb(DecodedOuput::Type::FFB_THUMB, &finger_thumb, PIN_THUMB_FFB);
     #endif
+    DigitalClampForceFeedback force_feedback_index(DecodedOuput::Type::FFB_INDEX, &finger_index, PIN_INDEX_FFB);
+    DigitalClampForceFeedback force_feedback_middle(DecodedOuput::Type::FFB_MIDDLE, &finger_middle, PIN_MIDDLE_FFB);
+    DigitalClampForceFeedback force_feedback_ring(DecodedOuput::Type::FFB_RING, &finger_ring, PIN_RING_FFB);
+    DigitalClampForceFeedback force_feedback_pinky(DecodedOuput::Type::FFB_PINKY, &finger_pinky, PIN_PINKY_FFB);
+  #elif FORCE_FEEDBACK_STYLE == FORCE_FEEDBACK_STYLE_SERVO_CLAMP
+    typedef ServoClampForceFeedback ForceFeedbackType;
+
+    #if ENABLE_THUMB
+      ServoClampForceFeedback force_feedback_thumb(DecodedOuput::Type::FFB_THUMB, &finger_thumb, PIN_THUMB_FFB);
+    #endif
+    ServoClampForceFeedback force_feedback_index(DecodedOuput::Type::FFB_INDEX, &finger_index, PIN_INDEX_FFB);
+    ServoClampForceFeedback force_feedback_middle(DecodedOuput::Type::FFB_MIDDLE, &finger_middle, PIN_MIDDLE_FFB);
+    ServoClampForceFeedback force_feedback_ring(DecodedOuput::Type::FFB_RING, &finger_ring, PIN_RING_FFB);
+    ServoClampForceFeedback force_feedback_pinky(DecodedOuput::Type::FFB_PINKY, &finger_pinky, PIN_PINKY_FFB);
   #endif
+
+  ForceFeedbackType* force_feedbacks[FORCE_FEEDBACK_COUNT] = {
+    #if ENABLE_THUMB
+      &force_feedback_thumb,
+    #endif
+    &force_feedback_index, &force_feedback_middle, &force_feedback_ring, &force_feedback_pinky
+  };
+#endif
+
+// The registries group the hardware above for the main loop. forEach calls
+// the visitor with every item by its concrete type, so all of the
+// configured hardware is known at compile time and the visitor's calls
+// don't need to go through the vtable.
+
+// The inputs, in the order they are encoded.
+struct InputRegistry {
+  // Longest string the inputs can encode to, not counting the new line.
+  static constexpr int ENCODED_SIZE = BUTTON_COUNT * Button::ENCODED_SIZE +
+                                      FINGER_COUNT * FingerType::ENCODED_SIZE +
+                                      JOYSTICK_COUNT * JoyStickAxis::ENCODED_SIZE +
+                                      GestureEngine<FingerType>::ENCODED_SIZE;
+
+  template<typename Visitor>
+  static void forEach(Visitor&& visit) {
+    for (size_t i = 0; i < BUTTON_COUNT; i++) visit(*buttons[i]);
+    for (size_t i = 0; i < FINGER_COUNT; i++) visit(*fingers[i]);
+    for (size_t i = 0; i < JOYSTICK_COUNT; i++) visit(*joysticks[i]);
+    visit(gestures);
+  }
+};
+
+struct CalibratedRegistry {
+  template<typename Visitor>
+  static void forEach(Visitor&& visit) {
+    for (size_t i = 0; i < FINGER_COUNT; i++) visit(*fingers[i]);
+  }
+};
+
+struct OutputRegistry {
+  template<typename Visitor>
+  static void forEach(Visitor&& visit) {
+    #if ENABLE_FORCE_FEEDBACK
+      for (size_t i = 0; i < FORCE_FEEDBACK_COUNT; i++) visit(*force_feedbacks[i]);
+    #endif
+    for (size_t i = 0; i < HAPTIC_COUNT; i++) visit(*haptics[i]);
+  }
 };
@@ -1,10 +1,160 @@
 #pragma once
 
+#include "Config.h"
+
+// Longest message that can be received from the driver, including the null terminator.
+#define RECEIVE_BUFFER_SIZE 100
+// Longest message that can be queued for sending. Telemetry from the
+// profiler is the longest message, and has longer numbers with a bigger int.
+// The frame timing and trigger value make a frame longer.
+#define TRANSMIT_BUFFER_SIZE (ENABLE_PROFILING ? (sizeof(int) == 2 ? 176 : 320) : \
+                              (ENABLE_FRAME_TIMING || ENABLE_TRIGGER_VALUE ? 128 : 100))
+
 //Interface for communication
 struct ICommunication {
   virtual bool isOpen() = 0;
   virtual void start() = 0;
-  virtual void output(char* data) = 0;
+  // Send a message, or queue it if the link is busy. Returns false if
+  // it replaced a message that was never sent, or couldn't be queued.
+  virtual bool output(const char* data, size_t length) = 0;
+  // Keep writing any queued output. This should be called every loop.
+  virtual void serviceOutput() {}
+  // Bytes queued that the link hasn't taken yet, for links that queue.
+  virtual size_t pendingBytes() { return 0; }
   virtual bool hasData() = 0;
+  // Must not block, returns false until a complete message has arrived.
   virtual bool readData(char* input, size_t buffer_size) = 0;
 };
+
+// Assembles messages from a stream out of the bytes that have already
+// arrived. A partial message is kept until the rest of it shows up on a
+// later loop, so reading never waits on the link.
+class LineReader {
+ public:
+  LineReader() : length(0), overflowed(false) {}
+
+  // Consume the available bytes until a message is complete. Returns true
+  // once one has been copied to the output, without the delimiter.
+  template<typename S>
+  bool readLine(S& stream, char* output, size_t output_size) {
+    while (stream.available() > 0) {
+      char next = stream.read();
+      if (next != ENCODING_DELIMITER) {
+        // Anything too long to fit is dropped up to the next delimiter.
+        if (length < RECEIVE_BUFFER_SIZE - 1) line[length++] = next;
+        else overflowed = true;
+        continue;
+      }
+
+      // A line from a terminal may end in CR LF.
+      if (ENCODING_DELIMITER == '\n' && length > 0 && line[length - 1] == '\r') length--;
+
+      bool complete = !overflowed && length > 0 && length < output_size;
+      if (complete) {
+        memcpy(output, line, length);
+        output[length] = '\0';
+      }
+
+      length = 0;
+      overflowed = false;
+      if (complete) return true;
+    }
+
+    return false;
+  }
+
+  // Forget a partial message, eg. when another client connects.
+  void reset() {
+    length = 0;
+    overflowed = false;
+  }
+
+ private:
+  char line[RECEIVE_BUFFER_SIZE];
+  size_t length;
+  bool overflowed;
+};
+
+// Writes messages to a stream without waiting for it to drain.
+//
+// A message that has started going out is always finished so the framing
+// stays intact, and at most one more waits behind it. Only the latest
+// state matters, so a newer message replaces the waiting one.
+class TransmitQueue {
+ public:
+  TransmitQueue() :
+    writing(0), write_length(0), write_offset(0), waiting_length(0),
+    superseded(0), dropped(0) {}
+
+  // Queue a message and write as much as the stream has room for.
+  // Returns false if the message replaced one that was never sent, or
+  // was too long to queue.
+  template<typename S>
+  bool send(S& stream, const char* data, size_t length) {
+    bool queued = true;
+    if (length > TRANSMIT_BUFFER_SIZE) {
+      dropped++;
+      queued = false;
+    } else {
+      if (waiting_length > 0) {
+        superseded++;
+        queued = false;
+      }
+      memcpy(buffers[1 - writing], data, length);
+      waiting_length = length;
+    }
+
+    service(stream);
+    return queued;
+  }
+
+  // Write as much as the stream has room for, without blocking.
+  template<typename S>
+  void service(S& stream) {
+    for (;;) {
+      if (write_offset == write_length) {
+        if (waiting_length == 0) return;
+
+        // Start on the waiting message.
+        writing = 1 - writing;
+        write_length = waiting_length;
+        write_offset = 0;
+        waiting_length = 0;
+      }
+
+      int space = stream.availableForWrite();
+      if (space <= 0) return;
+
+      size_t count = write_length - write_offset;
+      if (count > static_cast<size_t>(space)) count = space;
+      size_t written = stream.write(buffers[writing] + write_offset, count);
+      if (written == 0) return;
+      write_offset += written;
+    }
+  }
+
+  // Bytes queued but not written to the stream yet.
+  size_t pendingBytes() const {
+    return write_length - write_offset + waiting_length;
+  }
+
+  // Messages replaced by a newer one before they were sent.
+  unsigned long supersededCount() const {
+    return superseded;
+  }
+
+  // Messages too long to queue.
+  unsigned long droppedCount() const {
+    return dropped;
+  }
+
+ private:
+  char buffers[2][TRANSMIT_BUFFER_SIZE];
+  // The buffer being written, the other one holds the waiting message.
+  uint8_t writing;
+  size_t write_length;
+  size_t write_offset;
+  size_t waiting_length;
+  unsigned long superseded;
+  unsigned long dropped;
+};
@@ -2,6 +2,7 @@
 
 #include "Config.h"
 
+#include "AnalogSampler.hpp"
 #include "DriverProtocol.hpp"
 
 class JoyStickAxis : public EncodedInput {
@@ -9,9 +10,13 @@ class JoyStickAxis : public EncodedInput {
   JoyStickAxis(EncodedInput::Type type, int pin, float dead_zone, bool invert) :
     type(type), pin(pin), dead_zone(dead_zone), invert(invert), value(ANALOG_MAX/2) {}
 
+  void setupInput() override {
+    channel = analog_sampler.addChannel(pin);
+  }
+
   void readInput() override {
     // Read the latest value.
-    int new_value = analogRead(pin);
+    int new_value = analog_sampler.read(channel);
 
     // Apply the deadzone to the value.
     new_value = filterDeadZone(new_value);
@@ -25,13 +30,19 @@ class JoyStickAxis : public EncodedInput {
     value = new_value;
   }
 
+  // Encode string size = AXXXX + '\0'
+  static constexpr int ENCODED_SIZE = 6;
+
   inline int getEncodedSize() const override {
-    // Encode string size = AXXXX + '\0'
-    return 6;
+    return ENCODED_SIZE;
   }
 
   int encode(char* output) const override {
-    return snprintf(output, getEncodedSize(), "%c%d", type, value);
+    return encodeKeyValue(output, type, value);
+  }
+
+  void encodeBinary(BinaryFrame& frame) const override {
+    frame.setAnalog(type, value);
   }
 
   int getValue() const {
@@ -49,6 +60,7 @@ class JoyStickAxis : public EncodedInput {
 
   EncodedInput::Type type;
   int pin;
+  uint8_t channel;
   float dead_zone;
   bool invert;
   int value;
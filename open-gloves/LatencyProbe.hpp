@@ -0,0 +1,70 @@
+#pragma once
+
+#include "Config.h"
+
+#include "DriverProtocol.hpp"
+
+// Answers pings from the driver so it can measure how long commands take
+// to reach the outputs.
+//
+// The driver sends the PING key with an id of its choosing. Once the
+// outputs have been updated the reply "~J<id>,<received>,<actuated>" is
+// sent: the time the command was decoded and the time the outputs were
+// updated, in micros() on the same clock as the frame timing. With the
+// frame timing the driver can split the round trip into each direction.
+class LatencyProbe : public DecodedOuput {
+ public:
+  LatencyProbe() : id(0), received_time(0), actuated_time(0), pending(false), actuated(false) {}
+
+  bool ownsKey(DecodedOuput::Type key) const override {
+    return key == DecodedOuput::Type::PING;
+  }
+
+  void decodeValue(DecodedOuput::Type key, int value) override {
+    // A newer ping replaces one that hasn't been answered yet.
+    id = value;
+    received_time = micros();
+    pending = true;
+    actuated = false;
+  }
+
+  void updateOutput() override {}
+
+  // Call once all of the outputs have been updated.
+  void outputsUpdated() {
+    if (pending && !actuated) {
+      actuated_time = micros();
+      actuated = true;
+    }
+  }
+
+  bool replyReady() const {
+    return actuated;
+  }
+
+  // Write the reply, unframed. Returns the number of characters written.
+  int encodeReply(char* output) {
+    int offset = 0;
+    output[offset++] = '~';
+    output[offset++] = DecodedOuput::Type::PING;
+    offset += encodeInteger(output + offset, id);
+    output[offset++] = ',';
+    offset += encodeUnsigned(output + offset, received_time);
+    output[offset++] = ',';
+    offset += encodeUnsigned(output + offset, actuated_time);
+
+    pending = false;
+    actuated = false;
+    return offset;
+  }
+
+ private:
+  int id;
+  unsigned long received_time;
+  unsigned long actuated_time;
+  bool pending;
+  bool actuated;
+};
+
+// Longest reply: the prefix and key, the id and two timestamps.
+#define PING_REPLY_MAX_SIZE (2 + (sizeof(int) == 2 ? 6 : 11) + 2 * (1 + 10))
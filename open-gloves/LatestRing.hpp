@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+// Passes values from one producer thread to one consumer thread, where
+// only the newest value matters. Neither side ever waits on the other.
+//
+// This is a ring of three slots: the producer fills one, the consumer
+// reads another, and the third holds the newest published value. Publishing
+// and taking swap a slot with the shared one in a single atomic exchange, so
+// the consumer never sees a slot the producer is still writing. A value
+// that is published before the last one was taken replaces it.
+template<typename T>
+class LatestRing {
+ public:
+  LatestRing() : shared(1), write_index(0), read_index(2), superseded(0) {}
+
+  // Producer: the slot to fill before publishing.
+  T& writeSlot() {
+    return slots[write_index];
+  }
+
+  // Producer: make the filled slot the newest value.
+  // Returns false if it replaced a value the consumer never took.
+  bool publish() {
+    uint8_t previous = shared.exchange(write_index | FRESH, std::memory_order_acq_rel);
+    write_index = previous & INDEX_MASK;
+    if (previous & FRESH) {
+      superseded++;
+      return false;
+    }
+    return true;
+  }
+
+  // Consumer: take the newest value if there is one.
+  // Returns false if nothing was published since the last take.
+  bool take() {
+    if (!(shared.load(std::memory_order_relaxed) & FRESH)) return false;
+    uint8_t previous = shared.exchange(read_index, std::memory_order_acq_rel);
+    read_index = previous & INDEX_MASK;
+    return true;
+  }
+
+  // Consumer: the value from the last successful take.
+  const T& readSlot() const {
+    return slots[read_index];
+  }
+
+  // Producer: number of values that were replaced before being taken.
+  unsigned long supersededCount() const {
+    return superseded;
+  }
+
+ private:
+  static constexpr uint8_t INDEX_MASK = 0x03;
+  // Set on the shared index while it holds a value that hasn't been taken.
+  static constexpr uint8_t FRESH = 0x04;
+
+  T slots[3];
+  std::atomic<uint8_t> shared;
+  // Only touched by the producer.
+  uint8_t write_index;
+  // Only touched by the consumer.
+  uint8_t read_index;
+  unsigned long superseded;
+};
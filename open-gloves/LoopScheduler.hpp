@@ -0,0 +1,97 @@
+#pragma once
+
+// Default clock for the scheduler, backed by the Arduino timing functions.
+struct ArduinoClock {
+  static unsigned long now() {
+    return micros();
+  }
+
+  static void sleep(unsigned long duration) {
+    // delayMicroseconds is only accurate for short waits, let delay
+    // handle the whole milliseconds.
+    if (duration >= 1000) delay(duration / 1000);
+    delayMicroseconds(duration % 1000);
+  }
+};
+
+// Timing statistics of the loop, all times in microseconds.
+struct LoopStats {
+  unsigned long min_period;
+  unsigned long max_period;
+  unsigned long total_period;
+  unsigned long loops;
+  unsigned long overruns;
+
+  unsigned long meanPeriod() const {
+    return loops > 0 ? total_period / loops : 0;
+  }
+};
+
+// Runs the loop at a fixed rate by waiting for absolute deadlines instead
+// of sleeping a fixed time, so time spent in the loop doesn't add to the
+// period.
+//
+// If a loop runs late, the next one starts right away and the schedule is
+// kept. If the loop is late by a whole period or more, the missed loops are
+// skipped and the schedule restarts from now. Both count as an overrun.
+template<typename Clock = ArduinoClock>
+class LoopScheduler {
+ public:
+  LoopScheduler(unsigned long period) : period(period), started(false) {
+    resetStats();
+  }
+
+  // Start the schedule from now.
+  void start() {
+    last_start = Clock::now();
+    deadline = last_start + period;
+    started = true;
+  }
+
+  // Wait until it is time to start the next loop.
+  void wait() {
+    if (!started) start();
+
+    long remaining = static_cast<long>(deadline - Clock::now());
+    if (remaining > 0) {
+      Clock::sleep(remaining);
+    } else if (period > 0) {
+      stats.overruns++;
+
+      // Too far behind to catch up, skip the missed loops.
+      if (static_cast<unsigned long>(-remaining) >= period) {
+        deadline = Clock::now();
+      }
+    }
+    deadline += period;
+
+    // Record how long the loop that just ended took.
+    unsigned long now = Clock::now();
+    unsigned long loop_period = now - last_start;
+    last_start = now;
+
+    if (loop_period < stats.min_period) stats.min_period = loop_period;
+    if (loop_period > stats.max_period) stats.max_period = loop_period;
+    stats.total_period += loop_period;
+    stats.loops++;
+  }
+
+  const LoopStats& getStats() const {
+    return stats;
+  }
+
+  void resetStats() {
+    stats.min_period = static_cast<unsigned long>(-1);
+    stats.max_period = 0;
+    stats.total_period = 0;
+    stats.loops = 0;
+    stats.overruns = 0;
+  }
+
+ private:
+  unsigned long period;
+  unsigned long deadline;
+  unsigned long last_start;
+  bool started;
+  LoopStats stats;
+};
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <stdint.h>
+
+// Median of the last N values, without any allocations.
+//
+// The window is kept in a single array of indexes split around the median:
+// a max heap of the lower half below it and a min heap of the upper half
+// above it. Replacing the oldest value only has to repair the heap it
+// lands in, O(log N), and the median is always at the center, O(1).
+//
+// Like RunningMedian, the median of an even number of values is the mean
+// of the two middle values.
+template<typename T, uint8_t N>
+class MedianFilter {
+  static_assert(N > 0 && N <= 127, "The median window must hold 1 to 127 values");
+
+ public:
+  MedianFilter() : next(0), count(0) {
+    // Spread the slots out alternately above and below the median.
+    for (int8_t slot = N - 1; slot >= 0; slot--) {
+      position[slot] = ((slot + 1) / 2) * ((slot & 1) ? -1 : 1);
+      heap(position[slot]) = slot;
+    }
+  }
+
+  void add(T value) {
+    const bool filling = count < N;
+    const int8_t at = position[next];
+    const T old = values[next];
+    values[next] = value;
+    next = (next + 1) % N;
+    if (filling) count++;
+
+    if (at > 0) {
+      // The value is in the upper half.
+      if (!filling && old < value) minSortDown(at * 2);
+      else if (minSortUp(at)) maxSortDown(-1);
+    } else if (at < 0) {
+      // The value is in the lower half.
+      if (!filling && value < old) maxSortDown(at * 2);
+      else if (maxSortUp(at)) minSortDown(1);
+    } else {
+      // The value replaced the median.
+      if (maxCount() > 0) maxSortDown(-1);
+      if (minCount() > 0) minSortDown(1);
+    }
+  }
+
+  T getMedian() const {
+    T median = values[heap(0)];
+    if ((count & 1) == 0 && count > 0) {
+      median = (median + values[heap(-1)]) / 2;
+    }
+    return median;
+  }
+
+ private:
+  // Number of values in each half.
+  int8_t minCount() const {
+    return (count - 1) / 2;
+  }
+
+  int8_t maxCount() const {
+    return count / 2;
+  }
+
+  // Heap positions run from -N/2 to (N-1)/2 with the median at 0.
+  int8_t& heap(int8_t at) {
+    return heap_slots[at + N / 2];
+  }
+
+  int8_t heap(int8_t at) const {
+    return heap_slots[at + N / 2];
+  }
+
+  bool less(int8_t a, int8_t b) const {
+    return values[heap(a)] < values[heap(b)];
+  }
+
+  // Swap the positions if the value at a is less than the value at b.
+  bool exchangeIfLess(int8_t a, int8_t b) {
+    if (!less(a, b)) return false;
+
+    int8_t slot = heap(a);
+    heap(a) = heap(b);
+    heap(b) = slot;
+    position[heap(a)] = a;
+    position[heap(b)] = b;
+    return true;
+  }
+
+  // Restore the min heap below a position, starting at its child.
+  void minSortDown(int8_t at) {
+    for (; at <= minCount(); at *= 2) {
+      if (at > 1 && at < minCount() && less(at + 1, at)) at++;
+      if (!exchangeIfLess(at, at / 2)) break;
+    }
+  }
+
+  // Restore the max heap below a position, starting at its child.
+  void maxSortDown(int8_t at) {
+    for (; at >= -maxCount(); at *= 2) {
+      if (at < -1 && at > -maxCount() && less(at, at - 1)) at--;
+      if (!exchangeIfLess(at / 2, at)) break;
+    }
+  }
+
+  // Move a value up the min heap. Returns true if it became the median.
+  bool minSortUp(int8_t at) {
+    while (at > 0 && exchangeIfLess(at, at / 2)) at /= 2;
+    return at == 0;
+  }
+
+  // Move a value up the max heap. Returns true if it became the median.
+  bool maxSortUp(int8_t at) {
+    while (at < 0 && exchangeIfLess(at / 2, at)) at /= 2;
+    return at == 0;
+  }
+
+  // Values in the order they arrived, overwritten oldest first.
+  T values[N];
+  // Heap position of each value.
+  int8_t position[N];
+  // Value index at each heap position.
+  int8_t heap_slots[N];
+  uint8_t next;
+  uint8_t count;
+};
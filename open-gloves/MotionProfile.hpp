@@ -0,0 +1,111 @@
+#pragma once
+
+#include "Config.h"
+
+#include <limits.h>
+
+// Fractional bits of the positions and speeds, so slow moves still
+// advance every step.
+#define MOTION_FRACTION_BITS 10
+// Most steps taken to catch up in one update, after a stall the rest are dropped.
+#define MOTION_MAX_CATCH_UP 32
+
+// Moves an output toward a target no faster than a top speed, speeding up
+// and slowing down no faster than a top acceleration. A step in the target
+// becomes a smooth move instead of a jump.
+//
+// It steps at a fixed rate however often it is updated, so the motion
+// doesn't depend on the loop or on when the commands arrive. It brakes
+// once the distance left is what it needs to stop (v^2 = 2ad) and stops on
+// the target without overshooting it. The output stays within its range,
+// a turn around near an end stops there instead of running past it.
+// Everything is in fixed point, there is no division or floating point per
+// step.
+class MotionProfile {
+ public:
+  // The speed is in units per second and the acceleration in units per
+  // second squared, the step time in microseconds. The output stays
+  // between the lowest and highest.
+  MotionProfile(long max_speed, long max_acceleration, unsigned long step_time, int lowest, int highest) :
+    step_time(step_time), lowest(static_cast<long>(lowest) << MOTION_FRACTION_BITS),
+    highest(static_cast<long>(highest) << MOTION_FRACTION_BITS), position(0), target(0), velocity(0), last_step(0) {
+    const long steps_per_second = 1000000L / step_time;
+    speed_limit = (max_speed << MOTION_FRACTION_BITS) / steps_per_second;
+    acceleration = (max_acceleration << MOTION_FRACTION_BITS) / steps_per_second / steps_per_second;
+    if (speed_limit < 1) speed_limit = 1;
+    if (acceleration < 1) acceleration = 1;
+    // Past this distance there is always room to stop, and 2ad would overflow.
+    brake_distance_limit = LONG_MAX / (2 * acceleration);
+  }
+
+  // Jump to a position and stop there.
+  void reset(int output, unsigned long now) {
+    position = constrain(static_cast<long>(output) << MOTION_FRACTION_BITS, lowest, highest);
+    target = position;
+    velocity = 0;
+    last_step = now;
+  }
+
+  void setTarget(int output) {
+    target = constrain(static_cast<long>(output) << MOTION_FRACTION_BITS, lowest, highest);
+  }
+
+  // Take the steps due by now. Returns the position to output.
+  int update(unsigned long now) {
+    if (now - last_step > MOTION_MAX_CATCH_UP * step_time) {
+      last_step = now - MOTION_MAX_CATCH_UP * step_time;
+    }
+    while (now - last_step >= step_time) {
+      last_step += step_time;
+      step();
+    }
+    return output();
+  }
+
+  int output() const {
+    return (position + (1L << (MOTION_FRACTION_BITS - 1))) >> MOTION_FRACTION_BITS;
+  }
+
+ private:
+  void step() {
+    const long error = target - position;
+    if (error == 0 && velocity == 0) return;
+
+    const long distance = error < 0 ? -error : error;
+    const bool approaching = (velocity > 0 && error > 0) || (velocity < 0 && error < 0);
+    if (approaching && distance < brake_distance_limit && velocity * velocity >= 2 * acceleration * distance) {
+      // Brake to stop on the target.
+      velocity += velocity > 0 ? -acceleration : acceleration;
+    } else {
+      // Speed up toward the target, or turn around if moving away from it.
+      velocity += error > 0 ? acceleration : -acceleration;
+      velocity = constrain(velocity, -speed_limit, speed_limit);
+    }
+
+    position += velocity;
+
+    // Turning around near an end can carry it past the end, stop there.
+    if (position < lowest || position > highest) {
+      position = constrain(position, lowest, highest);
+      velocity = 0;
+    }
+
+    // Stop on the target once it is reached or passed.
+    const long remaining = target - position;
+    if (remaining == 0 || (remaining > 0) != (error > 0)) {
+      position = target;
+      velocity = 0;
+    }
+  }
+
+  const unsigned long step_time;
+  const long lowest;
+  const long highest;
+  long speed_limit;
+  long acceleration;
+  long brake_distance_limit;
+  long position;
+  long target;
+  long velocity;
+  unsigned long last_step;
+};
@@ -0,0 +1,181 @@
+#pragma once
+
+#include "Config.h"
+
+#include "DriverProtocol.hpp"
+#include "LoopScheduler.hpp"
+
+// Number of buckets in each timing histogram. Bucket n counts durations
+// from 2^n up to 2^(n+1) microseconds, the last bucket counts anything longer.
+#define PROFILE_BUCKETS 14
+
+// Histogram of durations in microseconds.
+class TimingHistogram {
+ public:
+  TimingHistogram() {
+    reset();
+  }
+
+  void reset() {
+    for (uint8_t i = 0; i < PROFILE_BUCKETS; i++) {
+      buckets[i] = 0;
+    }
+    min_time = static_cast<unsigned long>(-1);
+    max_time = 0;
+    total_time = 0;
+    count = 0;
+  }
+
+  void add(unsigned long duration) {
+    // Keep the distribution but halve the weight of older samples
+    // instead of overflowing.
+    if (count == UINT16_MAX) {
+      for (uint8_t i = 0; i < PROFILE_BUCKETS; i++) {
+        buckets[i] /= 2;
+      }
+      total_time /= 2;
+      count /= 2;
+    }
+
+    uint8_t bucket = 0;
+    for (unsigned long remaining = duration; remaining > 1 && bucket < PROFILE_BUCKETS - 1; remaining >>= 1) {
+      bucket++;
+    }
+    buckets[bucket]++;
+
+    if (duration < min_time) min_time = duration;
+    if (duration > max_time) max_time = duration;
+    total_time += duration;
+    count++;
+  }
+
+  unsigned long minimum() const {
+    return count > 0 ? min_time : 0;
+  }
+
+  unsigned long maximum() const {
+    return max_time;
+  }
+
+  unsigned long mean() const {
+    return count > 0 ? total_time / count : 0;
+  }
+
+  // The upper bound of the bucket holding the 99th percentile,
+  // no more than the longest duration seen.
+  unsigned long percentile99() const {
+    // Number of samples that may be above the percentile.
+    unsigned long above = count / 100;
+    unsigned long seen = 0;
+    for (int8_t bucket = PROFILE_BUCKETS - 1; bucket > 0; bucket--) {
+      seen += buckets[bucket];
+      if (seen > above) {
+        unsigned long upper = (2ul << bucket) - 1;
+        return upper < max_time ? upper : max_time;
+      }
+    }
+    return max_time < 1 ? max_time : 1;
+  }
+
+ private:
+  uint16_t buckets[PROFILE_BUCKETS];
+  unsigned long min_time;
+  unsigned long max_time;
+  unsigned long total_time;
+  uint16_t count;
+};
+
+// Times each stage of the loop and reports the timings to the driver
+// when it asks for them with the TELEMETRY key.
+//
+// The telemetry message is "~" followed by a key for each stage,
+// eg. A<min>,<max>,<p99>,<mean>, in microseconds. It ends with
+// L<min>,<max>,<mean>,<overruns> for the period of the whole loop.
+// The timings are reset every time they are sent.
+class LoopProfiler : public DecodedOuput {
+ public:
+  enum Stage : uint8_t {
+    CALIBRATION,
+    READ_INPUTS,
+    ENCODE,
+    SEND,
+    RECEIVE,
+    UPDATE_OUTPUTS,
+    STAGE_COUNT
+  };
+
+  LoopProfiler() : requested(false) {}
+
+  // Record the time since start against the stage.
+  // Returns the current time so stages can be chained.
+  unsigned long record(Stage stage, unsigned long start) {
+    unsigned long now = micros();
+    stages[stage].add(now - start);
+    return now;
+  }
+
+  bool ownsKey(DecodedOuput::Type key) const override {
+    return key == DecodedOuput::Type::TELEMETRY;
+  }
+
+  void decodeValue(DecodedOuput::Type key, int value) override {
+    requested = true;
+  }
+
+  void updateOutput() override {}
+
+  bool telemetryRequested() const {
+    return requested;
+  }
+
+  // Write the telemetry message, unframed. Returns the number of characters written.
+  int encodeTelemetry(char* output, const LoopStats& loop_stats) {
+    int offset = 0;
+    output[offset++] = '~';
+    for (uint8_t stage = 0; stage < STAGE_COUNT; stage++) {
+      offset += encodeTimings(output + offset, 'A' + stage,
+                              stages[stage].minimum(), stages[stage].maximum(),
+                              stages[stage].percentile99(), stages[stage].mean());
+      stages[stage].reset();
+    }
+    offset += encodeTimings(output + offset, 'L',
+                            loop_stats.loops > 0 ? loop_stats.min_period : 0, loop_stats.max_period,
+                            loop_stats.meanPeriod(), loop_stats.overruns);
+
+    requested = false;
+    return offset;
+  }
+
+ private:
+  int encodeTimings(char* output, char key, unsigned long a, unsigned long b,
+                    unsigned long c, unsigned long d) {
+    const unsigned long values[] = {a, b, c, d};
+    int offset = 0;
+    output[offset++] = key;
+    for (uint8_t i = 0; i < 4; i++) {
+      if (i > 0) output[offset++] = ',';
+      offset += encodeInteger(output + offset, values[i] > INT_MAX ? INT_MAX : values[i]);
+    }
+    return offset;
+  }
+
+  TimingHistogram stages[STAGE_COUNT];
+  bool requested;
+};
+
+// Longest telemetry message: the prefix, then a key and four numbers for
+// each stage and the loop.
+#define TELEMETRY_MAX_SIZE (1 + (LoopProfiler::STAGE_COUNT + 1) * (1 + 4 * (sizeof(int) == 2 ? 5 : 10) + 3))
+
+#if ENABLE_PROFILING
+  // Start timing the stages of the loop.
+  #define PROFILE_BEGIN(profiler) unsigned long profile_mark = micros()
+  // Record the time since the end of the previous stage against a stage.
+  #define PROFILE_STAGE(profiler, stage) profile_mark = (profiler).record(LoopProfiler::Stage::stage, profile_mark)
+  // Start the next stage here, the time since the previous one isn't any stage's.
+  #define PROFILE_SKIP(profiler) profile_mark = micros()
+#else
+  #define PROFILE_BEGIN(profiler)
+  #define PROFILE_STAGE(profiler, stage)
+  #define PROFILE_SKIP(profiler)
+#endif
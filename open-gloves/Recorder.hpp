@@ -0,0 +1,106 @@
+#pragma once
+
+#include "Config.h"
+
+#include "AnalogSampler.hpp"
+#include "ButtonBank.hpp"
+#include "DriverProtocol.hpp"
+
+// Sizes of the records after the header.
+#define RECORD_SAMPLE_SIZE  (2 + 2 * ANALOG_CHANNEL_COUNT)
+#define RECORD_EDGES_SIZE   (4 + 4 * BUTTON_COUNT)
+#define RECORD_COMMAND_SIZE (BINARY_COMMAND_MAX_SIZE + 1)
+#define RECORD_LARGER(a, b) ((a) > (b) ? (a) : (b))
+// Largest unframed record.
+#define RECORD_MAX_SIZE (7 + RECORD_LARGER(RECORD_LARGER(RECORD_SAMPLE_SIZE, RECORD_EDGES_SIZE), RECORD_COMMAND_SIZE))
+
+// Writes a log of what the glove read from its sensors and received from
+// the driver, so a session can be replayed without the glove. The records
+// are sent between the frames as messages of their own.
+//
+// Record layout before framing, all fields big endian:
+//   '#'            - marks a record, no binary frame starts with it.
+//   uint8 type     - 'S' for a sample, 'C' for a command.
+//   uint8 number   - counts every record and wraps, a gap is a lost record.
+//   uint32 time    - micros() when the sample was read or the command arrived.
+// A sample follows with:
+//   uint16 buttons - bit n set if the button n in the buttons list read
+//                    pressed, before debouncing.
+//   uint16 value   - for each analog channel in the order the inputs added
+//                    them, before any filtering or calibration.
+// Edges, after a sample that pressed or released buttons, follow with:
+//   uint16 edges   - bit n set if the button n was pressed or released.
+//   uint16 states  - bit n set if the button n is pressed, after debouncing.
+//   uint32 time    - for each button in edges, lowest first, micros() when
+//                    its edge started, or from the interrupt that saw it.
+// A command follows with the bytes received, without the delimiter.
+class Recorder {
+ public:
+  enum RecordType : uint8_t {
+    SAMPLE = 'S',
+    EDGES = 'E',
+    COMMAND = 'C'
+  };
+
+  static const uint8_t RECORD_MARKER = '#';
+
+  Recorder() : number(0) {}
+
+  // Write a sample record. Returns the number of bytes written.
+  int encodeSample(uint8_t* output, unsigned long time, uint16_t buttons, const AnalogSampler& sampler) {
+    int offset = encodeHeader(output, SAMPLE, time);
+    offset += encodeWord(output + offset, buttons);
+
+    for (uint8_t channel = 0; channel < sampler.channelCount(); channel++) {
+      offset += encodeWord(output + offset, sampler.readOversampled(channel));
+    }
+    return offset;
+  }
+
+  // Write an edges record if the last sample pressed or released any
+  // buttons. Returns the number of bytes written.
+  int encodeEdges(uint8_t* output, unsigned long time, const ButtonBank& buttons) {
+    uint16_t edges = buttons.lastEdges();
+    if (edges == 0) return 0;
+
+    int offset = encodeHeader(output, EDGES, time);
+    offset += encodeWord(output + offset, edges);
+    offset += encodeWord(output + offset, buttons.debouncedStates());
+    for (uint8_t i = 0; edges != 0; i++, edges >>= 1) {
+      if (!(edges & 1)) continue;
+      offset += encodeWord(output + offset, buttons.edgeTime(i) >> 16);
+      offset += encodeWord(output + offset, buttons.edgeTime(i) & 0xFFFF);
+    }
+    return offset;
+  }
+
+  // Write a command record. Commands too long to be valid are skipped,
+  // the decoder ignores them too. Returns the number of bytes written.
+  int encodeCommand(uint8_t* output, unsigned long time, const char* command, size_t length) {
+    if (length > BINARY_COMMAND_MAX_SIZE + 1) return 0;
+
+    int offset = encodeHeader(output, COMMAND, time);
+    memcpy(output + offset, command, length);
+    return offset + length;
+  }
+
+ private:
+  int encodeHeader(uint8_t* output, RecordType type, unsigned long time) {
+    output[0] = RECORD_MARKER;
+    output[1] = type;
+    output[2] = number++;
+    output[3] = time >> 24;
+    output[4] = (time >> 16) & 0xFF;
+    output[5] = (time >> 8) & 0xFF;
+    output[6] = time & 0xFF;
+    return 7;
+  }
+
+  static int encodeWord(uint8_t* output, uint16_t value) {
+    output[0] = value >> 8;
+    output[1] = value & 0xFF;
+    return 2;
+  }
+
+  uint8_t number;
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "Config.h"
+
+// Picks how often to send frames so they don't queue up on a slow link.
+// The inputs are still sampled every loop, only sending is skipped.
+//
+// After each send it looks at the bytes of older frames still queued. If
+// there are some, the link was busy the whole time since the last send,
+// so what it drained in that time is its throughput. The newest frame
+// waits for that queue to drain, plus however long the output call
+// blocked. Over the target latency the send interval grows quickly.
+// With an empty queue the interval shrinks slowly, probing for the
+// fastest rate the link keeps up with.
+//
+// This works for links that queue (the backlog grows) and links that
+// block (the output call takes longer) alike.
+class SendRateController {
+ public:
+  SendRateController(unsigned long min_interval, unsigned long max_interval, unsigned long target_latency) :
+    min_interval(min_interval), max_interval(max_interval), target_latency(target_latency),
+    interval(min_interval), last_send(0), last_backlog(0), throughput(0), latency(0) {}
+
+  // Whether it is time to send another frame.
+  bool shouldSend(unsigned long now) const {
+    return now - last_send >= interval;
+  }
+
+  // Report a send that ran from start to end. The backlog is the number of
+  // bytes the link has queued after it, accepted is what output returned.
+  void update(unsigned long start, unsigned long end, size_t length, size_t backlog, bool accepted) {
+    // Bytes of older frames that were still queued.
+    size_t standing = backlog > length ? backlog - length : 0;
+
+    unsigned long elapsed = start - last_send;
+    if (standing > 0 && last_backlog > standing && elapsed > 0 && elapsed < 1000000UL) {
+      unsigned long rate = (last_backlog - standing) * 1000000UL / elapsed;
+      // Exponential average over about 8 measurements.
+      throughput = throughput == 0 ? rate : throughput + (static_cast<long>(rate) - static_cast<long>(throughput)) / 8;
+    }
+
+    // Time the newest frame waits before it starts going out.
+    latency = end - start;
+    if (standing > 0 && throughput > 0) {
+      latency += standing * 1000000UL / throughput;
+    }
+
+    if (!accepted || latency > target_latency) {
+      // Back off fast, a growing queue only gets worse.
+      interval += interval / 4 + 500;
+    } else if (standing == 0) {
+      // The link kept up, creep back up to the full rate.
+      unsigned long step = interval / 32 + 50;
+      interval = interval > step ? interval - step : 0;
+    }
+    interval = constrain(interval, min_interval, max_interval);
+
+    last_send = start;
+    last_backlog = backlog;
+  }
+
+  // Current time between sends (us).
+  unsigned long sendInterval() const {
+    return interval;
+  }
+
+  // Estimated rate the link drains (bytes/s).
+  unsigned long linkThroughput() const {
+    return throughput;
+  }
+
+  // Estimated wait of the last frame sent before it started going out (us).
+  unsigned long queueLatency() const {
+    return latency;
+  }
+
+ private:
+  const unsigned long min_interval;
+  const unsigned long max_interval;
+  const unsigned long target_latency;
+
+  unsigned long interval;
+  unsigned long last_send;
+  size_t last_backlog;
+  unsigned long throughput;
+  unsigned long latency;
+};
@@ -3,10 +3,40 @@
 #include "ICommunication.hpp"
 #include "BluetoothSerial.h"
 
+// Set by the SPP events while the Bluetooth link can't take any more.
+volatile bool bt_congested = false;
+
+void btSppEvent(esp_spp_cb_event_t event, esp_spp_cb_param_t* param) {
+  if (event == ESP_SPP_CONG_EVT) {
+    bt_congested = param->cong.cong;
+  } else if (event == ESP_SPP_WRITE_EVT) {
+    bt_congested = param->write.cong;
+  } else if (event == ESP_SPP_CLOSE_EVT) {
+    bt_congested = false;
+  }
+}
+
 class BTSerialCommunication : public ICommunication {
  private:
   bool m_isOpen;
   BluetoothSerial m_SerialBT;
+  LineReader m_reader;
+  TransmitQueue m_transmitter;
+
+  // BluetoothSerial can't say how much it takes without waiting, its
+  // write waits while the SPP link is congested. The queue only writes
+  // to it while the link isn't.
+  struct Link {
+    BluetoothSerial& serial;
+
+    int availableForWrite() {
+      return bt_congested ? 0 : TRANSMIT_BUFFER_SIZE;
+    }
+
+    size_t write(const char* data, size_t length) {
+      return serial.write(reinterpret_cast<const uint8_t*>(data), length);
+    }
+  };
 
  public:
   BTSerialCommunication() {
@@ -19,14 +49,24 @@ class BTSerialCommunication : public ICommunication {
 
   void start() {
     Serial.begin(SERIAL_BAUD_RATE);
-    m_SerialBT.setTimeout(3);
+    m_SerialBT.register_callback(btSppEvent);
     m_SerialBT.begin(BT_SERIAL_DEVICE_NAME);
     Serial.println("The device started, now you can pair it with bluetooth!");
     m_isOpen = true;
   }
 
-  void output(char* data) {
-    m_SerialBT.print(data);
+  bool output(const char* data, size_t length) {
+    Link link = {m_SerialBT};
+    return m_transmitter.send(link, data, length);
+  }
+
+  void serviceOutput() {
+    Link link = {m_SerialBT};
+    m_transmitter.service(link);
+  }
+
+  size_t pendingBytes() {
+    return m_transmitter.pendingBytes();
   }
 
   bool hasData() override {
@@ -34,8 +74,6 @@ class BTSerialCommunication : public ICommunication {
   }
 
   bool readData(char* input, size_t buffer_size) {
-    size_t size = m_SerialBT.readBytesUntil('\n', input, buffer_size);
-    input[size] = NULL;
-    return size > 0;
+    return m_reader.readLine(m_SerialBT, input, buffer_size);
   }
 };
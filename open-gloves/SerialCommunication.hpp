@@ -6,6 +6,8 @@
 class SerialCommunication : public ICommunication {
   private:
     bool m_isOpen;
+    LineReader m_reader;
+    TransmitQueue m_transmitter;
 
   public:
     SerialCommunication() {
@@ -17,14 +19,21 @@ class SerialCommunication : public ICommunication {
     }
 
     void start(){
-      Serial.setTimeout(4);
       Serial.begin(SERIAL_BAUD_RATE);
       m_isOpen = true;
     }
 
-    void output(char* data){
-      Serial.print(data);
-      Serial.flush();
+    bool output(const char* data, size_t length){
+      // Waiting for the UART to drain would hold up the next sample.
+      return m_transmitter.send(Serial, data, length);
+    }
+
+    void serviceOutput(){
+      m_transmitter.service(Serial);
+    }
+
+    size_t pendingBytes(){
+      return m_transmitter.pendingBytes();
     }
 
     bool hasData() {
@@ -32,8 +41,6 @@ class SerialCommunication : public ICommunication {
     }
 
     bool readData(char* input, size_t buffer_size){
-      size_t size = Serial.readBytesUntil('\n', input, buffer_size);
-      input[size] = NULL;
-      return size > 0;
+      return m_reader.readLine(Serial, input, buffer_size);
     }
 };
@@ -4,11 +4,11 @@
 #include "ICommunication.hpp"
 #include <WiFi.h>
 
-#define WIFI_READ_BUFFER_LEN 100
 class WIFISerialCommunication : public ICommunication {
  private:
   WiFiServer m_server{WIFI_SERIAL_PORT};
   WiFiClient m_client;
+  LineReader m_reader;
 
  public:
   WIFISerialCommunication() {}
@@ -29,8 +29,17 @@ class WIFISerialCommunication : public ICommunication {
   }
 
   bool isOpen() {
-    // Set the client.
-    m_client = m_server.available();
+    // Only look for a new client when there isn't one, replacing the
+    // client every loop would throw away what it sent.
+    if (!m_client || !m_client.connected()) {
+      m_client = m_server.available();
+      if (m_client) {
+        // Whatever the last client left half sent isn't for this one.
+        m_reader.reset();
+        // Send each frame right away instead of batching them up.
+        m_client.setNoDelay(true);
+      }
+    }
 
     // Check the status of the client.
     return m_client && m_client.connected();
@@ -41,15 +50,14 @@ class WIFISerialCommunication : public ICommunication {
     return m_client.available() > 0;
   }
 
-  void output(char* data) {
+  bool output(const char* data, size_t length) {
     // Only call this if isOpen() returns true.
-    m_client.write(data);
+    m_client.write(reinterpret_cast<const uint8_t*>(data), length);
+    return true;
   }
 
   bool readData(char* input, size_t buffer_size) {
     // Only call this if isOpen() returns true.
-    size_t size = m_client.readBytesUntil('\n', input, buffer_size);
-    input[size] = NULL;
-    return size > 0;
+    return m_reader.readLine(m_client, input, buffer_size);
   }
 };
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "Config.h"
+#include "ICommunication.hpp"
+#include <WiFi.h>
+#include <WiFiUdp.h>
+
+// Sends each message in its own UDP datagram. A late frame is worth less
+// than a lost one, so nothing is retransmitted or held back to batch.
+//
+// Every datagram in either direction starts with a 16-bit big endian
+// sequence number followed by one message in the configured encoding.
+// Datagrams that are older than the newest one received are dropped.
+//
+// The glove learns where the driver is from the first datagram it
+// receives, so the driver has to send something, eg. an empty command,
+// to start the stream. Datagrams from anyone else are ignored until the
+// driver has been silent for WIFI_UDP_PEER_TIMEOUT, then the link is
+// closed and the next sender becomes the driver. The driver has to send
+// at least that often to keep the stream.
+class WIFIUDPCommunication : public ICommunication {
+ private:
+  // Size of the sequence number at the start of each datagram.
+  static const size_t HEADER_SIZE = 2;
+  // A sequence number this far behind the newest one is taken as the
+  // driver restarting instead of a late datagram.
+  static const int16_t REORDER_WINDOW = 64;
+
+  WiFiUDP m_udp;
+  IPAddress m_remote_ip;
+  uint16_t m_remote_port;
+  uint16_t m_send_sequence;
+  uint16_t m_receive_sequence;
+  bool m_received_any;
+  unsigned long m_last_heard;
+  uint8_t m_packet[HEADER_SIZE + RECEIVE_BUFFER_SIZE];
+
+ public:
+  WIFIUDPCommunication() :
+    m_remote_port(0), m_send_sequence(0), m_receive_sequence(0), m_received_any(false), m_last_heard(0) {}
+
+  void start() {
+    WiFi.mode(WIFI_STA);
+    WiFi.begin(WIFI_SERIAL_SSID, WIFI_SERIAL_PASSWORD);
+
+    if (WiFi.waitForConnectResult() != WL_CONNECTED) {
+      Serial.printf("WiFI connection failed!\n");
+      return;
+    }
+
+    Serial.begin(115200);
+    Serial.println("Your board is now connected to: ");
+    Serial.println(WiFi.localIP());
+    m_udp.begin(WIFI_SERIAL_PORT);
+  }
+
+  bool isOpen() {
+    // Open while the driver is heard from.
+    if (m_remote_port != 0 && millis() - m_last_heard >= WIFI_UDP_PEER_TIMEOUT) {
+      m_remote_port = 0;
+    }
+    return m_remote_port != 0;
+  }
+
+  bool hasData() {
+    return m_udp.parsePacket() > 0;
+  }
+
+  bool output(const char* data, size_t length) {
+    if (!isOpen()) return true;
+
+    uint8_t header[HEADER_SIZE] = {
+      static_cast<uint8_t>(m_send_sequence >> 8),
+      static_cast<uint8_t>(m_send_sequence & 0xFF)
+    };
+    m_send_sequence++;
+
+    m_udp.beginPacket(m_remote_ip, m_remote_port);
+    m_udp.write(header, HEADER_SIZE);
+    m_udp.write(reinterpret_cast<const uint8_t*>(data), length);
+    m_udp.endPacket();
+    return true;
+  }
+
+  bool readData(char* input, size_t buffer_size) {
+    // Only the newest command matters, read everything that is waiting.
+    bool received = false;
+    do {
+      received |= readPacket(input, buffer_size);
+    } while (m_udp.parsePacket() > 0);
+    return received;
+  }
+
+ private:
+  // Read the current datagram. Returns true if it was a new command.
+  bool readPacket(char* input, size_t buffer_size) {
+    int size = m_udp.read(m_packet, sizeof(m_packet));
+    if (size < static_cast<int>(HEADER_SIZE)) return false;
+    // Anything left over is too long to be a command.
+    if (m_udp.available() > 0) return false;
+
+    if (m_udp.remoteIP() != m_remote_ip || m_udp.remotePort() != m_remote_port) {
+      // Someone else, while the driver is still around.
+      if (isOpen()) return false;
+      m_remote_ip = m_udp.remoteIP();
+      m_remote_port = m_udp.remotePort();
+      m_received_any = false;
+    }
+    m_last_heard = millis();
+
+    uint16_t sequence = (m_packet[0] << 8) | m_packet[1];
+    int16_t age = m_receive_sequence - sequence;
+    if (m_received_any && age >= 0 && age < REORDER_WINDOW) return false;
+    m_receive_sequence = sequence;
+    m_received_any = true;
+
+    // Drop the delimiter if the driver sent one.
+    size_t length = size - HEADER_SIZE;
+    const char* message = reinterpret_cast<const char*>(m_packet + HEADER_SIZE);
+    if (length > 0 && message[length - 1] == ENCODING_DELIMITER) length--;
+    if (length == 0 || length >= buffer_size) return false;
+
+    memcpy(input, message, length);
+    input[length] = '\0';
+    return true;
+  }
+};
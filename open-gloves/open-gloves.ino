@@ -1,96 +1,153 @@
 #include "Config.h"
+#include "CalibrationStorage.hpp"
 #include "HardwareConfig.hpp"
 #include "ICommunication.hpp"
+#include "LatencyProbe.hpp"
+#include "LoopScheduler.hpp"
+#include "Profiler.hpp"
+#include "Recorder.hpp"
+#include "SendRateController.hpp"
 
 #if COMMUNICATION == COMM_SERIAL
   #include "SerialCommunication.hpp"
+  SerialCommunication comm;
 #elif COMMUNICATION == COMM_BLUETOOTH
   #include "SerialBTCommunication.hpp"
+  BTSerialCommunication comm;
 #elif COMMUNICATION == COMM_WIFI
   #include "SerialWIFICommunication.hpp"
+  WIFISerialCommunication comm;
+#elif COMMUNICATION == COMM_WIFI_UDP
+  #include "UDPWIFICommunication.hpp"
+  WIFIUDPCommunication comm;
 #endif
 
 #define ALWAYS_CALIBRATING CALIBRATION_LOOPS == -1
 
-ICommunication* comm;
 int calibration_count = 0;
 
-// These are composite lists of the hardware defined in the header above.
-EncodedInput* inputs[MAX_INPUT_COUNT];
-DecodedOuput* outputs[MAX_OUTPUT_COUNT];
-Calibrated* calibrators[MAX_CALIBRATED_COUNT];
+// Keeps the loop running every LOOP_TIME.
+LoopScheduler<> scheduler(LOOP_TIME * 1000UL);
 
-char* encoded_output_string;
-size_t input_count;
-size_t output_count;
-size_t calibrated_count;
+#if ENABLE_PROFILING
+  LoopProfiler profiler;
+#endif
 
-// Common pattern for registering inputs and outputs
-#define register(source, destination, new_count, existing) \
-do {                                                       \
-  for (size_t i = 0; i < new_count; existing++, i++) {     \
-    destination[existing] = source[i];                     \
-  }                                                        \
-} while(false)
+#if ENABLE_LATENCY_PROBE
+  LatencyProbe latency_probe;
+#endif
 
-void setup() {
-  #if COMMUNICATION == COMM_SERIAL
-    comm = new SerialCommunication();
-  #elif COMMUNICATION == COMM_BLUETOOTH
-    comm = new BTSerialCommunication();
-  #elif COMMUNICATION == COMM_WIFI
-    comm = new WIFISerialCommunication();
-  #endif
-
-  comm->start();
-
-  // Register the inputs.
-  input_count = 0;
-  register(buttons, inputs, BUTTON_COUNT, input_count);
-  register(fingers, inputs, FINGER_COUNT, input_count);
-  register(joysticks, inputs, JOYSTICK_COUNT, input_count);
-  register(gestures, inputs, GESTURE_COUNT, input_count);
-
-  // Register the calibrated inputs
-  calibrated_count = 0;
-  register(fingers, calibrators, FINGER_COUNT, calibrated_count);
-
-  // Register the outputs.
-  output_count = 0;
-  register(force_feedbacks, outputs, FORCE_FEEDBACK_COUNT, output_count);
-  register(haptics, outputs, HAPTIC_COUNT, output_count);
-
-  // Figure out needed size for the output string.
-  int string_size = 0;
-  for(size_t i = 0; i < input_count; i++) {
-    string_size += inputs[i]->getEncodedSize();
-  }
+#if ENABLE_RECORDING
+  Recorder recorder;
+#endif
 
-  // Add 1 new line and 1 for the null terminator.
-  encoded_output_string = new char[string_size + 1 + 1];
+#if ENABLE_FRAME_TIMING
+  FrameTiming frame_timing;
+  const FrameTiming* timing = &frame_timing;
+#else
+  const FrameTiming* timing = NULL;
+#endif
 
-  // Setup all the inputs.
-  for (size_t i = 0; i < input_count; i++) {
-    inputs[i]->setupInput();
-  }
+#if ENABLE_SEND_RATE_CONTROL
+  SendRateController send_rate(LOOP_TIME * 1000UL, SEND_RATE_MAX_INTERVAL * 1000UL, SEND_RATE_TARGET_LATENCY * 1000UL);
+#endif
 
-  // Setup all the outputs.
-  for (size_t i = 0; i < output_count; i++) {
-    outputs[i]->setupOutput();
-  }
+#if ENABLE_CALIBRATION_STORAGE
+  DefaultCalibrationStorage calibration_storage;
+  CalibrationStore calibration_store(&calibration_storage);
+#endif
 
-  // Setup the StatusLED.
-  led.setup();
+#if ENCODING == ENCODING_BINARY && ENABLE_DELTA_ENCODING
+  DeltaFilter delta_filter(DELTA_KEYFRAME_INTERVAL);
+  DeltaFilter* delta = &delta_filter;
+  bool was_open = false;
+#else
+  DeltaFilter* delta = NULL;
+#endif
 
-  if (ALWAYS_CALIBRATING) {
-    for (size_t i = 0; i < calibrated_count; i++) {
-      calibrators[i]->enableCalibration();
-    }
+// Routes the values received from the driver to the outputs.
+OutputDispatchTable output_table;
+
+#if ENCODING == ENCODING_BINARY
+  #define ENCODED_OUTPUT_SIZE BINARY_ENCODED_MAX_SIZE
+#else
+  // Add the timing, 1 new line and 1 for the null terminator.
+  #define ENCODED_OUTPUT_SIZE (InputRegistry::ENCODED_SIZE + (ENABLE_FRAME_TIMING ? FrameTiming::ENCODED_SIZE : 0) + 1 + 1)
+#endif
+
+static_assert(ENCODED_OUTPUT_SIZE <= TRANSMIT_BUFFER_SIZE, "A frame doesn't fit in the transmit buffer");
+#if ENABLE_PROFILING
+  static_assert(TELEMETRY_MAX_SIZE + TELEMETRY_MAX_SIZE / 254 + 2 <= TRANSMIT_BUFFER_SIZE,
+                "Telemetry doesn't fit in the transmit buffer");
+#endif
+#if ENABLE_RECORDING
+  static_assert(RECORD_MAX_SIZE + RECORD_MAX_SIZE / 254 + 2 <= TRANSMIT_BUFFER_SIZE,
+                "A record doesn't fit in the transmit buffer");
+#endif
+#if ENABLE_LATENCY_PROBE
+  static_assert(PING_REPLY_MAX_SIZE + PING_REPLY_MAX_SIZE / 254 + 2 <= TRANSMIT_BUFFER_SIZE,
+                "The ping reply doesn't fit in the transmit buffer");
+#endif
+
+#if ENABLE_DUAL_CORE
+  #include "LatestRing.hpp"
+
+  // A frame encoded by the sampling task, waiting to be sent.
+  struct EncodedFrame {
+    char data[ENCODED_OUTPUT_SIZE];
+    int size;
+  };
+
+  // A command received by the transport task, waiting to be decoded.
+  struct ReceivedCommand {
+    char data[RECEIVE_BUFFER_SIZE];
+  };
+
+  // Only the newest frame and command matter, older ones are replaced.
+  LatestRing<EncodedFrame> frame_ring;
+  LatestRing<ReceivedCommand> command_ring;
+
+  // Set by the transport task when the link dropped a frame.
+  std::atomic<bool> link_dropped_frame(false);
+  // Whether the driver is connected, kept by the transport task. Only the
+  // transport task may use comm, checking it can replace the WiFi client.
+  std::atomic<bool> link_open(false);
+
+  #if ENABLE_SEND_RATE_CONTROL
+    // The send rate controller belongs to the transport task, the sampling
+    // task paces the frames with the interval it publishes here.
+    std::atomic<unsigned long> send_interval(LOOP_TIME * 1000UL);
+    // When the sampling task last encoded a frame.
+    unsigned long last_encoded = 0;
+  #endif
+
+  TaskHandle_t transport_task;
+#else
+  char encoded_output_string[ENCODED_OUTPUT_SIZE];
+#endif
+
+// Adds each output to the dispatch table.
+struct RegisterOutput {
+  OutputDispatchTable& table;
+
+  void operator()(DecodedOuput& output) const {
+    table.registerOutput(&output);
   }
+};
+
+// Whether the driver is connected.
+bool linkOpen() {
+  #if ENABLE_DUAL_CORE
+    return link_open;
+  #else
+    return comm.isOpen();
+  #endif
 }
 
-void loop() {
-  if (!comm->isOpen()){
+// Show the connection state on the LED.
+void updateStatus() {
+  bool is_open = linkOpen();
+  if (!is_open){
     // Connection to Driver not ready, blink the LED to indicate no connection.
     led.setState(StatusLED::State::BLINK_STEADY);
   } else {
@@ -98,13 +155,21 @@ void loop() {
     led.setState(StatusLED::State::ON);
   }
 
+  #if ENCODING == ENCODING_BINARY && ENABLE_DELTA_ENCODING
+    // A new connection needs the full state.
+    if (is_open && !was_open) {
+      delta_filter.requestKeyframe();
+    }
+    was_open = is_open;
+  #endif
+}
+
+void updateCalibration() {
   // Notify the calibrators to turn on.
   if (calibration_button.isPressed()) {
     calibration_count = 0;
-    for (size_t i = 0; i < calibrated_count; i++) {
-      calibrators[i]->resetCalibration();
-      calibrators[i]->enableCalibration();
-    }
+    CalibratedRegistry::forEach(ResetCalibration());
+    CalibratedRegistry::forEach(EnableCalibration());
   }
 
   if (calibration_count < CALIBRATION_LOOPS || ALWAYS_CALIBRATING) {
@@ -112,35 +177,300 @@ void loop() {
     calibration_count++;
   } else {
     // Calibration is done, notify the calibrators
-    for (size_t i = 0; i < calibrated_count; i++) {
-      calibrators[i]->disableCalibration();
+    CalibratedRegistry::forEach(DisableCalibration());
+  }
+}
+
+// Update all the inputs. Returns the time they were read.
+unsigned long readInputs() {
+  unsigned long sample_time = micros();
+  analog_sampler.sample();
+  button_bank.sample(sample_time);
+  InputRegistry::forEach(ReadInput());
+
+  #if ENABLE_FRAME_TIMING
+    frame_timing.sample_time = sample_time;
+  #endif
+  return sample_time;
+}
+
+// Encode all of the inputs to a single string. Returns the encoded size.
+int encodeInputs(char* output) {
+  #if ENABLE_FRAME_TIMING
+    frame_timing.number++;
+  #endif
+
+  #if ENCODING == ENCODING_BINARY
+    int size = encodeAllBinary<InputRegistry>(output, delta, timing);
+  #else
+    int size = encodeAll<InputRegistry>(output, timing);
+  #endif
+
+  // The presses held for this frame can be let go.
+  button_bank.reported();
+  return size;
+}
+
+// Whether a frame should be sent this loop.
+bool sendDue() {
+  #if ENABLE_SEND_RATE_CONTROL && ENABLE_DUAL_CORE
+    unsigned long now = micros();
+    if (now - last_encoded < send_interval) return false;
+    last_encoded = now;
+    return true;
+  #elif ENABLE_SEND_RATE_CONTROL
+    return send_rate.shouldSend(micros());
+  #else
+    return true;
+  #endif
+}
+
+// Send a frame to the driver. Returns false if the link dropped one.
+bool sendFrame(const char* data, int size) {
+  #if ENABLE_SEND_RATE_CONTROL
+    unsigned long start = micros();
+    bool accepted = comm.output(data, size);
+    send_rate.update(start, micros(), size, comm.pendingBytes(), accepted);
+    #if ENABLE_DUAL_CORE
+      send_interval = send_rate.sendInterval();
+    #endif
+    return accepted;
+  #else
+    return comm.output(data, size);
+  #endif
+}
+
+#if ENABLE_RECORDING
+// Send a record of the log.
+void sendRecord(const uint8_t* record, int size) {
+  if (size == 0) return;
+
+  char framed_record[RECORD_MAX_SIZE + RECORD_MAX_SIZE / 254 + 2];
+  int framed_size = encodeMessage(framed_record, reinterpret_cast<const char*>(record), size);
+  if (!comm.output(framed_record, framed_size) && delta != NULL) {
+    // The record replaced a frame that was never sent.
+    delta->requestKeyframe();
+  }
+}
+#endif
+
+// Read a command from the driver if there is one.
+bool receiveCommand(char* received_bytes) {
+  return (ENABLE_SYNCHRONOUS_COMM || comm.hasData()) &&
+         comm.readData(received_bytes, RECEIVE_BUFFER_SIZE);
+}
+
+void decodeCommand(const char* received_bytes) {
+  #if ENCODING == ENCODING_BINARY
+    // Binary commands are zero free, so the length is the string length.
+    // An empty command is the driver asking for every value.
+    if (decodeAllBinary(received_bytes, strlen(received_bytes), output_table) == 0 && delta != NULL) {
+      delta->requestKeyframe();
+    }
+  #else
+    // Decode the update and write it to the outputs.
+    decodeAll(received_bytes, output_table);
+  #endif
+}
+
+#if ENABLE_DUAL_CORE
+// Reads, filters and encodes the inputs and drives the outputs at a
+// fixed rate. This is the only task that touches the hardware, so
+// nothing here waits on the driver.
+void samplingTask(void* parameters) {
+  for (;;) {
+    if (command_ring.take()) {
+      decodeCommand(command_ring.readSlot().data);
+    }
+
+    if (link_dropped_frame.exchange(false) && delta != NULL) {
+      // The driver missed the changes in the dropped frame.
+      delta->requestKeyframe();
+    }
+
+    updateStatus();
+    updateCalibration();
+
+    readInputs();
+
+    if (sendDue()) {
+      EncodedFrame& frame = frame_ring.writeSlot();
+      frame.size = encodeInputs(frame.data);
+      if (!frame_ring.publish() && delta != NULL) {
+        // The replaced frame was never sent, so the driver missed its changes.
+        delta->requestKeyframe();
+      }
+      xTaskNotifyGive(transport_task);
+    }
+
+    // Allow all the outputs to update their state.
+    OutputRegistry::forEach(UpdateOutput());
+
+    #if ENABLE_CALIBRATION_STORAGE
+      calibration_store.service(calibrators, MAX_CALIBRATED_COUNT);
+    #endif
+
+    scheduler.wait();
+  }
+}
+
+// Sends the newest frame and receives commands from the driver. This is
+// the only task that uses comm.
+void transportTask(void* parameters) {
+  // Poll for commands at least once a loop when no frames are coming.
+  const TickType_t poll_time = pdMS_TO_TICKS(LOOP_TIME) > 0 ? pdMS_TO_TICKS(LOOP_TIME) : 1;
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, poll_time);
+
+    link_open = comm.isOpen();
+    comm.serviceOutput();
+    if (frame_ring.take()) {
+      const EncodedFrame& frame = frame_ring.readSlot();
+      if (!sendFrame(frame.data, frame.size)) {
+        link_dropped_frame = true;
+      }
+    }
+
+    if (receiveCommand(command_ring.writeSlot().data)) {
+      command_ring.publish();
     }
   }
+}
+#endif
+
+void setup() {
+  comm.start();
+
+  OutputRegistry::forEach(RegisterOutput{output_table});
+
+  #if ENABLE_PROFILING
+    output_table.registerOutput(&profiler);
+  #endif
+
+  #if ENABLE_LATENCY_PROBE
+    output_table.registerOutput(&latency_probe);
+  #endif
+
+  // Setup all the inputs and outputs.
+  InputRegistry::forEach(SetupInput());
+  OutputRegistry::forEach(SetupOutput());
 
-  // Update all the inputs
-  for (int i = 0; i < input_count; i++) {
-    inputs[i]->readInput();
+  // The inputs have added their analog pins and buttons.
+  analog_sampler.begin();
+  button_bank.begin();
+
+  // Setup the StatusLED.
+  led.setup();
+
+  if (ALWAYS_CALIBRATING) {
+    CalibratedRegistry::forEach(EnableCalibration());
   }
 
-  // Encode all of the inputs to a single string.
-  encodeAll(encoded_output_string, inputs, input_count);
+  #if ENABLE_CALIBRATION_STORAGE
+    // A restored calibration is ready to use, skip calibrating at startup.
+    if (calibration_store.restore(calibrators, MAX_CALIBRATED_COUNT)) {
+      calibration_count = CALIBRATION_LOOPS;
+    }
+  #endif
+
+  scheduler.start();
+
+  #if ENABLE_DUAL_CORE
+    // The transport task must exist before the sampling task wakes it.
+    xTaskCreatePinnedToCore(transportTask, "transport", 4096, NULL, 1, &transport_task, TRANSPORT_CORE);
+    xTaskCreatePinnedToCore(samplingTask, "sampling", 4096, NULL, 1, NULL, SAMPLING_CORE);
+  #endif
+}
+
+#if ENABLE_DUAL_CORE
+void loop() {
+  // The tasks started in setup do all of the work.
+  vTaskDelete(NULL);
+}
+#else
+void loop() {
+  PROFILE_BEGIN(profiler);
+
+  updateStatus();
+  updateCalibration();
+  PROFILE_STAGE(profiler, CALIBRATION);
 
-  // Send the string to the communication handler.
-  comm->output(encoded_output_string);
+  #if ENABLE_RECORDING
+    unsigned long sample_time = readInputs();
+  #else
+    readInputs();
+  #endif
+  PROFILE_STAGE(profiler, READ_INPUTS);
+
+  // Flushing what the link held back isn't part of this frame's stages.
+  comm.serviceOutput();
+  PROFILE_SKIP(profiler);
+  if (sendDue()) {
+    int encoded_size = encodeInputs(encoded_output_string);
+    PROFILE_STAGE(profiler, ENCODE);
 
-  char received_bytes[100];
-  if ((ENABLE_SYNCHRONOUS_COMM || comm->hasData()) &&
-      comm->readData(received_bytes, 100)) {
-    for (size_t i = 0; i < output_count; i++) {
-      // Decode the update and write it to the output.
-      outputs[i]->decodeToOuput(received_bytes);
+    // Send the string to the communication handler.
+    if (!sendFrame(encoded_output_string, encoded_size) && delta != NULL) {
+      // The link dropped a frame, so the driver missed its changes.
+      delta->requestKeyframe();
     }
+    PROFILE_STAGE(profiler, SEND);
   }
 
-  // Allow all the outputs to update their state.
-  for (size_t i = 0; i < output_count; i++) {
-    outputs[i]->updateOutput();
+  #if ENABLE_RECORDING
+    // Log the readings after the frame so they don't hold it up.
+    uint8_t record[RECORD_MAX_SIZE];
+    sendRecord(record, recorder.encodeSample(record, sample_time, button_bank.rawStates(), analog_sampler));
+    sendRecord(record, recorder.encodeEdges(record, sample_time, button_bank));
+  #endif
+
+  // Skipped sends and the records aren't counted as receiving.
+  PROFILE_SKIP(profiler);
+  char received_bytes[RECEIVE_BUFFER_SIZE];
+  if (receiveCommand(received_bytes)) {
+    #if ENABLE_RECORDING
+      sendRecord(record, recorder.encodeCommand(record, micros(), received_bytes, strlen(received_bytes)));
+    #endif
+    decodeCommand(received_bytes);
   }
+  PROFILE_STAGE(profiler, RECEIVE);
+
+  // Allow all the outputs to update their state.
+  OutputRegistry::forEach(UpdateOutput());
+  PROFILE_STAGE(profiler, UPDATE_OUTPUTS);
+
+  #if ENABLE_LATENCY_PROBE
+    // Answer a ping once its command has reached the outputs.
+    latency_probe.outputsUpdated();
+    if (latency_probe.replyReady()) {
+      char reply[PING_REPLY_MAX_SIZE];
+      char framed_reply[PING_REPLY_MAX_SIZE + PING_REPLY_MAX_SIZE / 254 + 2];
+      int size = latency_probe.encodeReply(reply);
+      if (!comm.output(framed_reply, encodeMessage(framed_reply, reply, size)) && delta != NULL) {
+        // The reply replaced a frame that was never sent.
+        delta->requestKeyframe();
+      }
+    }
+  #endif
+
+  #if ENABLE_CALIBRATION_STORAGE
+    calibration_store.service(calibrators, MAX_CALIBRATED_COUNT);
+  #endif
 
-  delay(LOOP_TIME);
+  #if ENABLE_PROFILING
+    // Send the timings if the driver asked for them.
+    if (profiler.telemetryRequested()) {
+      char telemetry[TELEMETRY_MAX_SIZE];
+      char framed_telemetry[TELEMETRY_MAX_SIZE + TELEMETRY_MAX_SIZE / 254 + 2];
+      int size = profiler.encodeTelemetry(telemetry, scheduler.getStats());
+      scheduler.resetStats();
+      if (!comm.output(framed_telemetry, encodeMessage(framed_telemetry, telemetry, size)) && delta != NULL) {
+        // The telemetry replaced a frame that was never sent.
+        delta->requestKeyframe();
+      }
+    }
+  #endif
+
+  scheduler.wait();
 }
+#endif